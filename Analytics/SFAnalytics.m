@@ -237,6 +237,17 @@ const NSTimeInterval SFAnalyticsSamplerIntervalOncePerReport = -1.0;
     });
 }
 
+- (void)flushPendingWrites
+{
+    __weak __typeof(self) weakSelf = self;
+    dispatch_sync(_queue, ^{
+        __strong __typeof(self) strongSelf = weakSelf;
+        if (strongSelf) {
+            [strongSelf.database flushPendingWrites];
+        }
+    });
+}
+
 - (void)setDateProperty:(NSDate*)date forKey:(NSString*)key
 {
     __weak __typeof(self) weakSelf = self;
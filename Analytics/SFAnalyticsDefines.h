@@ -67,6 +67,9 @@ extern NSString* const SFAnalyticsTableSchema;
 // We can only send this many events in total to splunk per upload
 extern NSUInteger const SFAnalyticsMaxEventsToReport;
 
+// The store writes out buffered counter increments and rows once this many are pending
+extern NSUInteger const SFAnalyticsMaxPendingWrites;
+
 extern NSString* const SFAnalyticsErrorDomain;
 
 #endif /* __OBJC2__ */
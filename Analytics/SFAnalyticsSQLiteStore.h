@@ -47,6 +47,11 @@
 - (void)removeAllSamplesForName:(NSString*)name;
 - (void)clearAllData;
 
+// Counter increments, events and samples are buffered and written in batches; this writes them out now.
+// Pending writes are flushed within a few seconds, hold an os_transaction until then so an idle daemon
+// isn't exited under them, and are flushed at exit(). They are lost if the process crashes or is killed first.
+- (void)flushPendingWrites;
+
 - (NSDictionary*)summaryCounts;
 
 @end
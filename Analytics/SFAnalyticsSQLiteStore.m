@@ -26,13 +26,43 @@
 #import "SFAnalyticsSQLiteStore.h"
 #import "SFAnalyticsDefines.h"
 #import "debugging.h"
+#include <os/transaction_private.h>
 
 NSString* const SFAnalyticsColumnEventType = @"event_type";
 NSString* const SFAnalyticsColumnDate = @"timestamp";
 NSString* const SFAnalyticsColumnData = @"data";
 NSString* const SFAnalyticsUploadDate = @"upload_date";
 
-@implementation SFAnalyticsSQLiteStore
+// Counter increments and new rows are held in memory and written out together in one transaction,
+// either once this many have built up or shortly after the first one arrives.
+NSUInteger const SFAnalyticsMaxPendingWrites = 64;
+static const int64_t SFAnalyticsPendingWriteDelay = 5 * NSEC_PER_SEC;
+
+// One store per path, shared by every logger in the process. Guarded by the class.
+static NSMutableDictionary<NSString*, SFAnalyticsSQLiteStore*>* loggingStores = nil;
+
+// Nothing else closes the shared stores, so write out what's pending when the process exits
+static void SFAnalyticsFlushStoresAtExit(void)
+{
+    @autoreleasepool {
+        NSArray<SFAnalyticsSQLiteStore*>* stores = nil;
+        @synchronized([SFAnalyticsSQLiteStore class]) {
+            stores = [loggingStores allValues];
+        }
+        for (SFAnalyticsSQLiteStore* store in stores) {
+            [store flushPendingWrites];
+        }
+    }
+}
+
+@implementation SFAnalyticsSQLiteStore {
+    NSMutableDictionary<NSString*, NSMutableDictionary<NSString*, NSNumber*>*>* _pendingCounts;
+    NSMutableDictionary<NSString*, NSMutableArray<NSDictionary*>*>* _pendingRows;
+    NSUInteger _pendingWrites;
+    BOOL _flushScheduled;
+    // Keeps an idle daemon from being reaped while writes are pending
+    os_transaction_t _pendingTransaction;
+}
 
 + (instancetype)storeWithPath:(NSString*)path schema:(NSString*)schema
 {
@@ -47,10 +77,10 @@ NSString* const SFAnalyticsUploadDate = @"upload_date";
 
     SFAnalyticsSQLiteStore* store = nil;
     @synchronized([SFAnalyticsSQLiteStore class]) {
-        static NSMutableDictionary* loggingStores = nil;
         static dispatch_once_t onceToken;
         dispatch_once(&onceToken, ^{
             loggingStores = [[NSMutableDictionary alloc] init];
+            atexit(SFAnalyticsFlushStoresAtExit);
         });
 
         NSString* standardizedPath = path.stringByStandardizingPath;
@@ -68,87 +98,195 @@ NSString* const SFAnalyticsUploadDate = @"upload_date";
     return store;
 }
 
+- (instancetype)initWithPath:(NSString*)path schema:(NSString*)schema
+{
+    if ((self = [super initWithPath:path schema:schema])) {
+        _pendingCounts = [NSMutableDictionary new];
+        _pendingRows = [NSMutableDictionary new];
+    }
+    return self;
+}
+
 - (void)dealloc
 {
     [self close];
 }
 
+- (void)close
+{
+    @synchronized(self) {
+        if (self.isOpen) {
+            [self flushPendingWrites];
+        }
+        [super close];
+    }
+}
+
 - (BOOL)tryToOpenDatabase
 {
-    if (!self.isOpen) {
-        NSError* error = nil;
-        if (![self openWithError:&error]) {
-            return NO;
+    @synchronized(self) {
+        if (!self.isOpen) {
+            NSError* error = nil;
+            if (![self openWithError:&error]) {
+                return NO;
+            }
+            secnotice("SFAnalytics", "successfully opened analytics db");
+        }
+        return YES;
+    }
+}
+
+// Must be called with self locked
+- (void)noteWritePending
+{
+    if (!_pendingTransaction) {
+        _pendingTransaction = os_transaction_create("com.apple.security.analytics.pendingwrites");
+    }
+    if (++_pendingWrites >= SFAnalyticsMaxPendingWrites) {
+        [self flushPendingWrites];
+    } else if (!_flushScheduled) {
+        _flushScheduled = YES;
+        __weak __typeof(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, SFAnalyticsPendingWriteDelay), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+            [weakSelf flushPendingWrites];
+        });
+    }
+}
+
+- (void)addPendingCount:(NSString*)column forEventType:(NSString*)eventType
+{
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return;
+        }
+        NSMutableDictionary<NSString*, NSNumber*>* counts = _pendingCounts[eventType];
+        if (!counts) {
+            counts = [NSMutableDictionary new];
+            _pendingCounts[eventType] = counts;
+        }
+        counts[column] = @([counts[column] integerValue] + 1);
+        [self noteWritePending];
+    }
+}
+
+- (void)addPendingRow:(NSDictionary*)values toTable:(NSString*)table
+{
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return;
+        }
+        NSMutableArray<NSDictionary*>* rows = _pendingRows[table];
+        if (!rows) {
+            rows = [NSMutableArray new];
+            _pendingRows[table] = rows;
+        }
+        [rows addObject:values];
+        [self noteWritePending];
+    }
+}
+
+- (void)flushPendingWrites
+{
+    @synchronized(self) {
+        _flushScheduled = NO;
+        // Released once this flush is over
+        os_transaction_t transaction = _pendingTransaction;
+        _pendingTransaction = nil;
+        if (_pendingWrites == 0) {
+            return;
+        }
+
+        // Taken up front: if the write fails they are dropped, as a failed direct write always was
+        NSDictionary<NSString*, NSDictionary<NSString*, NSNumber*>*>* pendingCounts = _pendingCounts;
+        NSDictionary<NSString*, NSArray<NSDictionary*>*>* pendingRows = _pendingRows;
+        _pendingCounts = [NSMutableDictionary new];
+        _pendingRows = [NSMutableDictionary new];
+        _pendingWrites = 0;
+
+        if (![self tryToOpenDatabase]) {
+            return;
+        }
+
+        [self begin];
+        for (NSString* eventType in pendingCounts) {
+            NSDictionary<NSString*, NSNumber*>* deltas = pendingCounts[eventType];
+            NSDictionary* row = [[self select:@[SFAnalyticsColumnSuccessCount, SFAnalyticsColumnHardFailureCount, SFAnalyticsColumnSoftFailureCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject];
+            NSInteger successCount = [row[SFAnalyticsColumnSuccessCount] integerValue] + [deltas[SFAnalyticsColumnSuccessCount] integerValue];
+            NSInteger hardFailureCount = [row[SFAnalyticsColumnHardFailureCount] integerValue] + [deltas[SFAnalyticsColumnHardFailureCount] integerValue];
+            NSInteger softFailureCount = [row[SFAnalyticsColumnSoftFailureCount] integerValue] + [deltas[SFAnalyticsColumnSoftFailureCount] integerValue];
+            [self insertOrReplaceInto:SFAnalyticsTableSuccessCount values:@{SFAnalyticsColumnEventType : eventType, SFAnalyticsColumnSuccessCount : @(successCount), SFAnalyticsColumnHardFailureCount : @(hardFailureCount), SFAnalyticsColumnSoftFailureCount : @(softFailureCount)}];
+        }
+        for (NSString* table in pendingRows) {
+            for (NSDictionary* values in pendingRows[table]) {
+                [self insertOrReplaceInto:table values:values];
+            }
         }
-        secnotice("SFAnalytics", "successfully opened analytics db");
+        [self end];
+
+        (void)transaction; // dead store
+        transaction = nil;
     }
-    return YES;
 }
 
 - (NSInteger)successCountForEventType:(NSString*)eventType
 {
-    if (![self tryToOpenDatabase]) {
-        return 0;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return 0;
+        }
+        [self flushPendingWrites];
+        return [[[[self select:@[SFAnalyticsColumnSuccessCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject] valueForKey:SFAnalyticsColumnSuccessCount] integerValue];
     }
-    return [[[[self select:@[SFAnalyticsColumnSuccessCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject] valueForKey:SFAnalyticsColumnSuccessCount] integerValue];
 }
 
 - (void)incrementSuccessCountForEventType:(NSString*)eventType
 {
-    if (![self tryToOpenDatabase]) {
-        return;
-    }
-    NSInteger successCount = [self successCountForEventType:eventType];
-    NSInteger hardFailureCount = [self hardFailureCountForEventType:eventType];
-    NSInteger softFailureCount = [self softFailureCountForEventType:eventType];
-    [self insertOrReplaceInto:SFAnalyticsTableSuccessCount values:@{SFAnalyticsColumnEventType : eventType, SFAnalyticsColumnSuccessCount : @(successCount + 1), SFAnalyticsColumnHardFailureCount : @(hardFailureCount), SFAnalyticsColumnSoftFailureCount : @(softFailureCount)}];
+    [self addPendingCount:SFAnalyticsColumnSuccessCount forEventType:eventType];
 }
 
 - (NSInteger)hardFailureCountForEventType:(NSString*)eventType
 {
-    if (![self tryToOpenDatabase]) {
-        return 0;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return 0;
+        }
+        [self flushPendingWrites];
+        return [[[[self select:@[SFAnalyticsColumnHardFailureCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject] valueForKey:SFAnalyticsColumnHardFailureCount] integerValue];
     }
-    return [[[[self select:@[SFAnalyticsColumnHardFailureCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject] valueForKey:SFAnalyticsColumnHardFailureCount] integerValue];
 }
 
 - (NSInteger)softFailureCountForEventType:(NSString*)eventType
 {
-    if (![self tryToOpenDatabase]) {
-        return 0;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return 0;
+        }
+        [self flushPendingWrites];
+        return [[[[self select:@[SFAnalyticsColumnSoftFailureCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject] valueForKey:SFAnalyticsColumnSoftFailureCount] integerValue];
     }
-    return [[[[self select:@[SFAnalyticsColumnSoftFailureCount] from:SFAnalyticsTableSuccessCount where:@"event_type = ?" bindings:@[eventType]] firstObject] valueForKey:SFAnalyticsColumnSoftFailureCount] integerValue];
 }
 
 - (void)incrementHardFailureCountForEventType:(NSString*)eventType
 {
-    if (![self tryToOpenDatabase]) {
-        return;
-    }
-    NSInteger successCount = [self successCountForEventType:eventType];
-    NSInteger hardFailureCount = [self hardFailureCountForEventType:eventType];
-    NSInteger softFailureCount = [self softFailureCountForEventType:eventType];
-    [self insertOrReplaceInto:SFAnalyticsTableSuccessCount values:@{SFAnalyticsColumnEventType : eventType, SFAnalyticsColumnSuccessCount : @(successCount), SFAnalyticsColumnHardFailureCount : @(hardFailureCount + 1), SFAnalyticsColumnSoftFailureCount : @(softFailureCount)}];
+    [self addPendingCount:SFAnalyticsColumnHardFailureCount forEventType:eventType];
 }
 
 - (void)incrementSoftFailureCountForEventType:(NSString*)eventType
 {
-    if (![self tryToOpenDatabase]) {
-        return;
-    }
-    NSInteger successCount = [self successCountForEventType:eventType];
-    NSInteger hardFailureCount = [self hardFailureCountForEventType:eventType];
-    NSInteger softFailureCount = [self softFailureCountForEventType:eventType];
-    [self insertOrReplaceInto:SFAnalyticsTableSuccessCount values:@{SFAnalyticsColumnEventType : eventType, SFAnalyticsColumnSuccessCount : @(successCount), SFAnalyticsColumnHardFailureCount : @(hardFailureCount), SFAnalyticsColumnSoftFailureCount : @(softFailureCount + 1)}];
+    [self addPendingCount:SFAnalyticsColumnSoftFailureCount forEventType:eventType];
 }
 
 - (NSDictionary*)summaryCounts
 {
-    if (![self tryToOpenDatabase]) {
-        return [NSDictionary new];
+    NSArray* rows = nil;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return [NSDictionary new];
+        }
+        [self flushPendingWrites];
+        rows = [self selectAllFrom:SFAnalyticsTableSuccessCount where:nil bindings:nil];
     }
     NSMutableDictionary* successCountsDict = [NSMutableDictionary dictionary];
-    NSArray* rows = [self selectAllFrom:SFAnalyticsTableSuccessCount where:nil bindings:nil];
     for (NSDictionary* rowDict in rows) {
         NSString* eventName = rowDict[SFAnalyticsColumnEventType];
         if (!eventName) {
@@ -177,34 +315,52 @@ NSString* const SFAnalyticsUploadDate = @"upload_date";
 
 - (NSArray*)hardFailures
 {
-    if (![self tryToOpenDatabase]) {
-        return [NSArray new];
+    NSArray* recordBlobs = nil;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return [NSArray new];
+        }
+        [self flushPendingWrites];
+        recordBlobs = [self select:@[SFAnalyticsColumnData] from:SFAnalyticsTableHardFailures];
     }
-    return [self deserializedRecords:[self select:@[SFAnalyticsColumnData] from:SFAnalyticsTableHardFailures]];
+    return [self deserializedRecords:recordBlobs];
 }
 
 - (NSArray*)softFailures
 {
-    if (![self tryToOpenDatabase]) {
-        return [NSArray new];
+    NSArray* recordBlobs = nil;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return [NSArray new];
+        }
+        [self flushPendingWrites];
+        recordBlobs = [self select:@[SFAnalyticsColumnData] from:SFAnalyticsTableSoftFailures];
     }
-    return [self deserializedRecords:[self select:@[SFAnalyticsColumnData] from:SFAnalyticsTableSoftFailures]];
+    return [self deserializedRecords:recordBlobs];
 }
 
 - (NSArray*)allEvents
 {
-    if (![self tryToOpenDatabase]) {
-        return [NSArray new];
+    NSArray* recordBlobs = nil;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return [NSArray new];
+        }
+        [self flushPendingWrites];
+        recordBlobs = [self select:@[SFAnalyticsColumnData] from:SFAnalyticsTableAllEvents];
     }
-    return [self deserializedRecords:[self select:@[SFAnalyticsColumnData] from:SFAnalyticsTableAllEvents]];
+    return [self deserializedRecords:recordBlobs];
 }
 
 - (NSArray*)samples
 {
-    if (![self tryToOpenDatabase]) {
-        return [NSArray new];
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return [NSArray new];
+        }
+        [self flushPendingWrites];
+        return [self select:@[SFAnalyticsColumnSampleName, SFAnalyticsColumnSampleValue] from:SFAnalyticsTableSamples];
     }
-    return [self select:@[SFAnalyticsColumnSampleName, SFAnalyticsColumnSampleValue] from:SFAnalyticsTableSamples];
 }
 
 - (void)addEventDict:(NSDictionary*)eventDict toTable:(NSString*)table
@@ -215,7 +371,7 @@ NSString* const SFAnalyticsUploadDate = @"upload_date";
     NSError* error = nil;
     NSData* serializedRecord = [NSPropertyListSerialization dataWithPropertyList:eventDict format:NSPropertyListBinaryFormat_v1_0 options:0 error:&error];
     if(!error && serializedRecord) {
-        [self insertOrReplaceInto:table values:@{SFAnalyticsColumnDate : @([[NSDate date] timeIntervalSince1970]), SFAnalyticsColumnData : serializedRecord}];
+        [self addPendingRow:@{SFAnalyticsColumnDate : @([[NSDate date] timeIntervalSince1970]), SFAnalyticsColumnData : serializedRecord} toTable:table];
     }
     if(error && !serializedRecord) {
         secerror("Couldn't serialize failure record: %@", error);
@@ -227,15 +383,21 @@ NSString* const SFAnalyticsUploadDate = @"upload_date";
     if (![self tryToOpenDatabase]) {
         return;
     }
-    [self insertOrReplaceInto:SFAnalyticsTableSamples values:@{SFAnalyticsColumnDate : @([[NSDate date] timeIntervalSince1970]), SFAnalyticsColumnSampleName : name, SFAnalyticsColumnSampleValue : value}];
+    [self addPendingRow:@{SFAnalyticsColumnDate : @([[NSDate date] timeIntervalSince1970]), SFAnalyticsColumnSampleName : name, SFAnalyticsColumnSampleValue : value} toTable:SFAnalyticsTableSamples];
 }
 
 - (void)removeAllSamplesForName:(NSString*)name
 {
-    if (![self tryToOpenDatabase]) {
-        return;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return;
+        }
+        NSMutableArray<NSDictionary*>* pendingSamples = _pendingRows[SFAnalyticsTableSamples];
+        NSUInteger pendingCount = pendingSamples.count;
+        [pendingSamples filterUsingPredicate:[NSPredicate predicateWithFormat:@"%K != %@", SFAnalyticsColumnSampleName, name]];
+        _pendingWrites -= pendingCount - pendingSamples.count;
+        [self deleteFrom:SFAnalyticsTableSamples where:[NSString stringWithFormat:@"name == '%@'", name] bindings:nil];
     }
-    [self deleteFrom:SFAnalyticsTableSamples where:[NSString stringWithFormat:@"name == '%@'", name] bindings:nil];
 }
 
 - (NSDate*)uploadDate
@@ -254,16 +416,38 @@ NSString* const SFAnalyticsUploadDate = @"upload_date";
     [self setDateProperty:uploadDate forKey:SFAnalyticsUploadDate];
 }
 
+// A deferred flush can run on any thread, so everything that touches the connection takes the same lock
+- (NSDate*)datePropertyForKey:(NSString*)key
+{
+    @synchronized(self) {
+        return [super datePropertyForKey:key];
+    }
+}
+
+- (void)setDateProperty:(NSDate*)value forKey:(NSString*)key
+{
+    @synchronized(self) {
+        [super setDateProperty:value forKey:key];
+    }
+}
+
 - (void)clearAllData
 {
-    if (![self tryToOpenDatabase]) {
-        return;
+    @synchronized(self) {
+        if (![self tryToOpenDatabase]) {
+            return;
+        }
+        [_pendingCounts removeAllObjects];
+        [_pendingRows removeAllObjects];
+        _pendingWrites = 0;
+        _pendingTransaction = nil;
+
+        [self deleteFrom:SFAnalyticsTableSuccessCount where:@"event_type like ?" bindings:@[@"%"]];
+        [self deleteFrom:SFAnalyticsTableHardFailures where:@"id >= 0" bindings:nil];
+        [self deleteFrom:SFAnalyticsTableSoftFailures where:@"id >= 0" bindings:nil];
+        [self deleteFrom:SFAnalyticsTableSamples where:@"id >= 0" bindings:nil];
+        [self deleteFrom:SFAnalyticsTableAllEvents where:@"id >= 0" bindings:nil];
     }
-    [self deleteFrom:SFAnalyticsTableSuccessCount where:@"event_type like ?" bindings:@[@"%"]];
-    [self deleteFrom:SFAnalyticsTableHardFailures where:@"id >= 0" bindings:nil];
-    [self deleteFrom:SFAnalyticsTableSoftFailures where:@"id >= 0" bindings:nil];
-    [self deleteFrom:SFAnalyticsTableSamples where:@"id >= 0" bindings:nil];
-    [self deleteFrom:SFAnalyticsTableAllEvents where:@"id >= 0" bindings:nil];
 }
 
 @end
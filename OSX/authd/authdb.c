@@ -28,12 +28,27 @@ AUTHD_DEFINE_LOG
 
 #define AUTHDB_BUSY_DELAY 1
 #define AUTHDB_MAX_HANDLES 3
+#define AUTHDB_STMT_CACHE_SIZE 32
+
+struct _authdb_cached_stmt_s {
+    char * sql;
+    sqlite3_stmt * stmt;
+    bool in_use;
+};
 
 struct _authdb_connection_s {
     __AUTH_BASE_STRUCT_HEADER__;
     
     authdb_t db;
     sqlite3 * handle;
+    
+    // most recently used first
+    struct _authdb_cached_stmt_s stmt_cache[AUTHDB_STMT_CACHE_SIZE];
+    uint32_t stmt_cache_count;
+    
+    // row container for authdb_step_view
+    auth_items_t row;
+    bool row_in_use;
 };
 
 struct _authdb_s {
@@ -118,6 +133,7 @@ static const char * const authdb_upgrade_sql[] = {
 };
 
 static sqlite3 * _create_handle(authdb_t db);
+static void _stmt_cache_flush(authdb_connection_t dbconn);
 
 static int32_t
 _sqlite3_exec(sqlite3 * handle, const char * query)
@@ -335,6 +351,8 @@ static void _handle_corrupt_db(authdb_connection_t dbconn)
 	if (corrupt_db)
 		sqlite3_close(corrupt_db);
 
+    // the truncated database gets a new schema, don't keep statements compiled against the old one
+    _stmt_cache_flush(dbconn);
     _truncate_db(dbconn);
 }
 
@@ -635,6 +653,107 @@ done:
     return rc;
 }
 
+#pragma mark -
+#pragma mark statement cache
+
+/*
+ * Every statement authdb_step runs comes from a small set of literal SQL strings,
+ * so keep them compiled per connection. Statements handed out are marked in use;
+ * a nested authdb_step with the same SQL (e.g. delegates of delegates) gets a
+ * private statement that's finalized on release.
+ */
+static int32_t _stmt_acquire(authdb_connection_t dbconn, const char * sql, sqlite3_stmt ** out_stmt, bool * out_cached)
+{
+    int32_t rc;
+    sqlite3_stmt * stmt = NULL;
+    struct _authdb_cached_stmt_s * cache = dbconn->stmt_cache;
+    char * sql_copy = NULL;
+    bool busy = false;
+    
+    *out_cached = false;
+    
+    for (uint32_t i = 0; i < dbconn->stmt_cache_count; i++) {
+        if (strcmp(cache[i].sql, sql) != 0) {
+            continue;
+        }
+        if (cache[i].in_use) {
+            busy = true;
+            break;
+        }
+        struct _authdb_cached_stmt_s hit = cache[i];
+        memmove(&cache[1], &cache[0], i * sizeof(*cache));
+        hit.in_use = true;
+        cache[0] = hit;
+        *out_stmt = hit.stmt;
+        *out_cached = true;
+        return SQLITE_OK;
+    }
+    
+    rc = _prepare(dbconn, sql, false, &stmt);
+    require_noerr(rc, done);
+    *out_stmt = stmt;
+    require_quiet(!busy, done);
+    
+    // evict the least recently used statement, unless it's busy
+    if (dbconn->stmt_cache_count == AUTHDB_STMT_CACHE_SIZE) {
+        struct _authdb_cached_stmt_s * last = &cache[AUTHDB_STMT_CACHE_SIZE - 1];
+        require_quiet(!last->in_use, done);
+        sqlite3_finalize(last->stmt);
+        free_safe(last->sql);
+        dbconn->stmt_cache_count--;
+    }
+    
+    sql_copy = strdup(sql);
+    require_quiet(sql_copy != NULL, done);
+    memmove(&cache[1], &cache[0], dbconn->stmt_cache_count * sizeof(*cache));
+    cache[0].sql = sql_copy;
+    cache[0].stmt = stmt;
+    cache[0].in_use = true;
+    dbconn->stmt_cache_count++;
+    *out_cached = true;
+    
+done:
+    return rc;
+}
+
+static void _stmt_release(authdb_connection_t dbconn, sqlite3_stmt * stmt, bool cached)
+{
+    if (!stmt) {
+        return;
+    }
+    
+    if (!cached) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    
+    // callers bind with SQLITE_STATIC, so drop the bindings along with the read lock
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    for (uint32_t i = 0; i < dbconn->stmt_cache_count; i++) {
+        if (dbconn->stmt_cache[i].stmt == stmt) {
+            dbconn->stmt_cache[i].in_use = false;
+            return;
+        }
+    }
+    
+    // flushed while in use
+    sqlite3_finalize(stmt);
+}
+
+static void _stmt_cache_flush(authdb_connection_t dbconn)
+{
+    for (uint32_t i = 0; i < dbconn->stmt_cache_count; i++) {
+        struct _authdb_cached_stmt_s * entry = &dbconn->stmt_cache[i];
+        // statements in use are finalized by _stmt_release once they're no longer found here
+        if (!entry->in_use) {
+            sqlite3_finalize(entry->stmt);
+        }
+        free_safe(entry->sql);
+    }
+    dbconn->stmt_cache_count = 0;
+}
+
 static void _parseItemsAtIndex(sqlite3_stmt * stmt, int32_t col, auth_items_t items, const char * key)
 {
     switch (sqlite3_column_type(stmt, col)) {
@@ -836,15 +955,18 @@ done:
     return commit;
 }
 
-bool authdb_step(authdb_connection_t dbconn, const char * sql, void (^bind_stmt)(sqlite3_stmt*), authdb_iterator_t iter)
+static bool _step(authdb_connection_t dbconn, const char * sql, void (^bind_stmt)(sqlite3_stmt*), authdb_iterator_t iter, bool reuse_row)
 {
     bool result = false;
     sqlite3_stmt * stmt = NULL;
+    bool cached = false;
     int32_t rc = SQLITE_ERROR;
+    auth_items_t items = NULL;
+    bool owns_row = false;
     
     require_action(sql != NULL, done, rc = SQLITE_ERROR);
     
-    rc = _prepare(dbconn, sql, false, &stmt);
+    rc = _stmt_acquire(dbconn, sql, &stmt, &cached);
     require_noerr(rc, done);
     
     if (bind_stmt) {
@@ -853,18 +975,36 @@ bool authdb_step(authdb_connection_t dbconn, const char * sql, void (^bind_stmt)
     
     int32_t count = sqlite3_column_count(stmt);
     
-    auth_items_t items = NULL;
+    if (iter && reuse_row) {
+        if (!dbconn->row_in_use) {
+            if (!dbconn->row) {
+                dbconn->row = auth_items_create();
+            }
+            items = (auth_items_t)CFRetain(dbconn->row);
+            dbconn->row_in_use = owns_row = true;
+        } else {
+            // nested call, the connection's row is taken
+            items = auth_items_create();
+        }
+    }
+    
     while ((rc = sqlite3_step(stmt)) != SQLITE_DONE) {
         switch (rc) {
             case SQLITE_ROW:
                 {
                     if (iter) {
-                        items = auth_items_create();
+                        if (reuse_row) {
+                            auth_items_clear(items);
+                        } else {
+                            items = auth_items_create();
+                        }
                         for (int i = 0; i < count; i++) {
                             _parseItemsAtIndex(stmt, i, items, sqlite3_column_name(stmt, i));
                         }
                         result = iter(items);
-                        CFReleaseNull(items);
+                        if (!reuse_row) {
+                            CFReleaseNull(items);
+                        }
                         if (!result) {
                             goto done;
                         }
@@ -885,10 +1025,28 @@ bool authdb_step(authdb_connection_t dbconn, const char * sql, void (^bind_stmt)
     
 done:
     _checkResult(dbconn, rc, __FUNCTION__, stmt, false);
-    sqlite3_finalize(stmt);
+    _stmt_release(dbconn, stmt, cached);
+    if (items) {
+        // don't hold on to the last row's values
+        auth_items_clear(items);
+    }
+    if (owns_row) {
+        dbconn->row_in_use = false;
+    }
+    CFReleaseSafe(items);
     return rc == SQLITE_DONE;
 }
 
+bool authdb_step(authdb_connection_t dbconn, const char * sql, void (^bind_stmt)(sqlite3_stmt*), authdb_iterator_t iter)
+{
+    return _step(dbconn, sql, bind_stmt, iter, false);
+}
+
+bool authdb_step_view(authdb_connection_t dbconn, const char * sql, void (^bind_stmt)(sqlite3_stmt*), authdb_iterator_t iter)
+{
+    return _step(dbconn, sql, bind_stmt, iter, true);
+}
+
 void authdb_checkpoint(authdb_connection_t dbconn)
 {
     int32_t rc = sqlite3_wal_checkpoint(dbconn->handle, NULL);
@@ -1132,6 +1290,9 @@ _authdb_connection_finalize(CFTypeRef value)
 {
     authdb_connection_t dbconn = (authdb_connection_t)value;
     
+    // sqlite3_close refuses to close a handle with live statements
+    _stmt_cache_flush(dbconn);
+    CFReleaseNull(dbconn->row);
     if (dbconn->handle) {
         sqlite3_close(dbconn->handle);
     }
@@ -47,6 +47,11 @@ bool authdb_transaction(authdb_connection_t, AuthDBTransactionType, bool (^t)(vo
 AUTH_NONNULL1 AUTH_NONNULL2
 bool authdb_step(authdb_connection_t, const char * sql, void (^bind_stmt)(sqlite3_stmt* stmt), authdb_iterator_t iter);
 
+// Same as authdb_step but every row is presented in one reused auth_items_t, which is only
+// valid inside iter. Items copied out with auth_items_copy stay valid, don't retain the row itself.
+AUTH_NONNULL1 AUTH_NONNULL2
+bool authdb_step_view(authdb_connection_t, const char * sql, void (^bind_stmt)(sqlite3_stmt* stmt), authdb_iterator_t iter);
+
 AUTH_NONNULL_ALL    
 int32_t authdb_get_key_value(authdb_connection_t, const char * table, const bool skip_maintenance, auth_items_t * out_items);
 
@@ -248,7 +248,7 @@ _set_localization_hints(authdb_connection_t dbconn, auth_items_t hints, rule_t r
 {
     char * key = calloc(1u, 128);
 
-    authdb_step(dbconn, "SELECT lang,value FROM prompts WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
+    authdb_step_view(dbconn, "SELECT lang,value FROM prompts WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
         sqlite3_bind_int64(stmt, 1, rule_get_id(rule));
     }, ^bool(auth_items_t data) {
         snprintf(key, 128, "%s%s", kAuthorizationRuleParameterDescription, auth_items_get_string(data, "lang"));
@@ -257,7 +257,7 @@ _set_localization_hints(authdb_connection_t dbconn, auth_items_t hints, rule_t r
         return true;
     });
 
-    authdb_step(dbconn, "SELECT lang,value FROM buttons WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
+    authdb_step_view(dbconn, "SELECT lang,value FROM buttons WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
         sqlite3_bind_int64(stmt, 1, rule_get_id(rule));
     }, ^bool(auth_items_t data) {
         snprintf(key, 128, "%s%s", kAuthorizationRuleParameterButton, auth_items_get_string(data, "lang"));
@@ -1114,7 +1114,7 @@ _find_rule(engine_t engine, authdb_connection_t dbconn, const char * string)
     for (;;) {
         
         // lookup rule
-        authdb_step(dbconn, "SELECT COUNT(name) AS cnt FROM rules WHERE name = ? AND type = 1",
+        authdb_step_view(dbconn, "SELECT COUNT(name) AS cnt FROM rules WHERE name = ? AND type = 1",
         ^(sqlite3_stmt *stmt) {
             sqlite3_bind_text(stmt, 1, buf, -1, NULL);
         }, ^bool(auth_items_t data) {
@@ -256,7 +256,7 @@ mechanism_sql_fetch(mechanism_t mech, authdb_connection_t dbconn)
 {
     __block bool result = false;
     
-    authdb_step(dbconn, "SELECT id FROM mechanisms WHERE plugin = ? AND param = ? AND privileged = ? LIMIT 1", ^(sqlite3_stmt * stmt) {
+    authdb_step_view(dbconn, "SELECT id FROM mechanisms WHERE plugin = ? AND param = ? AND privileged = ? LIMIT 1", ^(sqlite3_stmt * stmt) {
         sqlite3_bind_text(stmt, 1, mechanism_get_plugin(mech), -1, NULL);
         sqlite3_bind_text(stmt, 2, mechanism_get_param(mech), -1, NULL);
         sqlite3_bind_int(stmt, 3, mechanism_is_privileged(mech));
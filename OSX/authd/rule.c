@@ -345,7 +345,7 @@ done:
 static void
 _sql_get_id(rule_t rule, authdb_connection_t dbconn)
 {
-    authdb_step(dbconn, "SELECT id,created,identifier,requirement FROM rules WHERE name = ? LIMIT 1",
+    authdb_step_view(dbconn, "SELECT id,created,identifier,requirement FROM rules WHERE name = ? LIMIT 1",
     ^(sqlite3_stmt *stmt) {
         sqlite3_bind_text(stmt, 1, rule_get_name(rule), -1, NULL);
     }, ^bool(auth_items_t data) {
@@ -552,10 +552,10 @@ _get_sql_mechanisms(rule_t rule, authdb_connection_t dbconn)
 {
     CFArrayRemoveAllValues(rule->mechanisms);
     
-    authdb_step(dbconn, "SELECT mechanisms.* " \
-                "FROM mechanisms " \
-                "JOIN mechanisms_map ON mechanisms.id = mechanisms_map.m_id " \
-                "WHERE mechanisms_map.r_id = ? ORDER BY mechanisms_map.ord ASC",
+    authdb_step_view(dbconn, "SELECT mechanisms.* " \
+                     "FROM mechanisms " \
+                     "JOIN mechanisms_map ON mechanisms.id = mechanisms_map.m_id " \
+                     "WHERE mechanisms_map.r_id = ? ORDER BY mechanisms_map.ord ASC",
     ^(sqlite3_stmt *stmt) {
         sqlite3_bind_int64(stmt, 1, rule_get_id(rule));
     }, ^bool(auth_items_t data) {
@@ -571,10 +571,10 @@ _get_sql_delegates(rule_t rule, authdb_connection_t dbconn)
 {
     CFArrayRemoveAllValues(rule->delegations);
     
-    authdb_step(dbconn, "SELECT rules.* " \
-                "FROM rules " \
-                "JOIN delegates_map ON rules.id = delegates_map.d_id " \
-                "WHERE delegates_map.r_id = ? ORDER BY delegates_map.ord ASC",
+    authdb_step_view(dbconn, "SELECT rules.* " \
+                     "FROM rules " \
+                     "JOIN delegates_map ON rules.id = delegates_map.d_id " \
+                     "WHERE delegates_map.r_id = ? ORDER BY delegates_map.ord ASC",
                 ^(sqlite3_stmt *stmt) {
                     sqlite3_bind_int64(stmt, 1, rule_get_id(rule));
                 }, ^bool(auth_items_t data) {
@@ -598,7 +598,7 @@ rule_sql_fetch(rule_t rule, authdb_connection_t dbconn)
 {
     __block bool result = false;
     
-    authdb_step(dbconn, "SELECT * FROM rules WHERE name = ? LIMIT 1",
+    authdb_step_view(dbconn, "SELECT * FROM rules WHERE name = ? LIMIT 1",
     ^(sqlite3_stmt *stmt) {
         sqlite3_bind_text(stmt, 1, rule_get_name(rule), -1, NULL);
     }, ^bool(auth_items_t data) {
@@ -918,7 +918,7 @@ rule_copy_to_cfobject(rule_t rule, authdb_connection_t dbconn) {
     
     if (rule_get_type(rule) == RT_RIGHT) {
         CFMutableDictionaryRef prompts = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        authdb_step(dbconn, "SELECT * FROM prompts WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
+        authdb_step_view(dbconn, "SELECT * FROM prompts WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
             sqlite3_bind_int64(stmt, 1, rule_get_id(rule));
         }, ^bool(auth_items_t data) {
             CFStringRef key = CFStringCreateWithCString(kCFAllocatorDefault, auth_items_get_string(data, "lang"), kCFStringEncodingUTF8);
@@ -935,7 +935,7 @@ rule_copy_to_cfobject(rule_t rule, authdb_connection_t dbconn) {
         CFReleaseSafe(prompts);
         
         CFMutableDictionaryRef buttons = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        authdb_step(dbconn, "SELECT * FROM buttons WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
+        authdb_step_view(dbconn, "SELECT * FROM buttons WHERE r_id = ?", ^(sqlite3_stmt *stmt) {
             sqlite3_bind_int64(stmt, 1, rule_get_id(rule));
         }, ^bool(auth_items_t data) {
             CFStringRef key = CFStringCreateWithCString(kCFAllocatorDefault, auth_items_get_string(data, "lang"), kCFStringEncodingUTF8);
@@ -969,7 +969,7 @@ static int64_t _process_get_identifier_count(process_t proc, authdb_connection_t
 {
     __block int64_t result = 0;
     
-    authdb_step(conn, "SELECT COUNT(*) AS cnt FROM rules WHERE identifier = ? ", ^(sqlite3_stmt *stmt) {
+    authdb_step_view(conn, "SELECT COUNT(*) AS cnt FROM rules WHERE identifier = ? ", ^(sqlite3_stmt *stmt) {
         sqlite3_bind_text(stmt, 1, process_get_identifier(proc), -1, NULL);
     }, ^bool(auth_items_t data) {
         result = auth_items_get_int64(data, "cnt");
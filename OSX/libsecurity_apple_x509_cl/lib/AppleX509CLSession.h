@@ -314,6 +314,9 @@ private:
 	LockedMap<CSSM_HANDLE, CLCachedEntry>	cacheMap;
 	LockedMap<CSSM_HANDLE, CLQuery>			queryMap;
 
+	/* decoded certs shared by all cache entries of the same encoded cert */
+	CLDecodedCertCache						decodedCerts;
+
 	CLCachedCert *lookupCachedCert(CSSM_HANDLE handle);
 	CLCachedCRL	 *lookupCachedCRL(CSSM_HANDLE handle);
 };
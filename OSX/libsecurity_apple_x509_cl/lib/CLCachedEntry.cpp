@@ -35,7 +35,73 @@ CLCachedEntry::CLCachedEntry()
 
 CLCachedCert::~CLCachedCert()
 {
-	delete &mCert;
+	/* mCert releases our reference to the shared cert */
+}
+
+CLCertDigest::CLCertDigest(const CssmData &encodedCert)
+{
+	CC_SHA256(encodedCert.data(), (CC_LONG)encodedCert.length(), bytes);
+}
+
+RefPointer<CLSharedCert>
+CLDecodedCertCache::intern(
+	AppleX509CLSession	&session,
+	const CssmData		&encodedCert)
+{
+	CLCertDigest key(encodedCert);
+	
+	/* fast path: concurrent lookups only share the read lock */
+	{
+		StReadWriteLock _(mLock, StReadWriteLock::Read);
+		MapType::iterator it = mMap.find(key);
+		if(it != mMap.end()) {
+			it->second->mReferenced = true;
+			return it->second;
+		}
+	}
+	
+	/* decode without holding the lock; throws on bad cert */
+	RefPointer<CLSharedCert> cert = new CLSharedCert(session, encodedCert);
+	
+	StReadWriteLock _(mLock, StReadWriteLock::Write);
+	MapType::iterator it = mMap.find(key);
+	if(it != mMap.end()) {
+		/* somebody else decoded the same cert meanwhile; use theirs */
+		it->second->mReferenced = true;
+		return it->second;
+	}
+	if(mMap.size() >= mCapacity) {
+		evictOneLocked();
+	}
+	mMap[key] = cert;
+	return cert;
+}
+
+/*
+ * Second-chance sweep: starting where the last sweep stopped, clear the
+ * referenced bit of each cert passed over and evict the first one found
+ * already clear. Terminates within two passes. mLock held for writing.
+ */
+void
+CLDecodedCertCache::evictOneLocked()
+{
+	if(mMap.empty()) {
+		return;
+	}
+	MapType::iterator it = mHandValid ? mMap.upper_bound(mHand) : mMap.begin();
+	for(;;) {
+		if(it == mMap.end()) {
+			it = mMap.begin();
+		}
+		if(!it->second->mReferenced) {
+			break;
+		}
+		it->second->mReferenced = false;
+		++it;
+	}
+	mHand = it->first;
+	mHandValid = true;
+	mMap.erase(it);
 }
 
 CLCachedCRL::~CLCachedCRL()
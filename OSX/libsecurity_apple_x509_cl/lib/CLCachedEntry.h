@@ -27,10 +27,106 @@
 
 #include <Security/cssmtype.h>
 #include <security_utilities/utilities.h>
+#include <security_utilities/refcount.h>
+#include <security_utilities/threading.h>
 #include <security_cdsa_utilities/cssmdata.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <map>
 #include "DecodedCert.h"
 #include "DecodedCrl.h"
 
+/* max number of distinct decoded certs a session keeps around */
+#define CL_DECODED_CERT_CACHE_SIZE		256
+
+/* 
+ * Key for interning decoded certs: SHA-256 of the encoded cert.
+ */
+struct CLCertDigest
+{
+	uint8 bytes[CC_SHA256_DIGEST_LENGTH];
+	
+	CLCertDigest() { }
+	CLCertDigest(const CssmData &encodedCert);
+	bool operator < (const CLCertDigest &other) const
+		{ return memcmp(bytes, other.bytes, sizeof(bytes)) < 0; }
+};
+
+/*
+ * One decoded cert, shared by every CLCachedCert in a session created from
+ * the same encoded bytes. DecodedCert decodes everything up front into its
+ * coder's arena, which then stays fixed for the life of this object: field
+ * getters decode their temporaries into a SecNssCoder of their own, so a hot
+ * cert does not grow with every fetch. Fetch fields via getCertFieldData()
+ * here, which serializes on this cert alone.
+ */
+class CLSharedCert : public RefCount
+{
+	NOCOPY(CLSharedCert)
+public:
+	CLSharedCert(
+		AppleX509CLSession	&session,
+		const CssmData		&encodedCert) : 
+			mCert(session, encodedCert), mReferenced(true) { }
+	
+	DecodedCert	&cert()	{ return mCert; }
+	
+	bool getCertFieldData(
+		const CssmOid		&fieldId,
+		unsigned			index,
+		uint32				&numFields,
+		CssmOwnedData		&fieldValue)
+		{
+			StLock<Mutex> _(mFieldLock);
+			return mCert.getCertFieldData(fieldId, index, numFields, fieldValue);
+		}
+	
+	void getAllParsedCertFields(
+		uint32 				&numberOfFields,
+		CSSM_FIELD_PTR 		&certFields)
+		{
+			StLock<Mutex> _(mFieldLock);
+			mCert.getAllParsedCertFields(numberOfFields, certFields);
+		}
+	
+private:
+	friend class CLDecodedCertCache;
+	DecodedCert		mCert;
+	Mutex			mFieldLock;
+	/* set on every cache hit, cleared by the eviction sweep (second chance) */
+	volatile bool	mReferenced;
+};
+
+/*
+ * Per-session intern table of decoded certs, keyed by content. Hits only take
+ * the table's read lock; misses decode outside any lock and insert under the
+ * write lock. When full, an insert evicts the first cert not used since the
+ * sweep last passed it (a clock approximation of LRU). Eviction only drops the
+ * table's reference: certs still held by a CLCachedCert live on.
+ */
+class CLDecodedCertCache
+{
+	NOCOPY(CLDecodedCertCache)
+public:
+	CLDecodedCertCache(
+		size_t capacity = CL_DECODED_CERT_CACHE_SIZE) : 
+			mCapacity(capacity), mHandValid(false) { }
+	
+	/* find or decode; throws CSSMERR_CL_UNKNOWN_FORMAT on bad data */
+	RefPointer<CLSharedCert> intern(
+		AppleX509CLSession	&session,
+		const CssmData		&encodedCert);
+	
+private:
+	typedef std::map<CLCertDigest, RefPointer<CLSharedCert> > MapType;
+	void evictOneLocked();
+	
+	ReadWriteLock			mLock;
+	MapType					mMap;
+	size_t					mCapacity;
+	CLCertDigest			mHand;		// sweep resumes after this key...
+	bool					mHandValid;	// ...if set, else at the start
+};
+
 /* 
  * There is one of these per active cached object (cert or CRL). 
  * AppleX509CLSession keeps a map of these in cacheMap. 
@@ -49,12 +145,12 @@ class CLCachedCert : public CLCachedEntry
 {
 public:
 	CLCachedCert(
-		DecodedCert &c) : mCert(c) { }
+		CLSharedCert &c) : mCert(&c) { }
 	~CLCachedCert();
-	DecodedCert	&cert()	{ return mCert; }
+	CLSharedCert &cert()	{ return *mCert; }
 private:
-	/* decoded NSS format */
-	DecodedCert &mCert;
+	/* decoded NSS format, possibly shared with other cached certs */
+	RefPointer<CLSharedCert> mCert;
 };
 
 class CLCachedCRL : public CLCachedEntry
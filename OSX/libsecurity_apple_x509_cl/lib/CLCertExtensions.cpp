@@ -407,7 +407,8 @@ bool getFieldAuthorityKeyId(
 	assert(nssObj != NULL);
 	
 	/* nssObj --> cdsaObj */
-	CL_nssAuthorityKeyIdToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_nssAuthorityKeyIdToCssm(*nssObj, *cdsaObj, coder, alloc);
 	
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
@@ -473,8 +474,9 @@ bool getFieldSubjAltName(
 	if(!brtn) {
 		return false;
 	}
+	SecNssCoder coder;			// temp memory, not the cert's arena
 	CL_nssGeneralNamesToCssm(*nssObj, *cdsaObj,	
-		cert.coder(), fieldValue.allocator);
+		coder, fieldValue.allocator);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -501,8 +503,9 @@ bool getFieldIssuerAltName(
 	if(!brtn) {
 		return false;
 	}
+	SecNssCoder coder;			// temp memory, not the cert's arena
 	CL_nssGeneralNamesToCssm(*nssObj, *cdsaObj,	
-		cert.coder(), fieldValue.allocator);
+		coder, fieldValue.allocator);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -610,6 +613,7 @@ bool getFieldCertPolicies(
 	CE_CertPolicies *cdsaObj;
 	bool brtn;
 	Allocator &alloc = fieldValue.allocator;
+	SecNssCoder coder;			// temp memory, not the cert's arena
 	brtn = cert.GetExtenTop<NSS_CertPolicies, CE_CertPolicies>(
 		index,
 		numFields,
@@ -670,7 +674,7 @@ bool getFieldCertPolicies(
 				/* decode as IA5String to temp memory */
 				toCopy.Data = NULL;
 				toCopy.Length = 0;
-				if(cert.coder().decodeItem(nQualInfo->qualifier,
+				if(coder.decodeItem(nQualInfo->qualifier,
 						kSecAsn1IA5StringTemplate,
 						&toCopy)) {
 					clErrorLog("***getCertPolicies: bad IA5String!\n");
@@ -831,7 +835,8 @@ bool getFieldCrlDistPoints(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_nssDistPointsToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_nssDistPointsToCssm(*nssObj, *cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -897,7 +902,8 @@ bool getFieldAuthInfoAccess(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_infoAccessToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_infoAccessToCssm(*nssObj, *cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -927,7 +933,8 @@ bool getFieldSubjInfoAccess(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_infoAccessToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_infoAccessToCssm(*nssObj, *cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -994,7 +1001,8 @@ bool getFieldQualCertStatements(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_qualCertStatementsToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_qualCertStatementsToCssm(*nssObj, *cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -1058,7 +1066,8 @@ bool getFieldNameConstraints(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_nssNameConstraintsToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_nssNameConstraintsToCssm(*nssObj, *cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -1122,7 +1131,8 @@ bool getFieldPolicyMappings(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_nssPolicyMappingsToCssm(*nssObj, *cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_nssPolicyMappingsToCssm(*nssObj, *cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
@@ -1186,7 +1196,8 @@ bool getFieldPolicyConstraints(
 		return false;
 	}
 	assert(nssObj != NULL);
-	CL_nssPolicyConstraintsToCssm(nssObj, cdsaObj, cert.coder(), alloc);
+	SecNssCoder coder;			// temp memory, not the cert's arena
+	CL_nssPolicyConstraintsToCssm(nssObj, cdsaObj, coder, alloc);
 	getFieldExtenCommon(cdsaObj, *decodedExt, fieldValue);
 	return true;
 }
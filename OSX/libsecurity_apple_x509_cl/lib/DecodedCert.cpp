@@ -45,8 +45,14 @@ DecodedCert::DecodedCert(
 	: DecodedItem(session)
 {
 	memset(&mCert, 0, sizeof(mCert));
-	PRErrorCode prtn = mCoder.decode(encodedCert.data(), encodedCert.length(), 
-		kSecAsn1SignedCertTemplate, &mCert);
+	/*
+	 * Take one copy of the caller's data in our arena, then decode 
+	 * in place: decoded fields refer into that copy rather than each
+	 * getting an allocation and copy of its own.
+	 */
+	SECItem derItem;
+	mCoder.allocCopyItem(encodedCert.data(), encodedCert.length(), derItem);
+	PRErrorCode prtn = mCoder.decodeItem(derItem, kSecAsn1SignedCertTemplate, &mCert, true);
 	if(prtn) {
 		CssmError::throwMe(CSSMERR_CL_UNKNOWN_FORMAT);
 	}
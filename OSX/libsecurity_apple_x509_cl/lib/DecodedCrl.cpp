@@ -42,8 +42,14 @@ DecodedCrl::DecodedCrl(
 	: DecodedItem(session)
 {
 	memset(&mCrl, 0, sizeof(mCrl));
-	PRErrorCode prtn = mCoder.decode(encodedCrl.data(), encodedCrl.length(), 
-		kSecAsn1SignedCrlTemplate, &mCrl);
+	/*
+	 * Take one copy of the caller's data in our arena, then decode 
+	 * in place: decoded fields refer into that copy rather than each
+	 * getting an allocation and copy of its own.
+	 */
+	SECItem derItem;
+	mCoder.allocCopyItem(encodedCrl.data(), encodedCrl.length(), derItem);
+	PRErrorCode prtn = mCoder.decodeItem(derItem, kSecAsn1SignedCrlTemplate, &mCrl, true);
 	if(prtn) {
 		CssmError::throwMe(CSSMERR_CL_UNKNOWN_FORMAT);
 	}
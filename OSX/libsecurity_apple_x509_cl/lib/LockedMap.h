@@ -17,7 +17,7 @@
 
 
 /*
- * LockedMap.h - STL-style map with attached Mutex
+ * LockedMap.h - STL-style map with attached ReadWriteLock
  *
  * Copyright (c) 2000,2011,2014 Apple Inc. 
  */
@@ -34,9 +34,9 @@ class LockedMap
 private:
 	typedef std::map<KeyType, ValueType *> MapType;
 	MapType					mMap;
-	Mutex					mMapLock;
+	ReadWriteLock			mMapLock;
 	
-	/* low-level lookup, cacheMapLock held on entry and exit */
+	/* low-level lookup, mMapLock held on entry and exit */
 	ValueType 				
 	*lookupEntryLocked(KeyType key) 
 		{
@@ -53,21 +53,22 @@ public:
 	void 
 	addEntry(ValueType &value, KeyType key)
 		{
-			StLock<Mutex> _(mMapLock);
+			StReadWriteLock _(mMapLock, StReadWriteLock::Write);
 			mMap[key] = &value;
 		}
 		
 	ValueType				
 	*lookupEntry(KeyType key)
 		{
-			StLock<Mutex> _(mMapLock);
+			/* lookups only exclude writers, not each other */
+			StReadWriteLock _(mMapLock, StReadWriteLock::Read);
 			return lookupEntryLocked(key);
 		}
 		
 	void	
 	removeEntry(KeyType key)
 		{
-			StLock<Mutex> _(mMapLock);
+			StReadWriteLock _(mMapLock, StReadWriteLock::Write);
 
 			ValueType *value = lookupEntryLocked(key);
 			if(value != NULL) {
@@ -78,7 +79,7 @@ public:
 	ValueType	
 	*removeFirstEntry()
 		{
-			StLock<Mutex> _(mMapLock);
+			StReadWriteLock _(mMapLock, StReadWriteLock::Write);
 			typename MapType::iterator it = mMap.begin();
 			if(it == mMap.end()) {
 				return NULL;
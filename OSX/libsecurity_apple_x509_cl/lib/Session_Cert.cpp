@@ -41,8 +41,8 @@ AppleX509CLSession::CertGetAllFields(
 	uint32 &NumberOfFields,
 	CSSM_FIELD_PTR &CertFields)
 {
-	DecodedCert decodedCert(*this, Cert);
-	decodedCert.getAllParsedCertFields(NumberOfFields, CertFields);
+	RefPointer<CLSharedCert> decodedCert = decodedCerts.intern(*this, Cert);
+	decodedCert->getAllParsedCertFields(NumberOfFields, CertFields);
 }
 
 
@@ -57,23 +57,14 @@ AppleX509CLSession::CertGetFirstFieldValue(
 	Value = NULL;
 	CssmAutoData aData(*this);
 	
-	DecodedCert *decodedCert = new DecodedCert(*this, EncodedCert);
+	RefPointer<CLSharedCert> decodedCert = decodedCerts.intern(*this, EncodedCert);
 	uint32 numMatches;
 	
 	/* this returns false if field not there, throws on bad OID */
-	bool brtn;
-	try {
-		brtn = decodedCert->getCertFieldData(CertField, 
+	if(!decodedCert->getCertFieldData(CertField, 
 			0, 				// index
 			numMatches, 
-			aData);
-	}
-	catch (...) {
-		delete decodedCert;
-		throw;
-	}
-	if(!brtn) {
-		delete decodedCert;
+			aData)) {
 		return CSSM_INVALID_HANDLE;
 	}
 
@@ -139,7 +130,7 @@ AppleX509CLSession::CertCache(
 	const CssmData &EncodedCert,
 	CSSM_HANDLE &CertHandle)
 {
-	DecodedCert *decodedCert = new DecodedCert(*this, EncodedCert);
+	RefPointer<CLSharedCert> decodedCert = decodedCerts.intern(*this, EncodedCert);
 	
 	/* cook up a CLCachedCert, stash it in cache */
 	CLCachedCert *cachedCert = new CLCachedCert(*decodedCert);
@@ -1033,6 +1033,7 @@ void TPCertGroup::appendCert(
 			mSizeofCertInfo * sizeof(TPCertInfo *));
 	}
 	mCertInfo[mNumCerts++] = certInfo;
+	indexCert(certInfo);
 }
 
 TPCertInfo *TPCertGroup::certAtIndex(
@@ -1059,9 +1060,48 @@ TPCertInfo *TPCertGroup::removeCertAtIndex(
 		mCertInfo[i] = mCertInfo[i+1];
 	}
 	mNumCerts--;
+	unindexCert(rtn);
 	return rtn;
 }
 
+/* FNV-1a over a DER-encoded name */
+static size_t tpNameHash(
+	const CSSM_DATA	*name)
+{
+	uint64 hash = 0xcbf29ce484222325ULL;
+	for(CSSM_SIZE dex=0; dex<name->Length; dex++) {
+		hash ^= name->Data[dex];
+		hash *= 0x100000001b3ULL;
+	}
+	return (size_t)hash;
+}
+
+void TPCertGroup::indexCert(
+	TPCertInfo			*certInfo)
+{
+	mSubjectIndex[tpNameHash(certInfo->subjectName())].push_back(certInfo);
+}
+
+void TPCertGroup::unindexCert(
+	TPCertInfo			*certInfo)
+{
+	TPSubjectIndex::iterator it = mSubjectIndex.find(tpNameHash(certInfo->subjectName()));
+	if(it == mSubjectIndex.end()) {
+		return;
+	}
+	std::vector<TPCertInfo *> &bucket = it->second;
+	for(std::vector<TPCertInfo *>::iterator bit = bucket.begin(); bit != bucket.end(); ++bit) {
+		if(*bit == certInfo) {
+			/* only the first occurrence, in case a cert was added twice */
+			bucket.erase(bit);
+			break;
+		}
+	}
+	if(bucket.empty()) {
+		mSubjectIndex.erase(it);
+	}
+}
+
 TPCertInfo *TPCertGroup::firstCert()
 {
 	if(mNumCerts == 0) {
@@ -1405,8 +1445,26 @@ TPCertInfo *TPCertGroup::findIssuerForCertOrCrl(
 	TPCertInfo *expiredIssuer = NULL;
 	TPCertInfo *unmatchedKeyIDIssuer = NULL;
 
-	for(unsigned certDex=0; certDex<mNumCerts; certDex++) {
-		TPCertInfo *certInfo = certAtIndex(certDex);
+	if(subject.issuerName() == NULL) {
+		return NULL;
+	}
+	TPSubjectIndex::const_iterator bucket =
+		mSubjectIndex.find(tpNameHash(subject.issuerName()));
+	if(bucket == mSubjectIndex.end()) {
+		return NULL;
+	}
+
+	/*
+	 * Gather the unused certs whose subject matches, ranked the way we'd
+	 * pick among them anyway - current with matching key id first, expired
+	 * without key id match last - so the usual case finds its issuer with
+	 * the first signature verify. Ties stay in group order.
+	 */
+	std::vector<TPCertInfo *> candidates[4];
+	size_t numCandidates = 0;
+	for(std::vector<TPCertInfo *>::const_iterator it = bucket->second.begin();
+			it != bucket->second.end(); ++it) {
+		TPCertInfo *certInfo = *it;
 
 		/* has this one already been used in this search? */
 		if(certInfo->used()) {
@@ -1414,48 +1472,73 @@ TPCertInfo *TPCertGroup::findIssuerForCertOrCrl(
 		}
 
 		/* subject/issuer names match? */
-		if(certInfo->isIssuerOf(subject)) {
-			/* yep, do a sig verify */
-			tpVfyDebug("findIssuerForCertOrCrl issuer/subj match checking sig");
-			CSSM_RETURN crtn = subject.verifyWithIssuer(certInfo);
-			switch(crtn) {
-				case CSSMERR_CSP_APPLE_PUBLIC_KEY_INCOMPLETE:
-					/* issuer OK, check sig later */
-					partialIssuerKey = true;
-					/* and fall thru */
-				case CSSM_OK:
-					/*
-					 * Temporal validity check: if we're not already holding an expired
-					 * issuer, and this one's invalid, hold it and keep going.
-					 */
-					if((crtn == CSSM_OK) && (expiredIssuer == NULL)) {
-						if(certInfo->isExpired() || certInfo->isNotValidYet()) {
-							tpDebug("findIssuerForCertOrCrl: holding expired cert %p",
-								certInfo);
-							expiredIssuer = certInfo;
-							break;
-						}
+		if(!certInfo->isIssuerOf(subject)) {
+			continue;
+		}
+		unsigned rank = 0;
+		if(certInfo->isExpired() || certInfo->isNotValidYet()) {
+			rank += 2;
+		}
+		if(!certInfo->isAuthorityKeyOf(subject)) {
+			rank += 1;
+		}
+		candidates[rank].push_back(certInfo);
+		numCandidates++;
+	}
+	if(numCandidates == 0) {
+		return NULL;
+	}
+
+	std::vector<TPCertInfo *> ranked;
+	ranked.reserve(numCandidates);
+	for(unsigned rank=0; rank<4; rank++) {
+		ranked.insert(ranked.end(), candidates[rank].begin(), candidates[rank].end());
+	}
+
+	for(std::vector<TPCertInfo *>::const_iterator it = ranked.begin();
+			it != ranked.end(); ++it) {
+		TPCertInfo *certInfo = *it;
+
+		/* names match, do a sig verify */
+		tpVfyDebug("findIssuerForCertOrCrl issuer/subj match checking sig");
+		CSSM_RETURN crtn = subject.verifyWithIssuer(certInfo);
+		switch(crtn) {
+			case CSSMERR_CSP_APPLE_PUBLIC_KEY_INCOMPLETE:
+				/* issuer OK, check sig later */
+				partialIssuerKey = true;
+				/* and fall thru */
+			case CSSM_OK:
+				/*
+				 * Temporal validity check: if we're not already holding an expired
+				 * issuer, and this one's invalid, hold it and keep going.
+				 */
+				if((crtn == CSSM_OK) && (expiredIssuer == NULL)) {
+					if(certInfo->isExpired() || certInfo->isNotValidYet()) {
+						tpDebug("findIssuerForCertOrCrl: holding expired cert %p",
+							certInfo);
+						expiredIssuer = certInfo;
+						break;
 					}
-					/* Authority key identifier check: if we can't match subject key id,
-					 * hold onto this cert and keep going.
-					 */
-					if(unmatchedKeyIDIssuer == NULL) {
-						if(!certInfo->isAuthorityKeyOf(subject)) {
-							tpDebug("findIssuerForCertOrCrl: holding issuer without key id match %p",
-								certInfo);
-							unmatchedKeyIDIssuer = certInfo;
-							break;
-						}
+				}
+				/* Authority key identifier check: if we can't match subject key id,
+				 * hold onto this cert and keep going.
+				 */
+				if(unmatchedKeyIDIssuer == NULL) {
+					if(!certInfo->isAuthorityKeyOf(subject)) {
+						tpDebug("findIssuerForCertOrCrl: holding issuer without key id match %p",
+							certInfo);
+						unmatchedKeyIDIssuer = certInfo;
+						break;
 					}
-					/* YES */
-					certInfo->used(true);
-					return certInfo;
-				default:
-					/* just skip this one and keep looking */
-					tpVfyDebug("findIssuerForCertOrCrl issuer/subj match BAD SIG");
-					break;
-			}
-		} 	/* names match */
+				}
+				/* YES */
+				certInfo->used(true);
+				return certInfo;
+			default:
+				/* just skip this one and keep looking */
+				tpVfyDebug("findIssuerForCertOrCrl issuer/subj match BAD SIG");
+				break;
+		}
 	}
 	if(unmatchedKeyIDIssuer != NULL) {
 		/* OK, we'll use this one (preferred over an expired issuer) */
@@ -1705,7 +1788,7 @@ post_trust_setting:
                         if(!firstSubjectIsInGroup || (mNumCerts > 1)) {
                             if(mNumCerts) {
                                 /* roll back to previous cert */
-                                mNumCerts--;
+                                unindexCert(mCertInfo[--mNumCerts]);
                             }
                             if(mNumCerts == 0) {
                                 /* roll back to caller's initial condition */
@@ -1751,7 +1834,7 @@ post_trust_setting:
 					expiredRoot = subjCert;
 					if(mNumCerts) {
 						/* roll back to previous cert */
-						mNumCerts--;
+						unindexCert(mCertInfo[--mNumCerts]);
 					}
 					if(mNumCerts == 0) {
 						/* roll back to caller's initial condition */
@@ -1779,7 +1862,7 @@ post_trust_setting:
                     untrustedRoot = subjCert;
                     if(mNumCerts) {
                         /* roll back to previous cert */
-                        mNumCerts--;
+                        unindexCert(mCertInfo[--mNumCerts]);
                     }
                     if(mNumCerts == 0) {
                         /* roll back to caller's initial condition */
@@ -30,6 +30,8 @@
 #include <security_utilities/threading.h>
 #include <security_utilities/globalizer.h>
 #include <CoreFoundation/CFDate.h>
+#include <unordered_map>
+#include <vector>
 
 /* protects TP-wide access to time() and gmtime() */
 extern ModuleNexus<Mutex> tpTimeLock;
@@ -616,11 +618,26 @@ private:
 	CSSM_RETURN				verifyWithPartialKeys(
 		const TPClItemInfo	&subjectItem);		// Cert or CRL
 
+	/* maintain mSubjectIndex as certs come and go */
+	void					indexCert(
+		TPCertInfo			*certInfo);
+	void					unindexCert(
+		TPCertInfo			*certInfo);
+
 	Allocator				&mAlloc;
 	TPCertInfo				**mCertInfo;		// just an array of pointers
 	unsigned				mNumCerts;			// valid certs in certInfo
 	unsigned				mSizeofCertInfo;	// mallocd space in certInfo
 	TPGroupOwner			mWhoOwns;			// if TGO_Group, we delete certs
 												//    upon destruction
+
+	/*
+	 * Our certs bucketed by a hash of their normalized subject name, each
+	 * bucket in group order, so findIssuerForCertOrCrl() only looks at
+	 * certs which can possibly be the issuer. Collisions are weeded out
+	 * by isIssuerOf().
+	 */
+	typedef std::unordered_map<size_t, std::vector<TPCertInfo *> > TPSubjectIndex;
+	TPSubjectIndex			mSubjectIndex;
 };
 #endif	/* _TP_CERT_INFO_H_ */
@@ -72,12 +72,21 @@ PRErrorCode	SecNssCoder::decode(
 	const void				*src,		// BER-encoded source
 	size_t				len,
 	const SecAsn1Template 	*templ,	
-	void					*dest)
+	void					*dest,
+	bool					noCopy)
 {
 	SECStatus prtn;
 	
 	assert(mPool != NULL);
-	prtn = SEC_ASN1Decode(mPool, dest, templ, (const char *)src, len);
+	if(noCopy) {
+		SECItem item;
+		item.Data = (uint8_t *)src;
+		item.Length = len;
+		prtn = SEC_QuickDERDecodeItem(mPool, dest, templ, &item);
+	}
+	else {
+		prtn = SEC_ASN1Decode(mPool, dest, templ, (const char *)src, len);
+	}
 	if(prtn) {
 		return PR_GetError();
 	}
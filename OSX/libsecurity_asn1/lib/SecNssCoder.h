@@ -57,6 +57,11 @@ public:
 	 * The dest pointer is a template-specific struct allocated
 	 * by the caller and must be zeroed by the caller. 
 	 *
+	 * If noCopy is true, primitive definite-length (i.e. DER) values
+	 * in dest refer directly to src rather than to copies in the 
+	 * arena pool; the caller must then keep src alive for as long 
+	 * as dest is in use. BER constructed strings are still copied.
+	 *
 	 * This does not throw any exceptions; error status 
 	 * (obtained from PR_GetError() is returned. 
 	 */
@@ -64,15 +69,17 @@ public:
 		const void				*src,		// BER-encoded source
 		size_t				len,
 		const SecAsn1Template 	*templ,	
-		void					*dest);
+		void					*dest,
+		bool					noCopy = false);
 		
 	/* convenience routine, decode from an SECItem */
 	PRErrorCode	decodeItem(
 		const SECItem			&item,		// BER-encoded source
 		const SecAsn1Template 	*templ,	
-		void					*dest)
+		void					*dest,
+		bool					noCopy = false)
 		{
-			return decode(item.Data, item.Length, templ, dest);
+			return decode(item.Data, item.Length, templ, dest, noCopy);
 		}
 		
 	
@@ -101,6 +101,11 @@ extern SECStatus SEC_ASN1DecodeItem(PRArenaPool *pool, void *dest,
 				    const SecAsn1Template *t,
 				    const SecAsn1Item *item);
 
+/*
+ * DER-only, no-copy decode: primitive definite-length values in dest
+ * point directly into src, which must outlive dest.  BER constructed
+ * and indefinite-length strings are still copied into arena.
+ */
 extern SECStatus SEC_QuickDERDecodeItem(PRArenaPool* arena, void* dest,
                      const SecAsn1Template* templateEntry,
                      SecAsn1Item* src);
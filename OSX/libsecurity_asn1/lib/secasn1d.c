@@ -296,7 +296,14 @@ typedef struct sec_asn1d_state_struct {
 	indefinite,	/* the current item has indefinite-length encoding */
 	missing,	/* an optional field that was not present */
 	optional,	/* the template says this field may be omitted */
-	substring;	/* this is a substring of a constructed string */
+	substring,	/* this is a substring of a constructed string */
+	reference;	/* dest refers to the caller's input, no copy */
+
+    /*
+     * Start of the identifier and length octets stashed aside for an
+     * ANY; used to refer to the whole encoding in place when possible.
+     */
+    const char *any_header;
 } sec_asn1d_state;
 
 #define IS_HIGH_TAG_NUMBER(n)	((n) == SEC_ASN1_HIGH_TAG_NUMBER)
@@ -342,6 +349,17 @@ struct sec_DecoderContext_struct {
     SEC_ASN1WriteProc filter_proc;	/* pass field bytes to this  */
     void *filter_arg;			/* argument to that function */
     PRBool filter_only;			/* do not allocate/store fields */
+
+    /*
+     * When no_copy is set, primitive definite-length contents which lie
+     * entirely within [input_start, input_end) are not copied; the
+     * destination SecAsn1Item points into the caller's input instead.
+     * BER constructed and indefinite-length forms are still reassembled
+     * in their_pool.
+     */
+    PRBool no_copy;
+    const char *input_start;
+    const char *input_end;
 };
 
 
@@ -1087,6 +1105,31 @@ sec_asn1d_check_and_subtract_length (unsigned long *remaining,
 }
 
 
+/*
+ * Determine whether the contents of a primitive, definite-length string
+ * or leaf can be referred to in place rather than copied.  The contents
+ * (plus any stashed ANY header of hdr_len bytes immediately preceding
+ * them) must lie entirely within the caller's input, which only holds
+ * when the decoder was started in no-copy mode.
+ */
+static PRBool
+sec_asn1d_can_reference (sec_asn1d_state *state, const char *start,
+			 unsigned long hdr_len, const char *buf, size_t len)
+{
+    SEC_ASN1DecoderContext *cx = state->top;
+
+    if (!cx->no_copy || cx->filter_only || state->substring
+	|| state->indefinite
+	|| (state->found_tag_modifiers & SEC_ASN1_CONSTRUCTED))
+		return PR_FALSE;
+    if (start == NULL || start < cx->input_start || buf > cx->input_end)
+		return PR_FALSE;
+    if ((unsigned long)(buf - start) != hdr_len)
+		return PR_FALSE;
+    return (state->contents_length <= len
+	    && state->contents_length <= (unsigned long)(cx->input_end - buf));
+}
+
 static void
 sec_asn1d_prepare_for_contents (sec_asn1d_state *state,
 	#ifdef	__APPLE__
@@ -1202,6 +1245,7 @@ sec_asn1d_prepare_for_contents (sec_asn1d_state *state,
      * both contents_length and pending will be zero.
      */
     state->pending = state->contents_length;
+    state->reference = PR_FALSE;
 
     /*
      * An EXPLICIT is nothing but an outer header, which we have
@@ -1410,6 +1454,30 @@ regular_string_type:
 	    poolp = state->top->their_pool;
 	}
 
+	if (alloc_len) {
+	    struct subitem *subitem;
+	    unsigned long hdr_len = 0;
+	    const char *start = buf;
+
+	    if (state->subitems_head != NULL) {
+		for (subitem = state->subitems_head;
+		     subitem != NULL; subitem = subitem->next)
+		    hdr_len += subitem->len;
+		start = state->any_header;
+	    }
+	    if (sec_asn1d_can_reference (state, start, hdr_len, buf, len)) {
+		/*
+		 * DER primitive contents already in the caller's input;
+		 * sec_asn1d_parse_leaf will account for them without a copy.
+		 */
+		item->Data = (unsigned char *)start;
+		item->Length = hdr_len;
+		state->reference = PR_TRUE;
+		state->subitems_head = state->subitems_tail = NULL;
+		alloc_len = 0;
+	    }
+	}
+
 	if (alloc_len || ((! state->indefinite)
 			  && (state->subitems_head != NULL))) {
 	    struct subitem *subitem;
@@ -1550,6 +1618,9 @@ regular_string_type:
 			item->Length = 0;
 			if (state->top->filter_only) {
 				item->Data = NULL;
+			} else if (sec_asn1d_can_reference (state, buf, 0, buf, len)) {
+				item->Data = (unsigned char *)buf;
+				state->reference = PR_TRUE;
 			} else {
 				item->Data = (unsigned char*)
 							sec_asn1d_zalloc (state->top->their_pool,
@@ -1741,6 +1812,10 @@ sec_asn1d_parse_leaf (sec_asn1d_state *state,
 				len--;
 			}
 		}
+		if (state->reference && item->Length == 0) {
+			/* contents are referred to in place; start them here */
+			item->Data = (unsigned char *)buf;
+		}
 		unsigned long offset = item->Length;
 		if (state->underlying_kind == SEC_ASN1_BIT_STRING) {
 			// The previous bit string must have no unused bits.
@@ -1775,7 +1850,8 @@ sec_asn1d_parse_leaf (sec_asn1d_state *state,
 			}
 			item->Length += len;
 		}
-		PORT_Memcpy (item->Data + offset, buf, len);
+		if (!state->reference)
+			PORT_Memcpy (item->Data + offset, buf, len);
     }
     state->pending -= bufLen;
     if (state->pending == 0)
@@ -1916,6 +1992,8 @@ sec_asn1d_record_any_header (sec_asn1d_state *state,
 	PORT_Memcpy (item->Data + item->Length, buf, len);
 	item->Length += len;
     } else {
+	if (state->subitems_head == NULL)
+	    state->any_header = buf;
 	sec_asn1d_add_to_subitems (state, buf, len, PR_TRUE);
     }
 }
@@ -3264,10 +3342,10 @@ SEC_ASN1DecoderAbort(SEC_ASN1DecoderContext *cx, int error)
 }
 
 
-SECStatus
-SEC_ASN1Decode (PRArenaPool *poolp, void *dest,
-		const SecAsn1Template *theTemplate,
-		const char *buf, size_t len)
+static SECStatus
+sec_asn1d_decode (PRArenaPool *poolp, void *dest,
+		  const SecAsn1Template *theTemplate,
+		  const char *buf, size_t len, PRBool no_copy)
 {
     SEC_ASN1DecoderContext *dcx;
     SECStatus urv, frv;
@@ -3277,6 +3355,13 @@ SEC_ASN1Decode (PRArenaPool *poolp, void *dest,
     if (dcx == NULL)
 	return SECFailure;
 
+    if (no_copy) {
+	/* the whole encoding is in hand, so leaves may refer into it */
+	dcx->no_copy = PR_TRUE;
+	dcx->input_start = buf;
+	dcx->input_end = buf + len;
+    }
+
     urv = SEC_ASN1DecoderUpdate (dcx, buf, len);
     frv = SEC_ASN1DecoderFinish (dcx);
 
@@ -3287,6 +3372,31 @@ SEC_ASN1Decode (PRArenaPool *poolp, void *dest,
 }
 
 
+SECStatus
+SEC_ASN1Decode (PRArenaPool *poolp, void *dest,
+		const SecAsn1Template *theTemplate,
+		const char *buf, size_t len)
+{
+    return sec_asn1d_decode (poolp, dest, theTemplate, buf, len, PR_FALSE);
+}
+
+
+/*
+ * Like SEC_ASN1DecodeItem, but primitive definite-length values are not
+ * copied: the resulting SecAsn1Items point into src, which must outlive
+ * the decoded structure.  Only BER constructed or indefinite-length
+ * strings are reassembled in poolp.
+ */
+SECStatus
+SEC_QuickDERDecodeItem (PRArenaPool *poolp, void *dest,
+			const SecAsn1Template *theTemplate,
+			SecAsn1Item *src)
+{
+    return sec_asn1d_decode (poolp, dest, theTemplate,
+			     (const char *) src->Data, src->Length, PR_TRUE);
+}
+
+
 SECStatus
 SEC_ASN1DecodeItem (PRArenaPool *poolp, void *dest,
 		    const SecAsn1Template *theTemplate,
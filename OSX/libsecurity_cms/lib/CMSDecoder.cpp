@@ -68,6 +68,13 @@ struct _CMSDecoder {
 	CFDataRef			detachedContent;
 	CFTypeRef			keychainOrArray;	/* unused */
 	
+	/* optional; encapsulated content goes here instead of into cmsMsg */
+	CMSDecoderContentCallback	contentCallback;
+	void				*contentCallbackContext;
+	
+	/* running digest of detached content fed via CMSDecoderUpdateDetachedContent() */
+	SecCmsDigestContextRef	detachedDigest;
+	
 	/*
 	 * The following are valid (and quiescent) after CMSDecoderFinalizeMessage().
 	 */
@@ -132,6 +139,11 @@ static void cmsDecoderFinalize(
 		SecCmsDecoderDestroy(cmsDecoder->decoder);
 		cmsDecoder->cmsMsg = NULL;
 	}
+	if(cmsDecoder->detachedDigest != NULL) {
+		/* detached content was never finalized */
+		SecCmsDigestContextCancel(cmsDecoder->detachedDigest);
+		cmsDecoder->detachedDigest = NULL;
+	}
 	CFRELEASE(cmsDecoder->detachedContent);
 	CFRELEASE(cmsDecoder->keychainOrArray);
 	if(cmsDecoder->cmsMsg != NULL) {
@@ -146,30 +158,40 @@ static void cmsDecoderFinalize(
 
 
 /*
- * Given detached content and a valid (decoded) SignedData, digest the detached
- * content. This occurs at the later of {CMSDecoderFinalizeMessage() finding a
- * SignedData when already have detachedContent, or CMSDecoderSetDetachedContent()
- * when we already have a SignedData).
+ * Start digesting detached content with the digest algorithms of a valid
+ * (decoded) SignedData.
  */
-static OSStatus cmsDigestDetachedContent(
-                                         CMSDecoderRef cmsDecoder)
+static OSStatus cmsStartDetachedDigest(
+                                       CMSDecoderRef cmsDecoder)
 {
-	ASSERT((cmsDecoder->signedData != NULL) && (cmsDecoder->detachedContent != NULL));
+	ASSERT((cmsDecoder->signedData != NULL) && (cmsDecoder->detachedDigest == NULL));
 	
 	SECAlgorithmID **digestAlgorithms = SecCmsSignedDataGetDigestAlgs(cmsDecoder->signedData);
 	if(digestAlgorithms == NULL) {
 		return errSecUnknownFormat;
 	}
-	SecCmsDigestContextRef digcx = SecCmsDigestContextStartMultiple(digestAlgorithms);
-	if(digcx == NULL) {
+	cmsDecoder->detachedDigest = SecCmsDigestContextStartMultiple(digestAlgorithms);
+	if(cmsDecoder->detachedDigest == NULL) {
 		return errSecAllocate;
 	}
+	return errSecSuccess;
+}
+
+/*
+ * Finish the digests started in cmsStartDetachedDigest() and hand them to
+ * the SignedData, after which the signers can be verified.
+ */
+static OSStatus cmsFinishDetachedDigest(
+                                        CMSDecoderRef cmsDecoder)
+{
+	ASSERT((cmsDecoder->signedData != NULL) && (cmsDecoder->detachedDigest != NULL));
+	
+	SECAlgorithmID **digestAlgorithms = SecCmsSignedDataGetDigestAlgs(cmsDecoder->signedData);
 	CSSM_DATA **digests = NULL;
 	
-	SecCmsDigestContextUpdate(digcx, CFDataGetBytePtr(cmsDecoder->detachedContent),
-                              CFDataGetLength(cmsDecoder->detachedContent));
 	/* note this frees the digest content regardless */
-	OSStatus ortn = SecCmsDigestContextFinishMultiple(digcx, cmsDecoder->arena, &digests);
+	OSStatus ortn = SecCmsDigestContextFinishMultiple(cmsDecoder->detachedDigest, cmsDecoder->arena, &digests);
+	cmsDecoder->detachedDigest = NULL;
 	if(ortn) {
 		ortn = cmsRtnToOSStatus(ortn);
 		CSSM_PERROR("SecCmsDigestContextFinishMultiple", ortn);
@@ -183,6 +205,40 @@ static OSStatus cmsDigestDetachedContent(
 	return ortn;
 }
 
+/*
+ * Given detached content and a valid (decoded) SignedData, digest the detached
+ * content. This occurs at the later of {CMSDecoderFinalizeMessage() finding a
+ * SignedData when already have detachedContent, or CMSDecoderSetDetachedContent()
+ * when we already have a SignedData).
+ */
+static OSStatus cmsDigestDetachedContent(
+                                         CMSDecoderRef cmsDecoder)
+{
+	ASSERT((cmsDecoder->signedData != NULL) && (cmsDecoder->detachedContent != NULL));
+	
+	OSStatus ortn = cmsStartDetachedDigest(cmsDecoder);
+	if(ortn) {
+		return ortn;
+	}
+	SecCmsDigestContextUpdate(cmsDecoder->detachedDigest, CFDataGetBytePtr(cmsDecoder->detachedContent),
+                              CFDataGetLength(cmsDecoder->detachedContent));
+	return cmsFinishDetachedDigest(cmsDecoder);
+}
+
+/*
+ * SecCmsContentCallback handed to the SecCmsDecoder when the caller asked for
+ * streamed content; the digests have already been updated by the time we
+ * get here.
+ */
+static void cmsDecoderDeliverContent(
+                                     void *arg,
+                                     const char *buf,
+                                     size_t len)
+{
+	CMSDecoderRef cmsDecoder = (CMSDecoderRef)arg;
+	cmsDecoder->contentCallback(cmsDecoder->contentCallbackContext, buf, len);
+}
+
 #pragma mark --- Start of Public API ---
 
 CFTypeID CMSDecoderGetTypeID(void)
@@ -238,7 +294,8 @@ OSStatus CMSDecoderUpdateMessage(
 				return cmsRtnToOSStatus(ortn);
 			}
 			ortn = SecCmsDecoderCreate(cmsDecoder->arena,
-                                       NULL, NULL, NULL, NULL, NULL, NULL, &cmsDecoder->decoder);
+                                       cmsDecoder->contentCallback ? cmsDecoderDeliverContent : NULL, cmsDecoder,
+                                       NULL, NULL, NULL, NULL, &cmsDecoder->decoder);
 			if(ortn) {
 				ortn = cmsRtnToOSStatus(ortn);
 				CSSM_PERROR("SecCmsDecoderCreate", ortn);
@@ -354,6 +411,10 @@ OSStatus CMSDecoderSetDetachedContent(
 	if((cmsDecoder == NULL) || (detachedContent == NULL)) {
 		return errSecParam;
 	}
+	if(cmsDecoder->detachedDigest != NULL) {
+		/* already being fed via CMSDecoderUpdateDetachedContent() */
+		return errSecParam;
+	}
 	cmsDecoder->detachedContent = detachedContent;
 	CFRetain(detachedContent);
 	
@@ -731,7 +792,8 @@ OSStatus CMSDecoderCopyAllCerts(
 
 /*
  * Obtain the actual message content (payload), if any. If the message was
- * signed with detached content this will return NULL.
+ * signed with detached content, or the content was delivered through
+ * CMSDecoderSetContentCallback(), this will return NULL.
  * Caller must CFRelease the result.
  */
 OSStatus CMSDecoderCopyContent(
@@ -826,6 +888,77 @@ OSStatus CMSDecoderGetDecoder(
 	return errSecSuccess;
 }
 
+/*
+ * Have the encapsulated content of the message handed to contentCallback, in
+ * pieces, as CMSDecoderUpdateMessage() decodes it rather than accumulated for
+ * CMSDecoderCopyContent(). Signer digests are still computed as the content
+ * goes by, so the signers can be verified after CMSDecoderFinalizeMessage()
+ * as usual. Must be called before the first call to CMSDecoderUpdateMessage().
+ */
+OSStatus CMSDecoderSetContentCallback(
+                                      CMSDecoderRef				cmsDecoder,
+                                      CMSDecoderContentCallback	contentCallback,
+                                      void						*context)
+{
+	if(cmsDecoder == NULL) {
+		return errSecParam;
+	}
+	if(cmsDecoder->decState != DS_Init) {
+		return errSecParam;
+	}
+	cmsDecoder->contentCallback = contentCallback;
+	cmsDecoder->contentCallbackContext = context;
+	return errSecSuccess;
+}
+
+/*
+ * Feed detached content to be digested, a piece at a time, as an alternative
+ * to CMSDecoderSetDetachedContent(). This can only be called after
+ * CMSDecoderFinalizeMessage() has found a SignedData, since that is what
+ * names the digest algorithms; CMSDecoderFinalizeDetachedContent() must
+ * follow the last call.
+ */
+OSStatus CMSDecoderUpdateDetachedContent(
+                                         CMSDecoderRef		cmsDecoder,
+                                         const void			*contentBytes,
+                                         size_t				contentBytesLen)
+{
+	if((cmsDecoder == NULL) || ((contentBytes == NULL) && (contentBytesLen != 0))) {
+		return errSecParam;
+	}
+	if((cmsDecoder->decState != DS_Final) || (cmsDecoder->signedData == NULL) ||
+	   (cmsDecoder->detachedContent != NULL)) {
+		return errSecParam;
+	}
+	if(cmsDecoder->detachedDigest == NULL) {
+		OSStatus ortn = cmsStartDetachedDigest(cmsDecoder);
+		if(ortn) {
+			return ortn;
+		}
+	}
+	SecCmsDigestContextUpdate(cmsDecoder->detachedDigest, (const unsigned char *)contentBytes,
+                              contentBytesLen);
+	return errSecSuccess;
+}
+
+/*
+ * Indicate that no more CMSDecoderUpdateDetachedContent() calls are
+ * forthcoming. After this, CMSDecoderCopySignerStatus() verifies the
+ * signers against the content.
+ */
+OSStatus CMSDecoderFinalizeDetachedContent(
+                                           CMSDecoderRef		cmsDecoder)
+{
+	if(cmsDecoder == NULL) {
+		return errSecParam;
+	}
+	if(cmsDecoder->detachedDigest == NULL) {
+		/* no CMSDecoderUpdateDetachedContent(), or already finalized */
+		return errSecParam;
+	}
+	return cmsFinishDetachedDigest(cmsDecoder);
+}
+
 /*
  * Obtain the signing time of signer 'signerIndex' of a CMS message, if
  * present. This is an unauthenticate time, although it is part of the
@@ -154,6 +154,38 @@ OSStatus CMSDecoderGetDecoder(
 	CMSDecoderRef		cmsDecoder,
 	SecCmsDecoderRef	*decoder);			/* RETURNED */
 
+/*
+ * Streaming decode of large messages. With a content callback set (before the
+ * first CMSDecoderUpdateMessage()), encapsulated content is passed to the
+ * callback as it is decoded instead of being kept in memory, and
+ * CMSDecoderCopyContent() returns NULL. Detached content can likewise be
+ * digested a piece at a time with CMSDecoderUpdateDetachedContent() once
+ * CMSDecoderFinalizeMessage() has been called, followed by
+ * CMSDecoderFinalizeDetachedContent(). Either way memory use does not depend
+ * on the size of the content, and the signers are verified with
+ * CMSDecoderCopySignerStatus() as usual.
+ *
+ * A decoder supplied with CMSDecoderSetDecoder() does not use the content
+ * callback.
+ */
+typedef void (*CMSDecoderContentCallback)(
+	void				*context,
+	const void			*contentBytes,
+	size_t				contentBytesLen);
+
+OSStatus CMSDecoderSetContentCallback(
+	CMSDecoderRef				cmsDecoder,
+	CMSDecoderContentCallback	contentCallback,
+	void						*context);
+
+OSStatus CMSDecoderUpdateDetachedContent(
+	CMSDecoderRef		cmsDecoder,
+	const void			*contentBytes,
+	size_t				contentBytesLen);
+
+OSStatus CMSDecoderFinalizeDetachedContent(
+	CMSDecoderRef		cmsDecoder);
+
 /*
  * Obtain the Hash Agility attribute value of signer 'signerIndex'
  * of a CMS message, if present.
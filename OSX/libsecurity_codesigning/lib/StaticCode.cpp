@@ -358,6 +358,7 @@ void SecStaticCode::resetValidity()
 	mGotResourceBase = false;
 	mTrust = NULL;
 	mCertChain = NULL;
+	mCertFacts.reset();
 #if TARGET_OS_OSX
 	mEvalDetails = NULL;
 #endif
@@ -905,13 +906,13 @@ bool SecStaticCode::verifySignature()
 		MacOSError::check(SecTrustGetResult(mTrust, &trustResult, &mCertChain.aref(), &mEvalDetails));
 
 		// if this is an Apple developer cert....
-		if (teamID() && SecStaticCode::isAppleDeveloperCert(mCertChain)) {
-			CFRef<CFStringRef> teamIDFromCert;
+		if (teamID() && SecStaticCode::isAppleDeveloperCert(mCertChain, &mCertFacts)) {
+			CFStringRef teamIDFromCert;
 			if (CFArrayGetCount(mCertChain) > 0) {
 				/* Note that SecCertificateCopySubjectComponent sets the out parameter to NULL if there is no field present */
-				MacOSError::check(SecCertificateCopySubjectComponent((SecCertificateRef)CFArrayGetValueAtIndex(mCertChain, Requirement::leafCert),
-																	 &CSSMOID_OrganizationalUnitName,
-																	 &teamIDFromCert.aref()));
+				MacOSError::check(mCertFacts.subjectComponent((SecCertificateRef)CFArrayGetValueAtIndex(mCertChain, Requirement::leafCert),
+															  CSSMOID_OrganizationalUnitName,
+															  teamIDFromCert));
 
 				if (teamIDFromCert) {
 					CFRef<CFStringRef> teamIDFromCD = CFStringCreateWithCString(NULL, teamID(), kCFStringEncodingUTF8);
@@ -964,7 +965,7 @@ bool SecStaticCode::verifySignature()
 		if (mSigningTimestamp) {
 			CFIndex rootix = CFArrayGetCount(mCertChain);
 			if (SecCertificateRef mainRoot = SecCertificateRef(CFArrayGetValueAtIndex(mCertChain, rootix-1)))
-				if (isAppleCA(mainRoot)) {
+				if (mCertFacts.isAppleCA(mainRoot)) {
 					// impose policy: if the signature itself draws to Apple, then so must the timestamp signature
 					CFRef<CFArrayRef> tsCerts;
 					OSStatus result = CMSDecoderCopySignerTimestampCertificates(cms, 0, &tsCerts.aref());
@@ -973,7 +974,7 @@ bool SecStaticCode::verifySignature()
 						MacOSError::check(result);
 					}
 					CFIndex tsn = CFArrayGetCount(tsCerts);
-					bool good = tsn > 0 && isAppleCA(SecCertificateRef(CFArrayGetValueAtIndex(tsCerts, tsn-1)));
+					bool good = tsn > 0 && mCertFacts.isAppleCA(SecCertificateRef(CFArrayGetValueAtIndex(tsCerts, tsn-1)));
 					if (!good) {
 						result = CSSMERR_TP_NOT_TRUSTED;
 						Security::Syslog::error("SecStaticCode: timestamp policy verification failed (error %d)", (int)result);
@@ -1882,7 +1883,8 @@ const Requirement *SecStaticCode::defaultDesignatedRequirement()
 			this->codeDirectory(),
 			NULL,
 			kSecCodeSignatureNoHash,
-			false
+			false,
+			&mCertFacts
 		);
 		return DRMaker(context).make();
 #else
@@ -1915,7 +1917,7 @@ bool SecStaticCode::satisfiesRequirement(const Requirement *req, OSStatus failur
 	bool result = false;
 	assert(req);
 	validateDirectory();
-	result = req->validates(Requirement::Context(mCertChain, infoDictionary(), entitlements(), codeDirectory()->identifier(), codeDirectory(), NULL, kSecCodeSignatureNoHash, mRep->appleInternalForcePlatform()), failure);
+	result = req->validates(Requirement::Context(mCertChain, infoDictionary(), entitlements(), codeDirectory()->identifier(), codeDirectory(), NULL, kSecCodeSignatureNoHash, mRep->appleInternalForcePlatform(), &mCertFacts), failure);
 	return result;
 }
 
@@ -2286,11 +2288,11 @@ void SecStaticCode::handleOtherArchitectures(void (^handle)(SecStaticCode* other
 // if it is a Mac or IPhone developer cert, an app store distribution cert,
 // or a developer ID
 //
-bool SecStaticCode::isAppleDeveloperCert(CFArrayRef certs)
+bool SecStaticCode::isAppleDeveloperCert(CFArrayRef certs, CertificateFacts *facts /* = NULL */)
 {
 	static const std::string appleDeveloperRequirement = "(" + std::string(WWDRRequirement) + ") or (" + MACWWDRRequirement + ") or (" + developerID + ") or (" + distributionCertificate + ") or (" + iPhoneDistributionCert + ")";
 	SecPointer<SecRequirement> req = new SecRequirement(parseRequirement(appleDeveloperRequirement), true);
-	Requirement::Context ctx(certs, NULL, NULL, "", NULL, NULL, kSecCodeSignatureNoHash, false);
+	Requirement::Context ctx(certs, NULL, NULL, "", NULL, NULL, kSecCodeSignatureNoHash, false, facts);
 
 	return req->requirement()->validates(ctx);
 }
@@ -198,7 +198,7 @@ public:
 	
 	CFDictionaryRef signingInformation(SecCSFlags flags); // omnibus information-gathering API (creates new dictionary)
 
-	static bool isAppleDeveloperCert(CFArrayRef certs); // determines if this is an apple developer certificate for library validation
+	static bool isAppleDeveloperCert(CFArrayRef certs, CertificateFacts *facts = NULL); // determines if this is an apple developer certificate for library validation
 #if !TARGET_OS_OSX
     bool trustedSigningCertChain() { return mTrustedSigningCertChain; }
 #endif
@@ -300,6 +300,7 @@ private:
 	// signature verification outcome (mTrust == NULL => not done yet)
 	CFRef<SecTrustRef> mTrust;			// outcome of crypto validation (valid or not)
 	CFRef<CFArrayRef> mCertChain;
+	CertificateFacts mCertFacts;		// what we and our requirements learned from the certs
 #if TARGET_OS_OSX
     CSSM_TP_APPLE_EVIDENCE_INFO *mEvalDetails;
 #else
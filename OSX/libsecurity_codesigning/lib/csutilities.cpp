@@ -153,6 +153,106 @@ bool certificateHasPolicy(SecCertificateRef cert, const CSSM_OID &policyOid)
 }
 #endif
 
+
+//
+// CertificateFacts
+//
+CertificateFacts::Facts &CertificateFacts::facts(SecCertificateRef cert)
+{
+	assert(cert);
+	std::map<SecCertificateRef, Facts>::iterator it = mFacts.find(cert);
+	if (it == mFacts.end()) {
+		it = mFacts.insert(make_pair(cert, Facts())).first;
+		it->second.cert = cert;
+	}
+	return it->second;
+}
+
+bool CertificateFacts::isAppleCA(SecCertificateRef cert)
+{
+	if (cert == NULL)
+		return false;
+	StLock<Mutex> _(mLock);
+	Facts &f = facts(cert);
+	if (f.appleCA == Facts::unknown)
+		f.appleCA = CodeSigning::isAppleCA(cert) ? Facts::yes : Facts::no;
+	return f.appleCA == Facts::yes;
+}
+
+void CertificateFacts::hash(SecCertificateRef cert, SHA1::Digest digest)
+{
+	StLock<Mutex> _(mLock);
+	Facts &f = facts(cert);
+	if (!f.haveHash) {
+		hashOfCertificate(cert, f.hash.data);
+		f.haveHash = true;
+	}
+	memcpy(digest, f.hash.data, sizeof(f.hash.data));
+}
+
+#if TARGET_OS_OSX
+OSStatus CertificateFacts::subjectComponent(SecCertificateRef cert, const CSSM_OID &oid, CFStringRef &value)
+{
+	StLock<Mutex> _(mLock);
+	Facts &f = facts(cert);
+	std::string key = 'S' + std::string((const char *)oid.Data, oid.Length);
+	std::map<std::string, Field>::iterator it = f.fields.find(key);
+	if (it == f.fields.end()) {
+		CFRef<CFStringRef> component;
+		OSStatus rc = SecCertificateCopySubjectComponent(cert, &oid, &component.aref());
+		it = f.fields.insert(make_pair(key, Field())).first;
+		it->second.status = rc;
+		it->second.value = component.get();
+	}
+	value = CFStringRef(it->second.value.get());
+	return it->second.status;
+}
+
+OSStatus CertificateFacts::emailAddresses(SecCertificateRef cert, CFArrayRef &value)
+{
+	StLock<Mutex> _(mLock);
+	Facts &f = facts(cert);
+	std::map<std::string, Field>::iterator it = f.fields.find("E");
+	if (it == f.fields.end()) {
+		CFRef<CFArrayRef> addresses;
+		OSStatus rc = SecCertificateCopyEmailAddresses(cert, &addresses.aref());
+		it = f.fields.insert(make_pair(std::string("E"), Field())).first;
+		it->second.status = rc;
+		it->second.value = addresses.get();
+	}
+	value = CFArrayRef(it->second.value.get());
+	return it->second.status;
+}
+
+bool CertificateFacts::hasField(SecCertificateRef cert, const CSSM_OID &oid)
+{
+	StLock<Mutex> _(mLock);
+	Facts &f = facts(cert);
+	std::string key = 'F' + std::string((const char *)oid.Data, oid.Length);
+	std::map<std::string, bool>::const_iterator it = f.has.find(key);
+	if (it != f.has.end())
+		return it->second;
+	return f.has[key] = certificateHasField(cert, oid);
+}
+
+bool CertificateFacts::hasPolicy(SecCertificateRef cert, const CSSM_OID &policyOid)
+{
+	StLock<Mutex> _(mLock);
+	Facts &f = facts(cert);
+	std::string key = 'P' + std::string((const char *)policyOid.Data, policyOid.Length);
+	std::map<std::string, bool>::const_iterator it = f.has.find(key);
+	if (it != f.has.end())
+		return it->second;
+	return f.has[key] = certificateHasPolicy(cert, policyOid);
+}
+#endif
+
+void CertificateFacts::reset()
+{
+	StLock<Mutex> _(mLock);
+	mFacts.clear();
+}
+
 //
 // Copyfile
 //
@@ -34,12 +34,15 @@
 #include <security_utilities/dispatch.h>
 #include <security_utilities/hashing.h>
 #include <security_utilities/unix++.h>
+#include <security_utilities/threading.h>
+#include <security_utilities/cfutilities.h>
 #if TARGET_OS_OSX
 #include <security_cdsa_utilities/cssmdata.h>
 #endif
 #include <copyfile.h>
 #include <asl.h>
 #include <cstdarg>
+#include <map>
 
 namespace Security {
 namespace CodeSigning {
@@ -130,6 +133,54 @@ bool certificateHasField(SecCertificateRef cert, const CSSM_OID &oid);
 bool certificateHasPolicy(SecCertificateRef cert, const CSSM_OID &policyOid);
 #endif
 
+
+//
+// A memo of facts pulled out of certificates, so that each is extracted at most
+// once no matter how many parties (requirement evaluation, DR generation,
+// signature validation) ask. Scope one to a single validation: facts are never
+// recomputed, only dropped wholesale by reset().
+// Returned CF objects belong to the memo and stay valid until reset().
+// Failures are memoized as their status; exceptions are not.
+//
+class CertificateFacts {
+	NOCOPY(CertificateFacts)
+public:
+	CertificateFacts() { }
+	
+	bool isAppleCA(SecCertificateRef cert);
+	void hash(SecCertificateRef cert, SHA1::Digest digest);
+#if TARGET_OS_OSX
+	OSStatus subjectComponent(SecCertificateRef cert, const CSSM_OID &oid, CFStringRef &value);
+	OSStatus emailAddresses(SecCertificateRef cert, CFArrayRef &value);
+	bool hasField(SecCertificateRef cert, const CSSM_OID &oid);
+	bool hasPolicy(SecCertificateRef cert, const CSSM_OID &policyOid);
+#endif
+	
+	void reset();
+	
+private:
+	struct Field {
+		OSStatus status;
+		CFCopyRef<CFTypeRef> value;
+	};
+	
+	struct Facts {
+		Facts() : appleCA(unknown), haveHash(false) { }
+		
+		enum { unknown, no, yes } appleCA;
+		bool haveHash;
+		SHA1::SDigest hash;
+		std::map<std::string, Field> fields;	// keyed by kind + OID bytes
+		std::map<std::string, bool> has;		// keyed by kind + OID bytes
+		CFCopyRef<SecCertificateRef> cert;		// keeps our key alive
+	};
+	
+	Facts &facts(SecCertificateRef cert);	// mLock held
+	
+	Mutex mLock;
+	std::map<SecCertificateRef, Facts> mFacts;
+};
+
 //
 // Encapsulation of the copyfile(3) API.
 // This is slated to go into utilities once stable.
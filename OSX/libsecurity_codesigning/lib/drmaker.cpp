@@ -45,7 +45,7 @@ const CSSM_DATA devIdLeafMarkerOID = { sizeof(caspianLeafMarker), (uint8_t *)cas
 
 
 DRMaker::DRMaker(const Requirement::Context &context)
-	: ctx(context)
+	: ctx(context), facts(context.certFacts ? *context.certFacts : mOwnFacts)
 {
 }
 
@@ -68,7 +68,7 @@ Requirement *DRMaker::make()
 	this->put(opAnd);
 	this->ident(ctx.identifier);
 	
-	if (isAppleCA(ctx.cert(Requirement::anchorCert))
+	if (facts.isAppleCA(ctx.cert(Requirement::anchorCert))
 #if	defined(TEST_APPLE_ANCHOR)
 		|| !memcmp(anchorHash, Requirement::testAppleAnchorHash(), SHA1::digestLength)
 #endif
@@ -84,16 +84,16 @@ Requirement *DRMaker::make()
 void DRMaker::nonAppleAnchor()
 {
 	// get the Organization DN element for the leaf
-	CFRef<CFStringRef> leafOrganization;
-	MacOSError::check(SecCertificateCopySubjectComponent(ctx.cert(Requirement::leafCert),
-		&CSSMOID_OrganizationName, &leafOrganization.aref()));
+	CFStringRef leafOrganization;
+	MacOSError::check(facts.subjectComponent(ctx.cert(Requirement::leafCert),
+		CSSMOID_OrganizationName, leafOrganization));
 
 	// now step up the cert chain looking for the first cert with a different one
 	int slot = Requirement::leafCert;						// start at leaf
 	if (leafOrganization) {
 		while (SecCertificateRef ca = ctx.cert(slot+1)) {		// NULL if you over-run the anchor slot
-			CFRef<CFStringRef> caOrganization;
-			MacOSError::check(SecCertificateCopySubjectComponent(ca, &CSSMOID_OrganizationName, &caOrganization.aref()));
+			CFStringRef caOrganization;
+			MacOSError::check(facts.subjectComponent(ca, CSSMOID_OrganizationName, caOrganization));
 			if (!caOrganization || CFStringCompare(leafOrganization, caOrganization, 0) != kCFCompareEqualTo)
 				break;
 			slot++;
@@ -104,7 +104,7 @@ void DRMaker::nonAppleAnchor()
 	
 	// nail the last cert with the leaf's Organization value
 	SHA1::Digest authorityHash;
-	hashOfCertificate(ctx.cert(slot), authorityHash);
+	facts.hash(ctx.cert(slot), authorityHash);
 	this->anchor(slot, authorityHash);
 }
 
@@ -113,9 +113,9 @@ void DRMaker::appleAnchor()
 {
 	if (isIOSSignature()) {
 		// get the Common Name DN element for the leaf
-		CFRef<CFStringRef> leafCN;
-		MacOSError::check(SecCertificateCopySubjectComponent(ctx.cert(Requirement::leafCert),
-			&CSSMOID_CommonName, &leafCN.aref()));
+		CFStringRef leafCN;
+		MacOSError::check(facts.subjectComponent(ctx.cert(Requirement::leafCert),
+			CSSMOID_CommonName, leafCN));
 		
 		// apple anchor generic and ...
 		this->put(opAnd);
@@ -137,9 +137,9 @@ void DRMaker::appleAnchor()
 	
 	if (isDeveloperIDSignature()) {
 		// get the Organizational Unit DN element for the leaf (it contains the TEAMID)
-		CFRef<CFStringRef> teamID;
-		MacOSError::check(SecCertificateCopySubjectComponent(ctx.cert(Requirement::leafCert),
-			&CSSMOID_OrganizationalUnitName, &teamID.aref()));
+		CFStringRef teamID;
+		MacOSError::check(facts.subjectComponent(ctx.cert(Requirement::leafCert),
+			CSSMOID_OrganizationalUnitName, teamID));
 
 		// apple anchor generic and ...
 		this->put(opAnd);
@@ -176,7 +176,7 @@ bool DRMaker::isIOSSignature()
 {
 	if (ctx.certCount() == 3)		// leaf, one intermediate, anchor
 		if (SecCertificateRef intermediate = ctx.cert(1)) // get intermediate
-			if (certificateHasField(intermediate, CssmOid::overlay(adcSdkMarkerOID)))
+			if (facts.hasField(intermediate, adcSdkMarkerOID))
 				return true;
 	return false;
 }
@@ -185,7 +185,7 @@ bool DRMaker::isDeveloperIDSignature()
 {
 	if (ctx.certCount() == 3)		// leaf, one intermediate, anchor
 		if (SecCertificateRef intermediate = ctx.cert(1)) // get intermediate
-			if (certificateHasField(intermediate, CssmOid::overlay(devIdSdkMarkerOID)))
+			if (facts.hasField(intermediate, devIdSdkMarkerOID))
 				return true;
 	return false;
 }
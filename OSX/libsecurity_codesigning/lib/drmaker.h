@@ -28,6 +28,7 @@
 #define _H_DRMAKER
 
 #include "reqmaker.h"
+#include "csutilities.h"
 
 namespace Security {
 namespace CodeSigning {
@@ -52,6 +53,10 @@ public:
 	
 	const Requirement::Context &ctx;
 	
+private:
+	CertificateFacts mOwnFacts;			// used if ctx doesn't bring its own
+	CertificateFacts &facts;
+
 public:
 	Requirement *make();
 
@@ -165,6 +165,134 @@ bool PolicyDatabase::checkCache(CFURLRef path, AuthorityType type, SecAssessment
 }
 
 
+//
+// The in-memory verdict cache
+//
+VerdictCache::Key::Key(CFDataRef cdHash, AuthorityType type, SecCSFlags flags)
+	: hash((const char *)CFDataGetBytePtr(cdHash), CFDataGetLength(cdHash)), type(type), flags(flags)
+{ }
+
+bool VerdictCache::Key::operator < (const Key &other) const
+{
+	if (type != other.type)
+		return type < other.type;
+	if (flags != other.flags)
+		return flags < other.flags;
+	return hash < other.hash;
+}
+
+VerdictCache::VerdictCache()
+	: mGeneration(0), mNotifyToken(-1)
+{
+	if (notify_register_check(kNotifySecAssessmentUpdate, &mNotifyToken) != NOTIFY_STATUS_OK)
+		mNotifyToken = -1;
+}
+
+VerdictCache::~VerdictCache()
+{
+	if (mNotifyToken != -1)
+		notify_cancel(mNotifyToken);
+}
+
+//
+// Pick up rule changes announced by other processes.
+// Returns false if we can't hear about them, in which case nothing may be cached.
+//
+bool VerdictCache::current()
+{
+	int changed;
+	if (mNotifyToken == -1 || notify_check(mNotifyToken, &changed) != NOTIFY_STATUS_OK)
+		return false;
+	if (changed) {
+		mVerdicts.clear();
+		mGeneration++;
+	}
+	return true;
+}
+
+uint64_t VerdictCache::generation()
+{
+	StLock<Mutex> _(mLock);
+	current();
+	return mGeneration;
+}
+
+CFDictionaryRef VerdictCache::find(CFDataRef cdHash, AuthorityType type, SecCSFlags flags)
+{
+	StLock<Mutex> _(mLock);
+	if (!current())
+		return NULL;
+	VerdictMap::iterator it = mVerdicts.find(Key(cdHash, type, flags));
+	if (it == mVerdicts.end())
+		return NULL;
+	if (it->second.expires <= CFAbsoluteTimeGetCurrent() / 86400.0 + julianBase) {
+		mVerdicts.erase(it);
+		return NULL;
+	}
+	return it->second.outcome.retain();
+}
+
+//
+// Copy a cached outcome into an assessment result.
+// Values are copied mutably, since callers annotate the authority dictionary in place.
+//
+static void copyOutcome(const void *key, const void *value, void *result)
+{
+	CFRef<CFPropertyListRef> copy = CFPropertyListCreateDeepCopy(NULL, value, kCFPropertyListMutableContainers);
+	CFDictionarySetValue(CFMutableDictionaryRef(result), key, copy);
+}
+
+void VerdictCache::apply(CFDictionaryRef outcome, CFMutableDictionaryRef result)
+{
+	CFDictionaryApplyFunction(outcome, copyOutcome, result);
+}
+
+void VerdictCache::add(CFDataRef cdHash, AuthorityType type, SecCSFlags flags, uint64_t generation, double expires, CFDictionaryRef result)
+{
+	const CFStringRef keys[] = {
+		kSecAssessmentAssessmentVerdict,
+		kSecAssessmentAssessmentAuthority,
+		kSecAssessmentAssessmentNotarizationDate,
+	};
+	CFRef<CFMutableDictionaryRef> outcome = makeCFMutableDictionary();
+	for (unsigned n = 0; n < sizeof(keys) / sizeof(keys[0]); n++)
+		if (CFTypeRef value = CFDictionaryGetValue(result, keys[n])) {
+			CFRef<CFPropertyListRef> copy = CFPropertyListCreateDeepCopy(NULL, value, kCFPropertyListImmutable);
+			CFDictionarySetValue(outcome, keys[n], copy);
+		}
+
+	StLock<Mutex> _(mLock);
+	if (!current() || generation != mGeneration)
+		return;		// rule book changed while this verdict was being reached
+	if (mVerdicts.size() >= maxEntries) {
+		double now = CFAbsoluteTimeGetCurrent() / 86400.0 + julianBase;
+		for (VerdictMap::iterator it = mVerdicts.begin(); it != mVerdicts.end(); )
+			if (it->second.expires <= now)
+				mVerdicts.erase(it++);
+			else
+				++it;
+		if (mVerdicts.size() >= maxEntries)
+			mVerdicts.clear();
+	}
+	Verdict &verdict = mVerdicts[Key(cdHash, type, flags)];
+	verdict.outcome.take(outcome.yield());
+	verdict.expires = expires;
+}
+
+void VerdictCache::remove(CFDataRef cdHash, AuthorityType type, SecCSFlags flags)
+{
+	StLock<Mutex> _(mLock);
+	mVerdicts.erase(Key(cdHash, type, flags));
+}
+
+void VerdictCache::invalidate()
+{
+	StLock<Mutex> _(mLock);
+	mVerdicts.clear();
+	mGeneration++;
+}
+
+
 //
 // Purge the object cache of all expired entries.
 // These are meant to run within the caller's transaction.
@@ -174,6 +302,8 @@ void PolicyDatabase::purgeAuthority()
 	SQLite::Statement cleaner(*this,
 		"DELETE FROM authority WHERE expires <= JULIANDAY('now');");
 	cleaner.execute();
+	if (this->changes())
+		mVerdicts.invalidate();
 }
 
 void PolicyDatabase::purgeObjects()
@@ -189,6 +319,7 @@ void PolicyDatabase::purgeObjects(double priority)
 		"DELETE FROM object WHERE expires <= JULIANDAY('now') OR (SELECT priority FROM authority WHERE id = object.authority) <= :priority;");
 	cleaner.bind(":priority") = priority;
 	cleaner.execute();
+	mVerdicts.invalidate();		// only called when the rule book changed
 }
 
     
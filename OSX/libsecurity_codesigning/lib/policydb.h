@@ -25,9 +25,13 @@
 
 #include "SecAssessment.h"
 #include <security_utilities/globalizer.h>
+#include <security_utilities/cfutilities.h>
 #include <security_utilities/hashing.h>
 #include <security_utilities/sqlite++.h>
+#include <security_utilities/threading.h>
 #include <CoreFoundation/CoreFoundation.h>
+#include <map>
+#include <string>
 
 namespace Security {
 namespace CodeSigning {
@@ -97,6 +101,51 @@ CFStringRef typeNameFor(AuthorityType type)
     CF_RETURNS_RETAINED;
 
 
+//
+// In-memory cache of the verdicts reached for top-level code, keyed by cdhash.
+// Each entry remembers the policy generation it was reached under; the generation
+// moves on whenever the rule book changes, either through this database or (as
+// announced by kNotifySecAssessmentUpdate) through another process, and outcomes
+// from older generations are neither returned nor stored.
+//
+class VerdictCache {
+public:
+	VerdictCache();
+	~VerdictCache();
+
+	uint64_t generation();
+	CFDictionaryRef find(CFDataRef cdHash, AuthorityType type, SecCSFlags flags) CF_RETURNS_RETAINED;
+	void add(CFDataRef cdHash, AuthorityType type, SecCSFlags flags, uint64_t generation, double expires, CFDictionaryRef result);
+	void remove(CFDataRef cdHash, AuthorityType type, SecCSFlags flags);
+	void invalidate();
+
+	static void apply(CFDictionaryRef outcome, CFMutableDictionaryRef result);
+
+	static const size_t maxEntries = 1024;
+
+private:
+	struct Key {
+		Key(CFDataRef cdHash, AuthorityType type, SecCSFlags flags);
+		std::string hash;			// cdhash bytes
+		AuthorityType type;
+		SecCSFlags flags;			// validation flags the verdict was reached under
+		bool operator < (const Key &other) const;
+	};
+	struct Verdict {
+		CFCopyRef<CFDictionaryRef> outcome; // verdict, authority and notarization date
+		double expires;				// julian date
+	};
+	typedef std::map<Key, Verdict> VerdictMap;
+
+	bool current();				// call with mLock held
+
+	Mutex mLock;
+	VerdictMap mVerdicts;
+	uint64_t mGeneration;
+	int mNotifyToken;
+};
+
+
 //
 // An open policy database.
 // Usually read-only, but can be opened for write by privileged callers.
@@ -116,6 +165,8 @@ public:
 	void purgeObjects();
 	void purgeObjects(double priority);//
 
+	VerdictCache &verdicts() { return mVerdicts; }
+
 	void upgradeDatabase();
 	std::string featureLevel(const char *feature);
 	bool hasFeature(const char *feature) { return !featureLevel(feature).empty(); }
@@ -127,6 +178,7 @@ public:
 
 private:
 	time_t mLastExplicitCheck;
+	VerdictCache mVerdicts;
 };
 
 
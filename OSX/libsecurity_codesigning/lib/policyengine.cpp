@@ -160,7 +160,7 @@ static std::string createWhitelistScreen(SecStaticCodeRef code)
 }
 
 
-void PolicyEngine::evaluateCodeItem(SecStaticCodeRef code, CFURLRef path, AuthorityType type, SecAssessmentFlags flags, bool nested, CFMutableDictionaryRef result)
+void PolicyEngine::evaluateCodeItem(SecStaticCodeRef code, CFURLRef path, AuthorityType type, SecAssessmentFlags flags, bool nested, CFMutableDictionaryRef result, double *cacheUntil)
 {
 	
 	SQLite::Statement query(*this,
@@ -228,7 +228,10 @@ void PolicyEngine::evaluateCodeItem(SecStaticCodeRef code, CFURLRef path, Author
 				CFRef<CFDictionaryRef> xinfo;
 				MacOSError::check(SecTrustCopyExtendedResult(trust, &xinfo.aref()));
 				if (CFDateRef limit = CFDateRef(CFDictionaryGetValue(xinfo, kSecTrustExpirationDate))) {
-					this->recordOutcome(code, allow, type, min(expires, dateToJulian(limit)), id);
+					double until = min(expires, dateToJulian(limit));
+					this->recordOutcome(code, allow, type, until, id);
+					if (cacheUntil)
+						*cacheUntil = until;
 				}
 			}
 		}
@@ -270,8 +273,12 @@ void PolicyEngine::evaluateCodeItem(SecStaticCodeRef code, CFURLRef path, Author
 		SYSPOLICY_ASSESS_OUTCOME_DEFAULT(cpath.c_str(), type, latentLabel.c_str(), hashp);
 		SYSPOLICY_RECORDER_MODE(cpath.c_str(), type, latentLabel.c_str(), hashp, 0);
 	}
-	if (!(flags & kSecAssessmentFlagNoCache))
-		this->recordOutcome(code, false, type, this->julianNow() + NEGATIVE_HOLD, latentID);
+	if (!(flags & kSecAssessmentFlagNoCache)) {
+		double until = this->julianNow() + NEGATIVE_HOLD;
+		this->recordOutcome(code, false, type, until, latentID);
+		if (cacheUntil)
+			*cacheUntil = until;
+	}
 	cfadd(result, "{%O=%B}", kSecAssessmentAssessmentVerdict, false);
 	addAuthority(flags, result, latentLabel.c_str(), latentID);
 }
@@ -399,6 +406,40 @@ void PolicyEngine::evaluateCode(CFURLRef path, AuthorityType type, SecAssessment
 	if (!(flags & kSecAssessmentFlagAllowWeak))
 		validationFlags |= kSecCSStrictValidate;
 	adjustValidation(code);
+	SecCSFlags cacheFlags = validationFlags;	// everything that can sway the verdict
+	if (type == kAuthorityExecute && !appOk)
+		cacheFlags |= kSecCSRestrictToAppLike;
+
+	// warm path: this code directory has been assessed under the current rule book before
+	uint64_t generation = verdicts().generation();
+	CFRef<CFDictionaryRef> signingInfo;
+	CFDataRef cdHash = NULL;
+	if (!(flags & (kSecAssessmentFlagNoCache | kSecAssessmentFlagRequestOrigin))
+		&& SecCodeCopySigningInformation(code, kSecCSDefaultFlags, &signingInfo.aref()) == errSecSuccess)
+		cdHash = CFDataRef(CFDictionaryGetValue(signingInfo, kSecCodeInfoUnique));
+	if (cdHash)
+		if (CFRef<CFDictionaryRef> outcome = verdicts().find(cdHash, type, cacheFlags)) {
+			// Rejections stand as recorded. Approvals skip the rule book but, as with the
+			// object cache, the signature must still hold up against what is on disk now.
+			if (CFDictionaryGetValue(outcome, kSecAssessmentAssessmentVerdict) != kCFBooleanTrue
+				|| SecStaticCodeCheckValidity(code, cacheFlags | kSecCSCheckNestedCode | kSecCSRestrictSymlinks, NULL) == errSecSuccess) {
+				SYSPOLICY_ASSESS_CACHE_HIT();
+				VerdictCache::apply(outcome, result);
+				if (CFMutableDictionaryRef authority = CFMutableDictionaryRef(CFDictionaryGetValue(result, kSecAssessmentAssessmentAuthority))) {
+					// the override state is current, not whatever it was when the verdict was reached
+					CFDictionaryRemoveValue(authority, kSecAssessmentAssessmentAuthorityOverride);
+					if (overrideAssessment(flags))
+						CFDictionaryAddValue(authority, kSecAssessmentAssessmentAuthorityOverride, kDisabledOverride);
+					CFDictionarySetValue(authority, kSecAssessmentAssessmentFromCache, kCFBooleanTrue);
+				}
+				return;
+			}
+			// no longer valid; forget the verdict and assess from scratch
+			verdicts().remove(cdHash, type, cacheFlags);
+			cdHash = NULL;
+			MacOSError::check(SecStaticCodeCreateWithPath(path, kSecCSDefaultFlags | kSecCSForceOnlineNotarizationCheck, &code.aref()));
+			adjustValidation(code);
+		}
 	
 	// deal with a very special case (broken 10.6/10.7 Applet bundles)
 	OSStatus rc = SecStaticCodeCheckValidity(code, validationFlags | kSecCSBasicValidateOnly, NULL);
@@ -412,6 +453,7 @@ void PolicyEngine::evaluateCode(CFURLRef path, AuthorityType type, SecAssessment
 		if (SYSPOLICY_ASSESS_OUTCOME_BROKEN_ENABLED())
 			SYSPOLICY_ASSESS_OUTCOME_BROKEN(cfString(path).c_str(), type, true);
 		rc = errSecCSUnsigned;
+		cdHash = NULL;		// the recorded signature is not what gets assessed
 	}
 
 	// ad-hoc sign unsigned code
@@ -427,6 +469,7 @@ void PolicyEngine::evaluateCode(CFURLRef path, AuthorityType type, SecAssessment
 	// prepare for deep traversal of (hopefully) good signatures
 	SecAssessmentFeedback feedback = SecAssessmentFeedback(CFDictionaryGetValue(context, kSecAssessmentContextKeyFeedback));
 	__block CFRef<CFMutableDictionaryRef> nestedFailure = NULL;	// save a nested failure for later
+	__block double cacheUntil = 0;		// set if the top-level outcome may be cached
 	MacOSError::check(SecStaticCodeSetCallback(code, kSecCSDefaultFlags, NULL, ^CFTypeRef (SecStaticCodeRef item, CFStringRef cfStage, CFDictionaryRef info) {
 		string stage = cfString(cfStage);
 		if (stage == "prepared") {
@@ -440,7 +483,7 @@ void PolicyEngine::evaluateCode(CFURLRef path, AuthorityType type, SecAssessment
 			}
 		} else if (stage == "validated") {
 			SecStaticCodeSetCallback(item, kSecCSDefaultFlags, NULL, NULL);		// clear callback to avoid unwanted recursion
-			evaluateCodeItem(item, path, type, flags, item != code, result);
+			evaluateCodeItem(item, path, type, flags, item != code, result, item == code ? &cacheUntil : NULL);
 			if (CFTypeRef verdict = CFDictionaryGetValue(result, kSecAssessmentAssessmentVerdict))
 				if (CFEqual(verdict, kCFBooleanFalse)) {
 					if (item == code)
@@ -469,6 +512,8 @@ void PolicyEngine::evaluateCode(CFURLRef path, AuthorityType type, SecAssessment
 	case errSecCSVetoed:		// nested code rejected by rule book; result was filled out there
         if (wasAdhocSigned)
             addToAuthority(result, kSecAssessmentAssessmentSource, CFSTR("no usable signature"));   // ad-hoc signature proved useless
+		else if (cdHash && cacheUntil)
+			verdicts().add(cdHash, type, cacheFlags, generation, cacheUntil, result);
 		return;
 	case errSecCSWeakResourceRules:
 	case errSecCSWeakResourceEnvelope:
@@ -532,8 +577,12 @@ void PolicyEngine::evaluateCode(CFURLRef path, AuthorityType type, SecAssessment
 			// default rule requires positive match at each nested code - reinstate failure
 			CFDictionaryReplaceValue(result, kSecAssessmentAssessmentVerdict, kCFBooleanFalse);
 			CFDictionaryReplaceValue(result, kSecAssessmentAssessmentAuthority, nestedFailure);
+			cacheUntil = min(cacheUntil, this->julianNow() + NEGATIVE_HOLD);
 		}
 	}
+
+	if (cdHash && cacheUntil)
+		verdicts().add(cdHash, type, cacheFlags, generation, cacheUntil, result);
 }
 
 
@@ -35,6 +35,7 @@
 #include <IOKit/IOCFUnserialize.h>
 #include "csutilities.h"
 #include "notarization.h"
+#include <algorithm>
 
 namespace Security {
 namespace CodeSigning {
@@ -74,6 +75,244 @@ private:
 static ModuleNexus<Fragments> fragments;
 
 
+//
+// Compiled requirements.
+//
+// A Plan is the requirement program decoded once: one Node per operation, in
+// post-order, with constant operands (strings, match values, hashes, slots)
+// already extracted. Nested and/or chains are flattened into a single n-ary
+// node whose operands are sorted by estimated cost, so cheap tests such as the
+// identifier of "identifier X and anchor apple generic" decide the outcome
+// before any certificate is looked at. Plans are immutable and shared.
+//
+// Nodes also record whether evaluating them can throw. Only trivial tests that
+// just compare against the code directory are known not to; everything else
+// (certificates, trust settings, fragments, dictionary matches) is assumed to.
+//
+class Requirement::Interpreter::Plan : public RefCount {
+public:
+	Plan(const Requirement *req);
+	
+	struct Node {
+		Node() : op(opFalse), pc(0), slot(0), cost(0), mayThrow(true) { }
+		
+		ExprOp op;						// opcode as encoded (flags included)
+		Offset pc;						// where it came from (for tracing)
+		int32_t slot;					// certificate slot or platform
+		std::string key;				// identifier, key, field name, OID or fragment name
+		Match match;					// match suffix, if any
+		CFCopyRef<CFDataRef> hash;		// opCDHash operand
+		SHA1::SDigest digest;			// opAnchorHash operand
+		std::vector<unsigned> args;		// operand nodes (opAnd, opOr, opNot, skipped unknowns)
+		unsigned cost;					// rough relative evaluation cost
+		bool mayThrow;					// evaluating this (or any operand) can throw
+	};
+	
+	const Node &node(unsigned ix) const { return mNodes[ix]; }
+	size_t size() const { return mNodes.size(); }
+	unsigned root() const { return mRoot; }
+	
+private:
+	class Compiler;
+	
+	std::vector<Node> mNodes;
+	unsigned mRoot;
+};
+
+
+class Requirement::Interpreter::Plan::Compiler : public Requirement::Reader {
+public:
+	Compiler(const Requirement *req, std::vector<Node> &nodes) : Reader(req), mNodes(nodes) { }
+	
+	unsigned compile(int depth);
+	
+private:
+	void operand(Node &node, unsigned arg);
+	
+	struct CheaperFirst {
+		CheaperFirst(const std::vector<Node> &nodes) : mNodes(nodes) { }
+		bool operator () (unsigned a, unsigned b) const { return mNodes[a].cost < mNodes[b].cost; }
+		const std::vector<Node> &mNodes;
+	};
+	
+	std::vector<Node> &mNodes;
+};
+
+Requirement::Interpreter::Plan::Plan(const Requirement *req)
+{
+	mRoot = Compiler(req, mNodes).compile(stackLimit);
+}
+
+//
+// Append an operand to an and/or node, absorbing operands of the same operation
+//
+void Requirement::Interpreter::Plan::Compiler::operand(Node &node, unsigned arg)
+{
+	const Node &sub = mNodes[arg];
+	if (sub.op == node.op)
+		node.args.insert(node.args.end(), sub.args.begin(), sub.args.end());
+	else
+		node.args.push_back(arg);
+}
+
+unsigned Requirement::Interpreter::Plan::Compiler::compile(int depth)
+{
+	if (--depth <= 0)		// nested too deeply - protect the stack
+		MacOSError::throwMe(errSecCSReqInvalid);
+	
+	Node node;
+	node.pc = pc();
+	node.op = ExprOp(get<uint32_t>());
+	switch (node.op & ~opFlagMask) {
+	case opFalse:
+	case opTrue:
+		node.mayThrow = false;
+		break;
+	case opIdent:
+		node.key = getString();
+		node.cost = 1;
+		node.mayThrow = false;
+		break;
+	case opAppleAnchor:
+		node.cost = 4;
+		break;
+	case opAppleGenericAnchor:
+		node.cost = 3;
+		break;
+	case opAnchorHash:
+		node.slot = get<int32_t>();
+		node.digest = SHA1::SDigest(getSHA1());
+		node.cost = 3;
+		break;
+	case opInfoKeyValue:	// [legacy; use opInfoKeyField]
+		node.key = getString();
+		node.match = Match(CFTempString(getString()), matchEqual);
+		node.cost = 2;
+		break;
+	case opAnd:
+	case opOr:
+		{
+			unsigned left = compile(depth);
+			unsigned right = compile(depth);
+			operand(node, left);
+			operand(node, right);
+			// stable, so equally expensive operands keep their written order
+			std::stable_sort(node.args.begin(), node.args.end(), CheaperFirst(mNodes));
+			node.mayThrow = false;
+			for (std::vector<unsigned>::const_iterator it = node.args.begin(); it != node.args.end(); ++it) {
+				node.cost += mNodes[*it].cost;
+				node.mayThrow |= mNodes[*it].mayThrow;
+			}
+			break;
+		}
+	case opCDHash:
+		node.hash.take(getHash());
+		node.cost = 1;
+		node.mayThrow = false;
+		break;
+	case opNot:
+		node.args.push_back(compile(depth));
+		node.cost = mNodes[node.args[0]].cost;
+		node.mayThrow = mNodes[node.args[0]].mayThrow;
+		break;
+	case opInfoKeyField:
+	case opEntitlementField:
+		node.key = getString();
+		node.match = Match(*this);
+		node.cost = 2;
+		break;
+	case opCertField:
+#if TARGET_OS_OSX
+	case opCertGeneric:
+	case opCertPolicy:
+#endif
+		node.slot = get<int32_t>();
+		node.key = getString();
+		node.match = Match(*this);
+		node.cost = 3;
+		break;
+	case opTrustedCert:
+		node.slot = get<int32_t>();
+		node.cost = 5;
+		break;
+	case opTrustedCerts:
+		node.cost = 5;
+		break;
+	case opNamedAnchor:
+	case opNamedCode:
+		node.key = getString();
+		node.cost = 6;
+		break;
+	case opPlatform:
+		node.slot = get<int32_t>();
+		node.cost = 1;
+		node.mayThrow = false;
+		break;
+	case opNotarized:
+		node.cost = 6;
+		break;
+	default:
+		// opcode not recognized - handle generically if possible, fail otherwise
+		if (node.op & (opGenericFalse | opGenericSkip)) {
+			// unknown opcode, but it has a size field and can be safely bypassed
+			skip(get<uint32_t>());
+			if (node.op & opGenericFalse) {
+				node.mayThrow = false;
+			} else {
+				node.args.push_back(compile(depth));
+				node.cost = mNodes[node.args[0]].cost;
+				node.mayThrow = mNodes[node.args[0]].mayThrow;
+			}
+			break;
+		}
+		// unrecognized opcode and no way to interpret it
+		secinfo("csinterp", "opcode 0x%x cannot be handled; aborting", node.op);
+		MacOSError::throwMe(errSecCSUnimplemented);
+	}
+	mNodes.push_back(node);
+	return unsigned(mNodes.size() - 1);
+}
+
+
+//
+// Process-global cache of Plans, keyed by the requirement's bytes.
+// Requirements evaluated repeatedly (designated requirements, peer checks)
+// are few, so this is bounded crudely.
+//
+class Plans {
+public:
+	RefPointer<Requirement::Interpreter::Plan> plan(const Requirement *req);
+	
+private:
+	static const size_t limit = 256;
+	typedef std::map<std::string, RefPointer<Requirement::Interpreter::Plan> > PlanMap;
+	
+	Mutex mLock;					// lock for all of the below...
+	PlanMap mPlans;					// cached plans
+};
+
+static ModuleNexus<Plans> plans;
+
+RefPointer<Requirement::Interpreter::Plan> Plans::plan(const Requirement *req)
+{
+	std::string key((const char *)req, req->length());
+	{
+		StLock<Mutex> _(mLock);
+		PlanMap::const_iterator it = mPlans.find(key);
+		if (it != mPlans.end())
+			return it->second;
+	}
+	
+	// compile outside the lock; a racing thread may do the same, which is harmless
+	RefPointer<Requirement::Interpreter::Plan> plan = new Requirement::Interpreter::Plan(req);
+	StLock<Mutex> _(mLock);
+	if (mPlans.size() >= limit)
+		mPlans.erase(mPlans.begin());
+	mPlans[key] = plan;
+	return plan;
+}
+
+
 //
 // Magic certificate features
 //
@@ -84,121 +323,112 @@ static CFStringRef appleIntermediateO = CFSTR("Apple Inc.");
 //
 // Main interpreter function.
 //
-// ExprOp code is in Polish Notation (operator followed by operands),
-// and this engine uses opportunistic evaluation.
+// ExprOp code is in Polish Notation (operator followed by operands).
+// It is evaluated from its compiled Plan; and/or stop at the first
+// operand that decides the outcome.
+//
+// The bytecode interpreter evaluated every operand, so an operand that threw
+// failed the requirement even where the others already said yes, e.g. a
+// malformed certificate field in "identifier X or certificate leaf[...]".
+// Short-circuiting must not turn that into a pass, so before returning true we
+// evaluate every operand that was skipped and could throw, ignoring its value.
+// A false result needs no such check: failing with an error or failing without
+// one both deny.
 //
 bool Requirement::Interpreter::evaluate()
-{ return eval(stackLimit); }
+{
+	RefPointer<Plan> plan = plans().plan(requirement());
+	mEvaluated.assign(plan->size(), false);
+	if (!eval(*plan, plan->root()))
+		return false;
+	raiseErrors(*plan, plan->root());
+	return true;
+}
 
-bool Requirement::Interpreter::eval(int depth)
+void Requirement::Interpreter::raiseErrors(const Plan &plan, unsigned ix)
 {
-	if (--depth <= 0)		// nested too deeply - protect the stack
-		MacOSError::throwMe(errSecCSReqInvalid);
-	
-	ExprOp op = ExprOp(get<uint32_t>());
-	CODESIGN_EVAL_REQINT_OP(op, this->pc() - sizeof(uint32_t));
-	switch (op & ~opFlagMask) {
+	const Plan::Node &node = plan.node(ix);
+	if (!node.mayThrow)
+		return;
+	if (node.args.empty()) {
+		if (!mEvaluated[ix])
+			(void)eval(plan, ix);
+	} else {
+		for (std::vector<unsigned>::const_iterator it = node.args.begin(); it != node.args.end(); ++it)
+			raiseErrors(plan, *it);
+	}
+}
+
+bool Requirement::Interpreter::eval(const Plan &plan, unsigned ix)
+{
+	const Plan::Node &node = plan.node(ix);
+	mEvaluated[ix] = true;
+	CODESIGN_EVAL_REQINT_OP(node.op, node.pc);
+	switch (node.op & ~opFlagMask) {
 	case opFalse:
 		return false;
 	case opTrue:
 		return true;
 	case opIdent:
-		return mContext->directory && getString() == mContext->directory->identifier();
+		return mContext->directory && node.key == mContext->directory->identifier();
 	case opAppleAnchor:
 		return appleSigned();
 	case opAppleGenericAnchor:
 		return appleAnchored();
 	case opAnchorHash:
-		{
-			SecCertificateRef cert = mContext->cert(get<int32_t>());
-			return verifyAnchor(cert, getSHA1());
-		}
-	case opInfoKeyValue:	// [legacy; use opInfoKeyField]
-		{
-			string key = getString();
-			return infoKeyValue(key, Match(CFTempString(getString()), matchEqual));
-		}
+		return verifyAnchor(mContext->cert(node.slot), node.digest.data);
+	case opInfoKeyValue:
+	case opInfoKeyField:
+		return infoKeyValue(node.key, node.match);
 	case opAnd:
-		return eval(depth) & eval(depth);
+		for (std::vector<unsigned>::const_iterator it = node.args.begin(); it != node.args.end(); ++it)
+			if (!eval(plan, *it))
+				return false;
+		return true;
 	case opOr:
-		return eval(depth) | eval(depth);
+		for (std::vector<unsigned>::const_iterator it = node.args.begin(); it != node.args.end(); ++it)
+			if (eval(plan, *it))
+				return true;
+		return false;
 	case opCDHash:
 		if (mContext->directory) {
 			CFRef<CFDataRef> cdhash = mContext->directory->cdhash();
-			CFRef<CFDataRef> required = getHash();
-			return CFEqual(cdhash, required);
+			return CFEqual(cdhash, node.hash);
 		} else
 			return false;
 	case opNot:
-		return !eval(depth);
-	case opInfoKeyField:
-		{
-			string key = getString();
-			Match match(*this);
-			return infoKeyValue(key, match);
-		}
+		return !eval(plan, node.args[0]);
 	case opEntitlementField:
-		{
-			string key = getString();
-			Match match(*this);
-			return entitlementValue(key, match);
-		}
+		return entitlementValue(node.key, node.match);
 	case opCertField:
-		{
-			SecCertificateRef cert = mContext->cert(get<int32_t>());
-			string key = getString();
-			Match match(*this);
-			return certFieldValue(key, match, cert);
-		}
+		return certFieldValue(node.key, node.match, mContext->cert(node.slot));
 #if TARGET_OS_OSX
 	case opCertGeneric:
-		{
-			SecCertificateRef cert = mContext->cert(get<int32_t>());
-			string key = getString();
-			Match match(*this);
-			return certFieldGeneric(key, match, cert);
-		}
+		return certFieldGeneric(node.key, node.match, mContext->cert(node.slot));
 	case opCertPolicy:
-		{
-			SecCertificateRef cert = mContext->cert(get<int32_t>());
-			string key = getString();
-			Match match(*this);
-			return certFieldPolicy(key, match, cert);
-		}
+		return certFieldPolicy(node.key, node.match, mContext->cert(node.slot));
 #endif
 	case opTrustedCert:
-		return trustedCert(get<int32_t>());
+		return trustedCert(node.slot);
 	case opTrustedCerts:
 		return trustedCerts();
 	case opNamedAnchor:
-		return fragments().namedAnchor(getString(), *mContext);
+		return fragments().namedAnchor(node.key, *mContext);
 	case opNamedCode:
-		return fragments().named(getString(), *mContext);
+		return fragments().named(node.key, *mContext);
 	case opPlatform:
-		{
-			int32_t targetPlatform = get<int32_t>();
-			return mContext->directory && mContext->directory->platform == targetPlatform;
-		}
+		return mContext->directory && mContext->directory->platform == node.slot;
 	case opNotarized:
-		{
-			return isNotarized(mContext);
-		}
+		return isNotarized(mContext);
 	default:
-		// opcode not recognized - handle generically if possible, fail otherwise
-		if (op & (opGenericFalse | opGenericSkip)) {
-			// unknown opcode, but it has a size field and can be safely bypassed
-			skip(get<uint32_t>());
-			if (op & opGenericFalse) {
-				CODESIGN_EVAL_REQINT_UNKNOWN_FALSE(op);
-				return false;
-			} else {
-				CODESIGN_EVAL_REQINT_UNKNOWN_SKIPPED(op);
-				return eval(depth);
-			}
+		// unknown opcode the compiler accepted as skippable
+		if (node.op & opGenericFalse) {
+			CODESIGN_EVAL_REQINT_UNKNOWN_FALSE(node.op);
+			return false;
+		} else {
+			CODESIGN_EVAL_REQINT_UNKNOWN_SKIPPED(node.op);
+			return eval(plan, node.args[0]);
 		}
-		// unrecognized opcode and no way to interpret it
-		secinfo("csinterp", "opcode 0x%x cannot be handled; aborting", op);
-		MacOSError::throwMe(errSecCSUnimplemented);
 	}
 }
 
@@ -260,8 +490,8 @@ bool Requirement::Interpreter::certFieldValue(const string &key, const Match &ma
 	// DN-component single-value match
 	for (const CertField *cf = certFields; cf->name; cf++)
 		if (cf->name == key) {
-			CFRef<CFStringRef> value;
-            OSStatus rc = SecCertificateCopySubjectComponent(cert, cf->oid, &value.aref());
+			CFStringRef value;
+            OSStatus rc = mFacts.subjectComponent(cert, *cf->oid, value);
 			if (rc) {
 				secinfo("csinterp", "cert %p lookup for DN.%s failed rc=%d", cert, key.c_str(), (int)rc);
 				return false;
@@ -271,8 +501,8 @@ bool Requirement::Interpreter::certFieldValue(const string &key, const Match &ma
 
 	// email multi-valued match (any of...)
 	if (key == "email") {
-		CFRef<CFArrayRef> value;
-        OSStatus rc = SecCertificateCopyEmailAddresses(cert, &value.aref());
+		CFArrayRef value;
+        OSStatus rc = mFacts.emailAddresses(cert, value);
 		if (rc) {
 			secinfo("csinterp", "cert %p lookup for email failed rc=%d", cert, (int)rc);
 			return false;
@@ -296,7 +526,7 @@ bool Requirement::Interpreter::certFieldGeneric(const string &key, const Match &
 
 bool Requirement::Interpreter::certFieldGeneric(const CssmOid &oid, const Match &match, SecCertificateRef cert)
 {
-	return cert && certificateHasField(cert, oid) && match(kCFBooleanTrue);
+	return cert && mFacts.hasField(cert, oid) && match(kCFBooleanTrue);
 }
 
 bool Requirement::Interpreter::certFieldPolicy(const string &key, const Match &match, SecCertificateRef cert)
@@ -308,7 +538,7 @@ bool Requirement::Interpreter::certFieldPolicy(const string &key, const Match &m
 
 bool Requirement::Interpreter::certFieldPolicy(const CssmOid &oid, const Match &match, SecCertificateRef cert)
 {
-	return cert && certificateHasPolicy(cert, oid) && match(kCFBooleanTrue);
+	return cert && mFacts.hasPolicy(cert, oid) && match(kCFBooleanTrue);
 }
 #endif
 
@@ -318,7 +548,7 @@ bool Requirement::Interpreter::certFieldPolicy(const CssmOid &oid, const Match &
 bool Requirement::Interpreter::appleAnchored()
 {
 	if (SecCertificateRef cert = mContext->cert(anchorCert))
-		if (isAppleCA(cert))
+		if (mFacts.isAppleCA(cert))
 		return true;
 	return false;
 }
@@ -418,19 +648,10 @@ bool Requirement::Interpreter::appleSigned()
 //
 bool Requirement::Interpreter::verifyAnchor(SecCertificateRef cert, const unsigned char *digest)
 {
-	// get certificate bytes
 	if (cert) {
-        SHA1 hasher;
-#if TARGET_OS_OSX
-		CSSM_DATA certData;
-		MacOSError::check(SecCertificateGetData(cert, &certData));
-		
-		// verify hash
-		hasher(certData.Data, certData.Length);
-#else
-        hasher(SecCertificateGetBytePtr(cert), SecCertificateGetLength(cert));
-#endif
-		return hasher.verify(digest);
+		SHA1::Digest certDigest;
+		mFacts.hash(cert, certDigest);
+		return memcmp(certDigest, digest, SHA1::digestLength) == 0;
 	}
 	return false;
 }
@@ -489,10 +710,16 @@ SecTrustSettingsResult Requirement::Interpreter::trustSetting(SecCertificateRef
 {
     // XXX: Not supported on embedded yet due to lack of supporting API
 #if TARGET_OS_OSX
-	// the SPI input is the uppercase hex form of the SHA-1 of the certificate...
+	// a chain's trust settings don't change during one validation
 	assert(cert);
+	std::pair<SecCertificateRef, bool> settingKey(cert, isAnchor);
+	std::map<std::pair<SecCertificateRef, bool>, SecTrustSettingsResult>::const_iterator it = mTrustSettings.find(settingKey);
+	if (it != mTrustSettings.end())
+		return it->second;
+
+	// the SPI input is the uppercase hex form of the SHA-1 of the certificate...
 	SHA1::Digest digest;
-	hashOfCertificate(cert, digest);
+	mFacts.hash(cert, digest);
 	string Certhex = CssmData(digest, sizeof(digest)).toHex();
 	for (string::iterator it = Certhex.begin(); it != Certhex.end(); ++it)
 		if (islower(*it))
@@ -518,10 +745,10 @@ SecTrustSettingsResult Requirement::Interpreter::trustSetting(SecCertificateRef
 		)) {
 	case errSecSuccess:
 		::free(errors);
-		if (foundMatch)
-			return result;
-		else
-			return kSecTrustSettingsResultUnspecified;
+		if (!foundMatch)
+			result = kSecTrustSettingsResultUnspecified;
+		mTrustSettings[settingKey] = result;
+		return result;
 	default:
 		::free(errors);
 		MacOSError::throwMe(rc);
@@ -533,11 +760,11 @@ SecTrustSettingsResult Requirement::Interpreter::trustSetting(SecCertificateRef
 
 
 //
-// Create a Match object from the interpreter stream
+// Create a Match object from the requirement stream
 //
-Requirement::Interpreter::Match::Match(Interpreter &interp)
+Requirement::Interpreter::Match::Match(Reader &reader)
 {
-	switch (mOp = interp.get<MatchOperation>()) {
+	switch (mOp = reader.get<MatchOperation>()) {
 	case matchExists:
 		break;
 	case matchEqual:
@@ -548,12 +775,12 @@ Requirement::Interpreter::Match::Match(Interpreter &interp)
 	case matchGreaterThan:
 	case matchLessEqual:
 	case matchGreaterEqual:
-		mValue.take(makeCFString(interp.getString()));
+		mValue.take(makeCFString(reader.getString()));
 		break;
 	default:
 		// Assume this (unknown) match type has a single data argument.
 		// This gives us a chance to keep the instruction stream aligned.
-		interp.getString();			// discard
+		reader.getString();			// discard
 		break;
 	}
 }
@@ -28,7 +28,11 @@
 #define _H_REQINTERP
 
 #include "reqreader.h"
+#include "csutilities.h"
 #include <Security/SecTrustSettings.h>
+#include <security_utilities/refcount.h>
+#include <map>
+#include <vector>
 
 #if TARGET_OS_OSX
 #include <security_cdsa_utilities/cssmdata.h>	// CssmOid
@@ -40,20 +44,30 @@ namespace CodeSigning {
 
 //
 // An interpreter for exprForm-type requirements.
-// This is a simple Polish Notation stack evaluator.
+// The requirement's Polish Notation program is lowered once into a Plan (a flat
+// node array with operands decoded and and/or chains flattened, cheapest operand
+// first), which is cached process-wide and evaluated with short-circuiting.
+// An operand that fails with an error still fails the whole requirement, as it
+// did when every operand was evaluated: short-circuiting may only turn an error
+// into a "no", never into a "yes".
+// Certificate facts come from the Context's CertificateFacts if it has one (so
+// they are shared with the rest of the validation), else from a private memo.
 //	
 class Requirement::Interpreter : public Requirement::Reader {	
 public:
-	Interpreter(const Requirement *req, const Context *ctx)	: Reader(req), mContext(ctx) { }
+	Interpreter(const Requirement *req, const Context *ctx)
+		: Reader(req), mContext(ctx), mFacts(ctx->certFacts ? *ctx->certFacts : mOwnFacts) { }
 	
 	static const unsigned stackLimit = 1000;
 	
 	bool evaluate();
 	
+	class Plan;						// compiled form of a requirement
+	
 protected:
 	class Match {
 	public:
-		Match(Interpreter &interp);		// reads match postfix from interp
+		Match(Reader &reader);			// reads match postfix from reader
 		Match(CFStringRef value, MatchOperation op) : mValue(value), mOp(op) { } // explicit
 		Match() : mValue(NULL), mOp(matchExists) { } // explict test for presence
 		bool operator () (CFTypeRef candidate) const; // match to candidate
@@ -67,7 +81,8 @@ protected:
 	};
 	
 protected:
-	bool eval(int depth);
+	bool eval(const Plan &plan, unsigned node);
+	void raiseErrors(const Plan &plan, unsigned node);
 	
 	bool infoKeyValue(const std::string &key, const Match &match);
 	bool entitlementValue(const std::string &key, const Match &match);
@@ -85,12 +100,17 @@ protected:
 	bool trustedCerts();
 	bool trustedCert(int slot);
 	
-	static SecTrustSettingsResult trustSetting(SecCertificateRef cert, bool isAnchor);
+	SecTrustSettingsResult trustSetting(SecCertificateRef cert, bool isAnchor);
 	
 private:
     CFArrayRef getAdditionalTrustedAnchors();
     bool appleLocalAnchored();
 	const Context * const mContext;
+
+	CertificateFacts mOwnFacts;		// used if the context doesn't bring its own
+	CertificateFacts &mFacts;
+	std::map<std::pair<SecCertificateRef, bool>, SecTrustSettingsResult> mTrustSettings;
+	std::vector<bool> mEvaluated;	// plan nodes evaluated so far by evaluate()
 };
 
 
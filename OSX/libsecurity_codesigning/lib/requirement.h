@@ -39,6 +39,9 @@ namespace Security {
 namespace CodeSigning {
 
 
+class CertificateFacts;
+
+
 //
 // Single requirement.
 // This is a contiguous binary blob, starting with this header
@@ -100,13 +103,14 @@ private:
 class Requirement::Context {
 protected:
 	Context()
-		: certs(NULL), info(NULL), entitlements(NULL), identifier(""), directory(NULL), packageChecksum(NULL), packageAlgorithm(kSecCodeSignatureNoHash), forcePlatform(false) { }
+		: certs(NULL), info(NULL), entitlements(NULL), identifier(""), directory(NULL), packageChecksum(NULL), packageAlgorithm(kSecCodeSignatureNoHash), forcePlatform(false), certFacts(NULL) { }
 
 public:
 	Context(CFArrayRef certChain, CFDictionaryRef infoDict, CFDictionaryRef entitlementDict, const std::string &ident,
-			const CodeDirectory *dir, CFDataRef packageChecksum, SecCSDigestAlgorithm packageAlgorithm, bool force_platform)
+			const CodeDirectory *dir, CFDataRef packageChecksum, SecCSDigestAlgorithm packageAlgorithm, bool force_platform,
+			CertificateFacts *facts = NULL)
 		: certs(certChain), info(infoDict), entitlements(entitlementDict), identifier(ident), directory(dir),
-			packageChecksum(packageChecksum), packageAlgorithm(packageAlgorithm), forcePlatform(force_platform)  { }
+			packageChecksum(packageChecksum), packageAlgorithm(packageAlgorithm), forcePlatform(force_platform), certFacts(facts)  { }
 
 	CFArrayRef certs;								// certificate chain
 	CFDictionaryRef info;							// Info.plist
@@ -116,6 +120,7 @@ public:
 	CFDataRef packageChecksum;					// package checksum
 	SecCSDigestAlgorithm packageAlgorithm; 		// package checksum algorithm
 	bool forcePlatform;
+	CertificateFacts *certFacts;					// memo of certs' facts shared with the caller (optional)
 
 	SecCertificateRef cert(int ix) const;			// get a cert from the cert chain (NULL if not found)
 	unsigned int certCount() const;				// length of cert chain (including root)
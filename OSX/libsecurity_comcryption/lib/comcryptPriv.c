@@ -102,6 +102,24 @@ int keynybble(
     return(j & 0xf);
 }
 
+/*
+ * Expand cpriv->key into the nybble sequence walked by keynybble().
+ * A zero-length key yields a single zero nybble.
+ */
+void expandKeyNybbles(comcryptPriv *cpriv)
+{
+	unsigned i;
+
+	cpriv->numKeyNybbles = 2 * cpriv->keybytes;
+	for(i=0; i<cpriv->numKeyNybbles; i++) {
+		cpriv->keyNybbles[i] = keynybble(cpriv->key, cpriv->keybytes, i);
+	}
+	if(cpriv->numKeyNybbles == 0) {
+		cpriv->keyNybbles[0] = 0;
+		cpriv->numKeyNybbles = 1;
+	}
+}
+
 /*
  * Hash a key array.
  */
@@ -178,6 +196,7 @@ void initCodeBufs(
 	unsigned char khash = (unsigned char)keyHash(key, keyLen);
 
 	cbuf->nybbleDex = khash;
+	cbuf->nybblePos = keyLen ? (khash % (2 * keyLen)) : 0;
 
 	if(laEnable) {
 		memset(cbuf->lookAhead, 0, LOOKAHEAD_SIZE);
@@ -453,13 +472,18 @@ void sigMunge(comcryptBuf *cbuf,
 	unsigned char *byteCodePtr,
 	unsigned char *longCodePtr)
 {
-	unsigned char tokenBit = 0x01;
+	unsigned numTokenBytes = TOKEN_BYTES_FROM_TOKEN_BITS(numTokens);
+	unsigned tokenWord = 0;
 	unsigned token;
 	unsigned short sig;
 
 	for(token=0; token<numTokens; token++) {
+		if((token % TOKEN_WORD_BITS) == 0) {
+			tokenWord = loadTokenWord(tokenPtr + (token >> 3),
+				numTokenBytes - (token >> 3));
+		}
 		sig = cbuf->sigArray[token];
-		if(*tokenPtr & tokenBit) {
+		if(tokenWord & 1) {
 			/* no match - munge longCode - written MSB first */
 			*longCodePtr++ ^= (unsigned char)(sig >> 8);
 			*longCodePtr++ ^= (unsigned char)sig;
@@ -468,11 +492,7 @@ void sigMunge(comcryptBuf *cbuf,
 			/* match - munge byteCode */
 			*byteCodePtr++ ^= (unsigned char)sig;
 		}
-		tokenBit <<= 1;
-		if(tokenBit == 0) {
-			tokenBit = 0x01;
-			tokenPtr++;
-		}
+		tokenWord >>= 1;
 	}
 }
 
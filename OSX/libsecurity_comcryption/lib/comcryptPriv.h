@@ -85,6 +85,7 @@ typedef unsigned queueElt;
 typedef struct _comcryptBuf {
 	queueElt 					*queue;			// mallocd, QLEN elements
 	unsigned					nybbleDex;		// index for keynybble()
+	unsigned					nybblePos;		// nybbleDex % numKeyNybbles
 	struct _comcryptBuf			*nextBuf;		// for recursion
 
 	/*
@@ -132,6 +133,13 @@ typedef struct _comcryptBuf {
 typedef struct {
 	unsigned char 			*key;
 	unsigned 				keybytes;			// valid bytes in *key
+
+	/*
+	 * The key expanded into the nybble sequence keynybble() walks, so the
+	 * block loops can step through it without a divide per code word.
+	 */
+	unsigned char			keyNybbles[2 * COMCRYPT_MAX_KEYLENGTH];
+	unsigned				numKeyNybbles;		// valid entries in keyNybbles
 	comcryptOptimize 		optimize;			// CCO_SIZE, etc.
 	unsigned char 			*map;
 	unsigned char 			*invmap;
@@ -315,6 +323,7 @@ extern int keynybble(
 	const unsigned char *key,
 	int 				keybytes,
 	int 				index);
+extern void expandKeyNybbles(comcryptPriv *cpriv);
 extern void mallocCodeBufs(comcryptBuf *cbufs);
 extern void freeCodeBufs(comcryptBuf *cbufs);
 extern void initCodeBufs(
@@ -456,6 +465,71 @@ static inline void nextSigWord(comcryptBuf *cbuf,
 #define updateToken(tokenPtr, tokenDex, tokenBit) 	\
 	MARK_BIT_ARRAY(tokenPtr, tokenDex, tokenBit)
 
+/*
+ * The block loops move token bits between the ciphertext and a register
+ * 32 at a time rather than addressing each bit in memory. Bytes are
+ * assembled explicitly, so this is independent of alignment and byte order;
+ * numBytes is what's left of the token array and may be less than 4.
+ */
+#define TOKEN_WORD_BITS		32
+
+static inline unsigned loadTokenWord(
+	const unsigned char *tokenPtr,
+	unsigned numBytes)
+{
+	unsigned word = 0;
+	unsigned shift;
+
+	if(numBytes > (TOKEN_WORD_BITS / 8)) {
+		numBytes = TOKEN_WORD_BITS / 8;
+	}
+	for(shift = 0; numBytes != 0; numBytes--, shift += 8) {
+		word |= (unsigned)(*tokenPtr++) << shift;
+	}
+	return word;
+}
+
+static inline void storeTokenWord(
+	unsigned char *tokenPtr,
+	unsigned word,
+	unsigned numBytes)
+{
+	if(numBytes > (TOKEN_WORD_BITS / 8)) {
+		numBytes = TOKEN_WORD_BITS / 8;
+	}
+	for(; numBytes != 0; numBytes--, word >>= 8) {
+		*tokenPtr++ = (unsigned char)word;
+	}
+}
+
+/*
+ * Step cbuf's key nybble index, and return the key nybble at the old index;
+ * same as keynybble(cpriv->key, cpriv->keybytes, (cbuf->nybbleDex)++).
+ * nybblePos tracks nybbleDex modulo the nybble count, including when
+ * nybbleDex wraps.
+ */
+static inline void skipKeyNybble(
+	const comcryptPriv *cpriv,
+	comcryptBuf *cbuf)
+{
+	if(++cbuf->nybblePos == cpriv->numKeyNybbles) {
+		cbuf->nybblePos = 0;
+	}
+	if(++cbuf->nybbleDex == 0) {
+		cbuf->nybblePos = 0;
+	}
+}
+
+static inline unsigned char nextKeyNybble(
+	const comcryptPriv *cpriv,
+	comcryptBuf *cbuf)
+{
+	unsigned char nybble = cpriv->keyNybbles[cbuf->nybblePos];
+
+	skipKeyNybble(cpriv, cbuf);
+	return nybble;
+}
+
 /*
  * Macros for accessing lookahead array elements
  */
@@ -135,6 +135,7 @@ comcryptReturn comcryptInit(
 	}
 	memmove(cpriv->key, key, keyLen);
 	cpriv->keybytes = keyLen;
+	expandKeyNybbles(cpriv);
 	cpriv->cbuf.codeBufLength = 0;
 	cpriv->cbuf.nextBuf->codeBufLength = 0;
 	cpriv->version = 0;
@@ -410,6 +411,7 @@ static comcryptReturn comcryptBlock(
 	unsigned		match;
 	unsigned		jmatch=0;
 	unsigned		tokenDex = 0;		// index into array of token bits
+	unsigned		tokenWord = 0;		// token bits not yet stored
 	unsigned		j;
 	unsigned		numLongCodes = 0;
 	unsigned		numByteCodes = 0;
@@ -581,8 +583,7 @@ static comcryptReturn comcryptBlock(
 		 * sequence update
 		 */
 #if		!SKIP_NIBBLE_ON_QUEUE_0
-		nibble = keynybble(cpriv->key, cpriv->keybytes,
-						(cbuf->nybbleDex)++);
+		nibble = nextKeyNybble(cpriv, cbuf);
 #endif	/*SKIP_NIBBLE_ON_QUEUE_0*/
 
 		COMPROF_START;
@@ -598,13 +599,13 @@ static comcryptReturn comcryptBlock(
 				above = 0;
 				laprintf(("...queue hit at queue[0]\n"));
 #if		SKIP_NIBBLE_ON_QUEUE_0
-				nibble = (cbuf->nybbleDex)++;
+				nibble = cbuf->nybbleDex;
+				skipKeyNybble(cpriv, cbuf);
 #endif	/*SKIP_NIBBLE_ON_QUEUE_0*/
 			}
 			else {
 #if		SKIP_NIBBLE_ON_QUEUE_0
-				nibble = keynybble(cpriv->key, cpriv->keybytes,
-								(cbuf->nybbleDex)++);
+				nibble = nextKeyNybble(cpriv, cbuf);
 #endif	/*SKIP_NIBBLE_ON_QUEUE_0*/
 
 				above = (cbuf->f1 * jmatch * (16 + nibble)) >> 9;
@@ -656,8 +657,7 @@ static comcryptReturn comcryptBlock(
 			 * the queue or not.
 			 */
 #if		SKIP_NIBBLE_ON_QUEUE_0
-			nibble = keynybble(cpriv->key, cpriv->keybytes,
-							(cbuf->nybbleDex)++);
+			nibble = nextKeyNybble(cpriv, cbuf);
 #endif	/*SKIP_NIBBLE_ON_QUEUE_0*/
 
 			above = ABOVE(cbuf->f2) + nibble;
@@ -712,12 +712,20 @@ static comcryptReturn comcryptBlock(
 			 */
 			above = 0;
 #if		SKIP_NIBBLE_ON_QUEUE_0
-			nibble = (cbuf->nybbleDex)++;
+			nibble = cbuf->nybbleDex;
+			skipKeyNybble(cpriv, cbuf);
 #endif	/*SKIP_NIBBLE_ON_QUEUE_0*/
 		}
 
-		updateToken(tokenPtr, tokenDex, !match);
+		if(!match) {
+			tokenWord |= 1U << (tokenDex % TOKEN_WORD_BITS);
+		}
 		tokenDex++;
+		if((tokenDex % TOKEN_WORD_BITS) == 0) {
+			storeTokenWord(tokenPtr + ((tokenDex - TOKEN_WORD_BITS) >> 3),
+				tokenWord, TOKEN_WORD_BITS / 8);
+			tokenWord = 0;
+		}
 
 		if(match) {
 			*byteCodePtr++ = codeWord & 0xff;
@@ -733,6 +741,11 @@ static comcryptReturn comcryptBlock(
 		}
 	}
 
+	if(tokenDex % TOKEN_WORD_BITS) {
+		storeTokenWord(tokenPtr + ((tokenDex - (tokenDex % TOKEN_WORD_BITS)) >> 3),
+			tokenWord, TOKEN_BYTES_FROM_TOKEN_BITS(tokenDex % TOKEN_WORD_BITS));
+	}
+
 #if		COM_DEBUG
 	if(numTokenBytes != ((tokenDex + 7) >> 3)) {
 		ddprintf(("comcryptBlock: numTokenBytes (%d), tokenDex (%d)\n",
@@ -958,6 +971,7 @@ static dcbReturn deComcryptBlock(
 	unsigned char		*byteCodePtr;
 	unsigned			numByteCodes;
 	unsigned			tokenDex;
+	unsigned			tokenWord = 0;			// token bits not yet examined
 	unsigned			oddByte = 0;
 	unsigned short		codeWord;
 	unsigned char		codeByte;
@@ -1090,13 +1104,17 @@ static dcbReturn deComcryptBlock(
 	sigSeq = cpriv->sigSeqEnable && !level2;
 
 	for(tokenDex=0; tokenDex<numTokenBits; tokenDex++) {
-		match = !getToken(tokenPtr, tokenDex);
+		if((tokenDex % TOKEN_WORD_BITS) == 0) {
+			tokenWord = loadTokenWord(tokenPtr + (tokenDex >> 3),
+				numTokenBytes - (tokenDex >> 3));
+		}
+		match = !(tokenWord & 1);
+		tokenWord >>= 1;
 
 		/*
 		 * 17 Dec 1997 - Always calculate this regardless of match
 		 */
-		nibble = keynybble(cpriv->key, cpriv->keybytes,
-						  	 (cbuf->nybbleDex)++);
+		nibble = nextKeyNybble(cpriv, cbuf);
 
 		if(match) {
 			codeByte = *byteCodePtr++;
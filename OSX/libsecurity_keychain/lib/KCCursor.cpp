@@ -38,6 +38,9 @@
 #include <SecBase.h>
 #include <Security/SecBasePriv.h>
 #include <utilities/array_size.h>
+#include <dispatch/dispatch.h>
+#include <deque>
+#include <exception>
 
 using namespace KeychainCore;
 using namespace CssmClient;
@@ -45,6 +48,171 @@ using namespace CSSMDateTimeUtils;
 
 using namespace KeySchema;
 
+
+//
+// A keychain's search as set up by the prefetch: opened, queried, and holding
+// the first result (if any) until next() gets to it.
+//
+struct KCCursorImpl::PrefetchedSearch
+{
+	PrefetchedSearch() : opened(false), failed(false), gotRecord(false), status(errSecSuccess) {}
+
+	DbCursor cursor;
+	DbAttributes attributes;
+	DbUniqueRecord uniqueId;
+	bool opened;				// database activated
+	bool failed;				// first cursor->next threw; status has the error
+	bool gotRecord;
+	OSStatus status;
+	std::exception_ptr error;	// opening threw something other than a CommonError
+};
+
+//
+// Runs every keychain's open and first query on a concurrent queue, so a search
+// over several keychains waits for the slowest of them rather than for their sum.
+// It is shared with the blocks doing the work, so it outlives a cursor that is
+// released early.
+//
+class KCCursorImpl::Prefetch : public RefCount
+{
+	NOCOPY(Prefetch)
+public:
+	Prefetch(size_t count);
+	~Prefetch();
+
+	// Set up a cursor for each keychain and start opening and querying them.
+	// Call once the caller holds a reference, as the work may finish before this returns.
+	void start(const StorageManager::KeychainList &searchList, const CssmQuery &query);
+
+	PrefetchedSearch &search(size_t index) { return mSearches[index]; }
+
+	// Blocks until the next search is available; false once all are taken
+	bool take(size_t &index);
+
+private:
+	void fetch(size_t index, Keychain keychain);
+	void finished(size_t index);
+
+	PrefetchedSearch *mSearches;
+	size_t mCount;
+	size_t mTaken;
+
+	Mutex mReadyLock;
+	std::deque<size_t> mReady;			// indices of completed searches, in completion order
+	dispatch_semaphore_t mReadySemaphore;
+};
+
+KCCursorImpl::Prefetch::Prefetch(size_t count) :
+	mSearches(new PrefetchedSearch[count]),
+	mCount(count),
+	mTaken(0),
+	mReadySemaphore(dispatch_semaphore_create(0))
+{
+}
+
+KCCursorImpl::Prefetch::~Prefetch()
+{
+	delete[] mSearches;
+	dispatch_release(mReadySemaphore);
+}
+
+void KCCursorImpl::Prefetch::start(const StorageManager::KeychainList &searchList, const CssmQuery &query)
+{
+	RefPointer<Prefetch> self = this;
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+	for (size_t index = 0; index < mCount; index++)
+	{
+		Keychain keychain = searchList[index];
+		try
+		{
+			// Setting up the cursor doesn't touch the DL; it copies our query.
+			StLock<Mutex> _(*keychain->getKeychainMutex());
+			mSearches[index].cursor = DbCursor(keychain->database(), query);
+		}
+		catch (const CommonError &)
+		{
+			// leave it unopened, next() will skip it
+			finished(index);
+			continue;
+		}
+		catch (...)
+		{
+			mSearches[index].error = std::current_exception();
+			finished(index);
+			continue;
+		}
+
+		dispatch_async(queue, ^{
+			self->fetch(index, keychain);
+		});
+	}
+}
+
+void KCCursorImpl::Prefetch::fetch(size_t index, Keychain keychain)
+{
+	PrefetchedSearch &search = mSearches[index];
+
+	try
+	{
+		StLock<Mutex> _(*keychain->getKeychainMutex());
+		keychain->database()->activate();
+		search.opened = true;
+
+		try
+		{
+			search.gotRecord = search.cursor->next(&search.attributes, NULL, search.uniqueId);
+		}
+		catch (const CommonError &err)
+		{
+			search.failed = true;
+			search.status = err.osStatus();
+			search.attributes.invalidate();
+		}
+		catch (...)
+		{
+			search.failed = true;
+			search.status = errSecItemNotFound;
+		}
+	}
+	catch (const CommonError &)
+	{
+		// couldn't open this keychain; next() skips it
+	}
+	catch (...)
+	{
+		// next() rethrows this when it gets to this keychain, as it would have
+		// had it opened the keychain itself
+		search.error = std::current_exception();
+	}
+
+	finished(index);
+}
+
+void KCCursorImpl::Prefetch::finished(size_t index)
+{
+	{
+		StLock<Mutex> _(mReadyLock);
+		mReady.push_back(index);
+	}
+	dispatch_semaphore_signal(mReadySemaphore);
+}
+
+bool KCCursorImpl::Prefetch::take(size_t &index)
+{
+	if (mTaken == mCount)
+		return false;
+
+	dispatch_semaphore_wait(mReadySemaphore, DISPATCH_TIME_FOREVER);
+	{
+		StLock<Mutex> _(mReadyLock);
+		index = mReady.front();
+		mReady.pop_front();
+	}
+	mTaken++;
+	return true;
+}
+
 // define a table of our attributes for easy lookup
 static const CSSM_DB_ATTRIBUTE_INFO* gKeyAttributeLookupTable[] =
 {
@@ -61,7 +229,10 @@ KCCursorImpl::KCCursorImpl(const StorageManager::KeychainList &searchList, SecIt
 	mCurrent(mSearchList.begin()),
 	mAllFailed(true),
     mDeleteInvalidRecords(false),
+    mReadAllMatches(false),
     mIsNewKeychain(true),
+    mPrefetchStarted(false),
+    mPrimed(NULL),
 	mMutex(Mutex::recursive)
 {
     recordType(Schema::recordTypeFor(itemClass));
@@ -119,7 +290,10 @@ KCCursorImpl::KCCursorImpl(const StorageManager::KeychainList &searchList, const
 	mCurrent(mSearchList.begin()),
 	mAllFailed(true),
     mDeleteInvalidRecords(false),
+    mReadAllMatches(false),
     mIsNewKeychain(true),
+    mPrefetchStarted(false),
+    mPrimed(NULL),
 	mMutex(Mutex::recursive)
 {
 	if (!attrList) // No additional selectionPredicates: we are done
@@ -186,12 +360,29 @@ KCCursorImpl::next(Item &item)
 	DbUniqueRecord uniqueId;
 	OSStatus status = 0;
 
+	if (!mPrefetchStarted)
+	{
+		mPrefetchStarted = true;
+		if (mReadAllMatches && mSearchList.size() > 1)
+			startPrefetch();
+	}
+
 	for (;;)
 	{
         Item tempItem = NULL;
         {
             while (!mDbCursor)
             {
+                if (mPrefetch)
+                {
+                    if (nextPrefetched())
+                        continue;
+
+                    if (mAllFailed && status)
+                        CssmError::throwMe(status);
+                    return false;
+                }
+
                 // Do the newKeychain dance before we check our done status
                 newKeychain(mCurrent);
 
@@ -228,29 +419,46 @@ KCCursorImpl::next(Item &item)
             StLock<Mutex> _(*mutex);
 
             bool gotRecord;
-            try
-            {
-                // Clear out existing attributes first!
-                // (the previous iteration may have left attributes from a different schema)
-                dbAttributes.clear();
-
-                gotRecord = mDbCursor->next(&dbAttributes, NULL, uniqueId);
-                mAllFailed = false;
-            }
-            catch(const CommonError &err)
+            DbAttributes *attributes = &dbAttributes;
+            if (mPrimed)
             {
-                // Catch the last error we get and move on to the next keychain
-                // This error will be returned when we reach the end of our keychain list
-                // iff all calls to KCCursorImpl::next failed
-                status = err.osStatus();
-                gotRecord = false;
-                dbAttributes.invalidate();
+                // The prefetch already asked for this keychain's first record
+                PrefetchedSearch *primed = mPrimed;
+                mPrimed = NULL;
+                attributes = &primed->attributes;
+                uniqueId = primed->uniqueId;
+                gotRecord = primed->gotRecord;
+                if (primed->failed)
+                    status = primed->status;
+                else
+                    mAllFailed = false;
             }
-            catch(...)
+            else
             {
-                // Catch all other errors
-                status = errSecItemNotFound;
-                gotRecord = false;
+                try
+                {
+                    // Clear out existing attributes first!
+                    // (the previous iteration may have left attributes from a different schema)
+                    dbAttributes.clear();
+
+                    gotRecord = mDbCursor->next(&dbAttributes, NULL, uniqueId);
+                    mAllFailed = false;
+                }
+                catch(const CommonError &err)
+                {
+                    // Catch the last error we get and move on to the next keychain
+                    // This error will be returned when we reach the end of our keychain list
+                    // iff all calls to KCCursorImpl::next failed
+                    status = err.osStatus();
+                    gotRecord = false;
+                    dbAttributes.invalidate();
+                }
+                catch(...)
+                {
+                    // Catch all other errors
+                    status = errSecItemNotFound;
+                    gotRecord = false;
+                }
             }
 
             // If we did not get a record from the current keychain or the current
@@ -267,23 +475,23 @@ KCCursorImpl::next(Item &item)
             }
 
             // If doing a search for all records, skip the db blob added by the CSPDL
-            if (dbAttributes.recordType() == CSSM_DL_DB_RECORD_METADATA &&
+            if (attributes->recordType() == CSSM_DL_DB_RECORD_METADATA &&
                     mDbCursor->recordType() == CSSM_DL_DB_RECORD_ANY)
                 continue;
 
             // Filter out group keys at this layer
-            if (dbAttributes.recordType() == CSSM_DL_DB_RECORD_SYMMETRIC_KEY)
+            if (attributes->recordType() == CSSM_DL_DB_RECORD_SYMMETRIC_KEY)
             {
                 bool groupKey = false;
                 try
                 {
                     // fetch the key label attribute, if it exists
-                    dbAttributes.add(KeySchema::Label);
+                    attributes->add(KeySchema::Label);
                     Db db((*mCurrent)->database());
-                    CSSM_RETURN getattr_result = CSSM_DL_DataGetFromUniqueRecordId(db->handle(), uniqueId, &dbAttributes, NULL);
+                    CSSM_RETURN getattr_result = CSSM_DL_DataGetFromUniqueRecordId(db->handle(), uniqueId, attributes, NULL);
                     if (getattr_result == CSSM_OK)
                     {
-                        CssmDbAttributeData *label = dbAttributes.find(KeySchema::Label);
+                        CssmDbAttributeData *label = attributes->find(KeySchema::Label);
                         CssmData attrData;
                         if (label)
                             attrData = *label;
@@ -292,7 +500,7 @@ KCCursorImpl::next(Item &item)
                     }
                     else
                     {
-                        dbAttributes.invalidate();
+                        attributes->invalidate();
                     }
                 }
                 catch (...) {}
@@ -305,7 +513,7 @@ KCCursorImpl::next(Item &item)
             // Go though Keychain since item might already exist.
             // This might throw a CSSMERR_DL_RECORD_NOT_FOUND or be otherwise invalid. If we're supposed to delete these items, delete them...
             try {
-                tempItem = (*mCurrent)->item(dbAttributes.recordType(), uniqueId);
+                tempItem = (*mCurrent)->item(attributes->recordType(), uniqueId);
             } catch(CssmError cssme) {
                 if (mDeleteInvalidRecords) {
                     // This is an invalid record for some reason; delete it and restart the loop
@@ -361,6 +569,48 @@ void KCCursorImpl::setDeleteInvalidRecords(bool deleteRecord) {
     mDeleteInvalidRecords = deleteRecord;
 }
 
+void KCCursorImpl::setReadAllMatches(bool all) {
+    mReadAllMatches = all;
+}
+
+void KCCursorImpl::startPrefetch() {
+    // The caller is going to reach every keychain, so do their upgrades and
+    // tickles now, serialized and before any keychain is opened, as they would
+    // have happened one at a time.
+    for (StorageManager::KeychainList::iterator it = mSearchList.begin(); it != mSearchList.end(); ++it) {
+        mIsNewKeychain = true;
+        newKeychain(it);
+    }
+
+    mPrefetch = new Prefetch(mSearchList.size());
+    mPrefetch->start(mSearchList, *this);
+}
+
+bool KCCursorImpl::nextPrefetched() {
+    size_t index;
+    while (mPrefetch->take(index)) {
+        PrefetchedSearch &search = mPrefetch->search(index);
+        mCurrent = mSearchList.begin() + index;
+        if (search.error) {
+            std::exception_ptr error = search.error;
+            search.error = nullptr;
+            std::rethrow_exception(error);
+        }
+        if (!search.opened) {
+            // same as failing to activate it ourselves: skip this keychain
+            continue;
+        }
+        mDbCursor = search.cursor;
+        // don't keep the query alive past the point where next() lets go of it
+        search.cursor = DbCursor();
+        mPrimed = &search;
+        return true;
+    }
+
+    mCurrent = mSearchList.end();
+    return false;
+}
+
 void KCCursorImpl::newKeychain(StorageManager::KeychainList::iterator kcIter) {
     if(!mIsNewKeychain) {
         // We've already been called on this keychain, don't bother.
@@ -61,16 +61,32 @@ public:
     // creating items, and try to delete these corrupt records.
     void setDeleteInvalidRecords(bool deleteRecord);
 
+    // Set this to true before the first call to next() if the caller is going to
+    // read every match. A search of more than one keychain then opens and queries
+    // all of them concurrently and returns results from whichever keychain answers
+    // first, rather than in search list order. Otherwise keychains are opened one
+    // at a time, as next() reaches them.
+    void setReadAllMatches(bool all);
+
 private:
 	StorageManager::KeychainList mSearchList;
 	StorageManager::KeychainList::iterator mCurrent;
 	CssmClient::DbCursor mDbCursor;
 	bool mAllFailed;
     bool mDeleteInvalidRecords;
+    bool mReadAllMatches;
 
     // Remembers if we've called newKeychain() on mCurrent.
     bool mIsNewKeychain;
 
+    // Concurrent open and first query of every keychain, if mReadAllMatches
+    class Prefetch;
+    struct PrefetchedSearch;
+    RefPointer<Prefetch> mPrefetch;
+    bool mPrefetchStarted;
+    // Search whose first record was fetched by mPrefetch and not yet looked at
+    PrefetchedSearch *mPrimed;
+
 protected:
 	Mutex mMutex;
 
@@ -81,6 +97,11 @@ protected:
     // Handles the end iterator.
     void newKeychain(StorageManager::KeychainList::iterator kcIter);
 
+    // Kick off mPrefetch, and take its searches as they become available.
+    // nextPrefetched() sets mCurrent, mDbCursor and mPrimed; returns false when all are taken.
+    void startPrefetch();
+    bool nextPrefetched();
+
     // Try to delete a record. Silently swallow any RECORD_NOT_FOUND exceptions,
     // but throw others upward.
     void deleteInvalidRecord(DbUniqueRecord& uniqueId);
@@ -37,6 +37,7 @@
 #include "SecKeychainPriv.h"
 #include "SecCertificatePriv.h"
 #include "TrustAdditions.h"
+#include "KCCursor.h"
 #include "TrustSettingsSchema.h"
 #include <Security/SecTrustPriv.h>
 #include "utilities/array_size.h"
@@ -3222,6 +3223,10 @@ _CreateSecItemParamsFromDictionary(CFDictionaryRef dict, OSStatus *error)
 				itemParams->itemClass,
 				(itemParams->attrList->count == 0) ? NULL : itemParams->attrList,
 				(SecKeychainSearchRef*)&itemParams->search);
+		if (status == errSecSuccess && itemParams->returnAllMatches) {
+			// every match is wanted, so take them from whichever keychain answers first
+			KCCursorImpl::required((SecKeychainSearchRef)itemParams->search)->setReadAllMatches(true);
+		}
 	}
 
 error_exit:
@@ -3562,6 +3567,9 @@ UpdateKeychainSearchAndCopyNext(SecItemParams *params, CFTypeRef *item)
 			params->itemClass,
 			(params->attrList->count == 0) ? NULL : params->attrList,
 			(SecKeychainSearchRef*)&params->search) == errSecSuccess) {
+			if (params->returnAllMatches) {
+				KCCursorImpl::required((SecKeychainSearchRef)params->search)->setReadAllMatches(true);
+			}
 			// Return the first matching item from the new search.
 			// We won't come back here again until there are no more matching items for this search.
 			status = SecKeychainSearchCopyNext((SecKeychainSearchRef)params->search, (SecKeychainItemRef*)item);
@@ -23,6 +23,8 @@
 
 #include <CoreFoundation/CoreFoundation.h>
 #include <CommonCrypto/CommonDigest.h>
+#include <dispatch/dispatch.h>
+#include <vector>
 
 #include <Security/Security.h>
 #include <security_utilities/security_utilities.h>
@@ -361,6 +363,43 @@ void Download::FinalizeDigestAndCompare ()
 
 
 
+// below this many whole sectors in one buffer, hashing them in parallel isn't worth the handoff
+static const CFIndex kMinParallelSectors = 4;
+
+void Download::DigestSectorsAndCompare (const UInt8* sectors, CFIndex numSectors)
+{
+	// each whole sector has its own digest in the ticket, so the sectors can be
+	// hashed side by side; only hash the ones we have digests for
+	CFIndex available = mNumHashes - mCurrentHash;
+	CFIndex numToHash = numSectors < available ? numSectors : available;
+	std::vector<char> matched (numToHash);
+	
+	char* results = numToHash ? &matched[0] : NULL;
+	const Sha256Digest* expected = mDigests + mCurrentHash;
+	size_t sectorSize = mSectorSize;
+	dispatch_apply (numToHash, dispatch_get_global_queue (DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+		^(size_t i) {
+			Sha256Digest digest;
+			CC_SHA256 (sectors + i * sectorSize, (CC_LONG) sectorSize, digest);
+			results[i] = memcmp (digest, expected[i], CC_SHA256_DIGEST_LENGTH) == 0;
+		});
+	
+	// report in sector order, exactly as FinalizeDigestAndCompare would have
+	for (CFIndex i = 0; i < numSectors; ++i)
+	{
+		// make sure we don't overflow the digest buffer
+		if (i >= numToHash || !results[i])
+		{
+			// Something's really wrong!
+			MacOSError::throwMe (errSecureDownloadInvalidDownload);
+		}
+		
+		mCurrentHash++;
+	}
+}
+
+
+
 void Download::UpdateWithData (CFDataRef data)
 {
 	// figure out how much data to hash
@@ -369,6 +408,17 @@ void Download::UpdateWithData (CFDataRef data)
 	
 	while (dataLength > 0)
 	{
+		// at a sector boundary, hand off a run of whole sectors in one go
+		if (mBytesInCurrentDigest == 0 && mSectorSize > 0 && dataLength / mSectorSize >= kMinParallelSectors)
+		{
+			CFIndex numSectors = dataLength / mSectorSize;
+			DigestSectorsAndCompare (finger, numSectors);
+			
+			finger += numSectors * mSectorSize;
+			dataLength -= numSectors * mSectorSize;
+			continue;
+		}
+		
 		// figure out how many bytes are left to hash
 		size_t bytesLeftToHash = mSectorSize - mBytesInCurrentDigest;
 		size_t bytesToHash = MinSizeT (bytesLeftToHash, dataLength);
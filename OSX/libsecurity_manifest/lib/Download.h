@@ -64,6 +64,7 @@ protected:
 	void ParseTicket (CFDataRef ticket);
 	SecPolicyRef GetPolicy ();
 	void FinalizeDigestAndCompare ();
+	void DigestSectorsAndCompare (const UInt8* sectors, CFIndex numSectors);
 	void GoOrNoGo (SecTrustResultType result);
 	
 public:
@@ -28,6 +28,7 @@
 #include <security_utilities/logging.h>
 #include <security_utilities/debugging.h>
 #include <security_utilities/cfutilities.h>
+#include <security_utilities/hashing.h>
 #include <security_cdsa_client/dlquery.h>
 #include <securityd_client/ssclient.h>
 #include <Security/mds_schema.h>
@@ -40,6 +41,9 @@
 #include <assert.h>
 #include <time.h>
 #include <string>
+#include <map>
+#include <set>
+#include <algorithm>
 #include <unistd.h>
 #include <syslog.h>
 
@@ -100,6 +104,7 @@ namespace Security
 #define MDS_INSTALL_LOCK_NAME	"mds.install.lock"	
 #define MDS_OBJECT_DB_NAME		"mdsObject.db"
 #define MDS_DIRECT_DB_NAME		"mdsDirectory.db"
+#define MDS_SCAN_MANIFEST_NAME	"mdsScan.manifest"
 
 #define MDS_INSTALL_LOCK_PATH	MDS_SYSTEM_DB_DIR "/" MDS_INSTALL_LOCK_NAME
 #define MDS_OBJECT_DB_PATH		MDS_SYSTEM_DB_DIR "/" MDS_OBJECT_DB_NAME
@@ -864,6 +869,431 @@ static bool checkUserBundles(
 	return rtn;
 }
 
+/*
+ * Record of what the last full plugin scan saw: the two DB files it left behind,
+ * the bundle directories it walked and every bundle found in them, by device,
+ * inode and modification time, plus a digest of each bundle's MDS info.
+ *
+ * If none of that has changed since, the DBs are known to be up to date and the
+ * scan - an object DB walk, a query and a stat per plugin, and a parse of any
+ * bundle that looks new - can be skipped altogether. The manifest lives next to
+ * the DBs it describes and is only read or written under the DB lock.
+ *
+ * File format, one entry per line, path last since it may contain spaces:
+ *
+ *    mdsscan <version>
+ *    <kind> <dev> <ino> <mtime sec> <mtime nsec> <digest or -> <path>
+ *    end
+ *
+ * where kind is 'D' for a DB file, 'R' for a bundle directory (inode 0 if it
+ * did not exist), 'B' for a bundle and 'P' for a registered plugin that isn't
+ * one of those bundles (e.g. one added via installFile()). The scan would stat
+ * a 'P' plugin to see if it's outdated, so any change to one forces a rescan.
+ */
+#define MDS_SCAN_MANIFEST_VERSION	2
+
+class ScanManifest
+{
+public:
+	ScanManifest(
+		const std::string &dbDir,
+		const std::vector<std::string> &bundleDirs);
+
+	/* true if nothing recorded by the last scan has changed */
+	bool isCurrent();
+
+	/* call before and after a full scan, respectively */
+	void snapshotBundles();
+	void write();
+
+	/* plugins still registered after the scan's removeOutdatedPlugins() */
+	void notePluginPaths(const std::vector<std::string> &pluginPaths);
+
+private:
+	struct Entry {
+		char			kind;
+		dev_t			dev;
+		ino_t			ino;
+		struct timespec	mtime;
+		std::string		digest;
+		std::string		path;
+	};
+	typedef std::vector<Entry> EntryVector;
+
+	bool load(EntryVector &entries);
+	static bool statEntry(char kind, const std::string &path, Entry &entry);
+	static bool sameFile(const Entry &a, const Entry &b);
+	static std::string bundleDigest(const std::string &bundlePath);
+
+	std::string mPath;
+	std::string mDbDir;
+	std::vector<std::string> mBundleDirs;
+	EntryVector mRecorded;			// as last loaded from disk
+	EntryVector mBundles;			// snapshotBundles() result
+	EntryVector mPlugins;			// notePluginPaths() result
+};
+
+ScanManifest::ScanManifest(
+	const std::string &dbDir,
+	const std::vector<std::string> &bundleDirs) :
+		mPath(dbDir + "/" MDS_SCAN_MANIFEST_NAME),
+		mDbDir(dbDir),
+		mBundleDirs(bundleDirs)
+{
+}
+
+bool ScanManifest::statEntry(
+	char kind,
+	const std::string &path,
+	Entry &entry)
+{
+	struct stat sb;
+
+	entry.kind = kind;
+	entry.path = path;
+	entry.digest.clear();
+	MSIoDbg("stat %s in ScanManifest", path.c_str());
+	if(::stat(path.c_str(), &sb)) {
+		entry.dev = 0;
+		entry.ino = 0;
+		entry.mtime.tv_sec = 0;
+		entry.mtime.tv_nsec = 0;
+		return false;
+	}
+	entry.dev = sb.st_dev;
+	entry.ino = sb.st_ino;
+	entry.mtime = sb.st_mtimespec;
+	return true;
+}
+
+bool ScanManifest::sameFile(
+	const Entry &a,
+	const Entry &b)
+{
+	return (a.dev == b.dev) && (a.ino == b.ino) &&
+		(a.mtime.tv_sec == b.mtime.tv_sec) &&
+		(a.mtime.tv_nsec == b.mtime.tv_nsec);
+}
+
+/*
+ * SHA-1 over the names and contents of the files MDSAttrParser consumes from
+ * a bundle: its Info.plist and its top-level *.mdsinfo resources. Returns an
+ * empty string if the bundle can't be read.
+ */
+std::string ScanManifest::bundleDigest(
+	const std::string &bundlePath)
+{
+	std::vector<std::string> files;
+	files.push_back("Contents/Info.plist");
+
+	std::string resources = bundlePath + "/Contents/Resources";
+	if(DIR *dir = opendir(resources.c_str())) {
+		static const char suffix[] = "." MDS_INFO_TYPE;
+		const size_t suffixLen = sizeof(suffix) - 1;
+		struct dirent *dp;
+		while((dp = readdir(dir)) != NULL) {
+			size_t len = strlen(dp->d_name);
+			if((len > suffixLen) && !strcmp(dp->d_name + len - suffixLen, suffix)) {
+				files.push_back(std::string("Contents/Resources/") + dp->d_name);
+			}
+		}
+		closedir(dir);
+	}
+	/* readdir order is not stable across rewrites of the directory */
+	std::sort(files.begin() + 1, files.end());
+
+	SHA1 hash;
+	char buf[4096];
+	for(std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it) {
+		std::string path = bundlePath + "/" + *it;
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) {
+			if(it == files.begin()) {
+				/* no Info.plist; nothing worth remembering */
+				return std::string();
+			}
+			continue;
+		}
+		hash.update(it->c_str(), it->size() + 1);
+		ssize_t thisRead;
+		while((thisRead = read(fd, buf, sizeof(buf))) > 0) {
+			hash.update(buf, thisRead);
+		}
+		close(fd);
+		if(thisRead < 0) {
+			return std::string();
+		}
+	}
+
+	SHA1::Digest digest;
+	hash.finish(digest);
+	std::string hex;
+	for(size_t dex = 0; dex < SHA1::digestLength; dex++) {
+		char byte[3];
+		snprintf(byte, sizeof(byte), "%02x", digest[dex]);
+		hex += byte;
+	}
+	return hex;
+}
+
+bool ScanManifest::load(
+	EntryVector &entries)
+{
+	FILE *file = fopen(mPath.c_str(), "r");
+	if(file == NULL) {
+		MSDebug("no scan manifest at %s", mPath.c_str());
+		return false;
+	}
+
+	bool complete = false;
+	char line[MAXPATHLEN + 128];
+	int version = 0;
+	if(fgets(line, sizeof(line), file) == NULL ||
+	   sscanf(line, "mdsscan %d", &version) != 1 ||
+	   version != MDS_SCAN_MANIFEST_VERSION) {
+		MSDebug("scan manifest %s has unknown format", mPath.c_str());
+		fclose(file);
+		return false;
+	}
+	while(fgets(line, sizeof(line), file) != NULL) {
+		size_t len = strlen(line);
+		if(len == 0 || line[len - 1] != '\n') {
+			/* truncated or overlong */
+			break;
+		}
+		line[len - 1] = '\0';
+		if(!strcmp(line, "end")) {
+			complete = true;
+			break;
+		}
+
+		Entry entry;
+		char kind;
+		unsigned long long dev, ino;
+		long long sec;
+		long nsec;
+		char digest[2 * SHA1::digestLength + 1];
+		int pathOffset = 0;
+		if(sscanf(line, "%c %llu %llu %lld %ld %40s %n",
+				&kind, &dev, &ino, &sec, &nsec, digest, &pathOffset) != 6 ||
+		   pathOffset == 0 || line[pathOffset] == '\0') {
+			break;
+		}
+		entry.kind = kind;
+		entry.dev = (dev_t)dev;
+		entry.ino = (ino_t)ino;
+		entry.mtime.tv_sec = (time_t)sec;
+		entry.mtime.tv_nsec = nsec;
+		if(strcmp(digest, "-")) {
+			entry.digest = digest;
+		}
+		entry.path = line + pathOffset;
+		entries.push_back(entry);
+	}
+	fclose(file);
+	if(!complete) {
+		MSDebug("scan manifest %s is damaged", mPath.c_str());
+		entries.clear();
+	}
+	return complete;
+}
+
+bool ScanManifest::isCurrent()
+{
+	mRecorded.clear();
+	if(!load(mRecorded)) {
+		return false;
+	}
+
+	/* the scan covered exactly these DB files and bundle directories, in order */
+	std::vector<std::string> expected;
+	expected.push_back(mDbDir + "/" MDS_OBJECT_DB_NAME);
+	expected.push_back(mDbDir + "/" MDS_DIRECT_DB_NAME);
+	expected.insert(expected.end(), mBundleDirs.begin(), mBundleDirs.end());
+	if(mRecorded.size() < expected.size()) {
+		return false;
+	}
+	for(size_t dex = 0; dex < expected.size(); dex++) {
+		const Entry &recorded = mRecorded[dex];
+		char kind = (dex < 2) ? 'D' : 'R';
+		if(recorded.kind != kind || recorded.path != expected[dex]) {
+			MSDebug("scan manifest covers different paths");
+			return false;
+		}
+	}
+
+	/*
+	 * Anything added to or removed from a bundle directory changes its mtime,
+	 * so if the directories match, the recorded bundles are all there are.
+	 */
+	bool touched = false;
+	for(EntryVector::iterator it = mRecorded.begin(); it != mRecorded.end(); ++it) {
+		Entry current;
+		bool exists = statEntry(it->kind, it->path, current);
+		if(it->kind == 'R' && it->ino == 0) {
+			if(exists) {
+				MSDebug("scan manifest: %s appeared", it->path.c_str());
+				return false;
+			}
+			continue;
+		}
+		if(!exists) {
+			MSDebug("scan manifest: %s is gone", it->path.c_str());
+			return false;
+		}
+		if(sameFile(*it, current)) {
+			continue;
+		}
+		if(it->kind != 'B' || it->digest.empty()) {
+			/* for a 'P' plugin, the scan's outdated check would look at this */
+			MSDebug("scan manifest: %s changed", it->path.c_str());
+			return false;
+		}
+
+		/* A bundle was touched or replaced; only its content matters. */
+		current.digest = bundleDigest(it->path);
+		if(current.digest != it->digest) {
+			MSDebug("scan manifest: bundle %s changed", it->path.c_str());
+			return false;
+		}
+		MSDebug("scan manifest: bundle %s touched but unchanged", it->path.c_str());
+		*it = current;
+		touched = true;
+	}
+
+	if(touched) {
+		/* remember the new stats so we don't digest the same bundles again */
+		mBundles.clear();
+		mPlugins.clear();
+		for(EntryVector::const_iterator it = mRecorded.begin() + expected.size();
+				it != mRecorded.end(); ++it) {
+			((it->kind == 'P') ? mPlugins : mBundles).push_back(*it);
+		}
+		write();
+	}
+	return true;
+}
+
+/*
+ * Stat and digest every bundle the scan is about to see. This is done before
+ * the scan so that a bundle which changes while we're scanning doesn't get
+ * recorded as up to date.
+ */
+void ScanManifest::snapshotBundles()
+{
+	/* reuse digests of bundles that haven't changed since the last manifest */
+	std::map<std::string, const Entry *> previous;
+	for(EntryVector::const_iterator it = mRecorded.begin(); it != mRecorded.end(); ++it) {
+		if(it->kind == 'B') {
+			previous[it->path] = &*it;
+		}
+	}
+
+	mBundles.clear();
+	for(std::vector<std::string>::const_iterator dirIt = mBundleDirs.begin();
+			dirIt != mBundleDirs.end(); ++dirIt) {
+		DIR *dir = opendir(dirIt->c_str());
+		if(dir == NULL) {
+			continue;
+		}
+		struct dirent *dp;
+		while((dp = readdir(dir)) != NULL) {
+			if(!isBundle(dp)) {
+				continue;
+			}
+			Entry entry;
+			if(!statEntry('B', *dirIt + "/" + dp->d_name, entry)) {
+				continue;
+			}
+			std::map<std::string, const Entry *>::const_iterator prev = previous.find(entry.path);
+			if(prev != previous.end() && sameFile(*prev->second, entry)) {
+				entry.digest = prev->second->digest;
+			}
+			else {
+				entry.digest = bundleDigest(entry.path);
+			}
+			mBundles.push_back(entry);
+		}
+		closedir(dir);
+	}
+}
+
+/*
+ * Stat the registered plugins that snapshotBundles() didn't cover. Like the
+ * bundle snapshot this must precede the DB commit, so call it right after
+ * removeOutdatedPlugins(), which stat()ed the same paths.
+ */
+void ScanManifest::notePluginPaths(
+	const std::vector<std::string> &pluginPaths)
+{
+	std::set<std::string> seen;
+	for(EntryVector::const_iterator it = mBundles.begin(); it != mBundles.end(); ++it) {
+		seen.insert(it->path);
+	}
+
+	mPlugins.clear();
+	for(std::vector<std::string>::const_iterator it = pluginPaths.begin();
+			it != pluginPaths.end(); ++it) {
+		if(!seen.insert(*it).second) {
+			continue;
+		}
+		/* if it's already gone, record it that way; the next session rescans */
+		Entry entry;
+		statEntry('P', *it, entry);
+		mPlugins.push_back(entry);
+	}
+}
+
+/*
+ * Write the manifest, taking the DB and bundle directory stats now. Failure
+ * just means the next session does a full scan.
+ */
+void ScanManifest::write()
+{
+	EntryVector entries;
+	Entry entry;
+	if(!statEntry('D', mDbDir + "/" MDS_OBJECT_DB_NAME, entry)) {
+		return;
+	}
+	entries.push_back(entry);
+	if(!statEntry('D', mDbDir + "/" MDS_DIRECT_DB_NAME, entry)) {
+		return;
+	}
+	entries.push_back(entry);
+	for(std::vector<std::string>::const_iterator it = mBundleDirs.begin(); it != mBundleDirs.end(); ++it) {
+		statEntry('R', *it, entry);
+		entries.push_back(entry);
+	}
+	entries.insert(entries.end(), mBundles.begin(), mBundles.end());
+	entries.insert(entries.end(), mPlugins.begin(), mPlugins.end());
+
+	std::string tmpPath = mPath + ".tmp";
+	int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+		(geteuid() == 0) ? MDS_SYSTEM_DB_MODE : MDS_USER_DB_MODE);
+	FILE *file = (fd < 0) ? NULL : fdopen(fd, "w");
+	if(file == NULL) {
+		MSDebug("error %d creating scan manifest %s", errno, tmpPath.c_str());
+		if(fd >= 0) {
+			close(fd);
+		}
+		return;
+	}
+	fprintf(file, "mdsscan %d\n", MDS_SCAN_MANIFEST_VERSION);
+	for(EntryVector::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+		fprintf(file, "%c %llu %llu %lld %ld %s %s\n", it->kind,
+			(unsigned long long)it->dev, (unsigned long long)it->ino,
+			(long long)it->mtime.tv_sec, (long)it->mtime.tv_nsec,
+			it->digest.empty() ? "-" : it->digest.c_str(), it->path.c_str());
+	}
+	fprintf(file, "end\n");
+	if(fclose(file) || rename(tmpPath.c_str(), mPath.c_str())) {
+		MSDebug("error %d writing scan manifest %s", errno, mPath.c_str());
+		unlink(tmpPath.c_str());
+		return;
+	}
+	MSDebug("wrote scan manifest %s (%zu bundles)", mPath.c_str(), mBundles.size());
+}
+
 #define COPY_BUF_SIZE	65536
 
 /* 
@@ -1163,18 +1593,38 @@ void MDSSession::updateDataBases()
 			MSDebug("Using system DBs only");
 		}
 		
-		/* 
-		 * Update per-user DBs from both bundle sources (System bundles, user bundles)
-		 * as appropriate. 
+		/*
+		 * If neither the DBs nor any plugin bundle changed since the last full
+		 * scan, there's nothing to do.
 		 */
-		DbFilesInfo dbFiles(*this, userDBFileDir.c_str());
-		dbFiles.removeOutdatedPlugins();
-		dbFiles.updateSystemDbInfo(NULL, MDS_BUNDLE_PATH);
+		std::vector<std::string> bundleDirs;
+		bundleDirs.push_back(MDS_BUNDLE_PATH);
 		if(userBundlePath[0]) {
-			/* skip for invalid or missing $HOME... */
-			if(checkUserBundles(userBundlePath)) {
-				dbFiles.updateForBundleDir(userBundlePath);
-			}
+			bundleDirs.push_back(userBundlePath);
+		}
+		ScanManifest manifest(userDBFileDir, bundleDirs);
+		if(manifest.isCurrent()) {
+			MSDebug("scan manifest current; skipping plugin scan");
+		}
+		else {
+			manifest.snapshotBundles();
+			{
+				/* 
+				 * Update per-user DBs from both bundle sources (System bundles, user bundles)
+				 * as appropriate. 
+				 */
+				DbFilesInfo dbFiles(*this, userDBFileDir.c_str());
+				dbFiles.removeOutdatedPlugins();
+				manifest.notePluginPaths(dbFiles.keptPluginPaths());
+				dbFiles.updateSystemDbInfo(NULL, MDS_BUNDLE_PATH);
+				if(userBundlePath[0]) {
+					/* skip for invalid or missing $HOME... */
+					if(checkUserBundles(userBundlePath)) {
+						dbFiles.updateForBundleDir(userBundlePath);
+					}
+				}
+			}	/* DBs committed and closed */
+			manifest.write();
 		}
 		mModule.setDbPath(userDBFileDir.c_str());
 	}	/* main block protected by mLockFd */
@@ -1528,7 +1978,10 @@ void MDSSession::DbFilesInfo::checkOutdatedPlugin(
 		/* timestamp of plugin's main directory later than that of DBs */
 		obsolete = true;
 	}
-	if(obsolete) {
+	if(!obsolete) {
+		mKeptPluginPaths.push_back(path);
+	}
+	else {
         if (guidValue.Length != 0 && guidValue.Length < MAX_GUID_LEN) {
             TbdRecord *tbdRecord = new TbdRecord(guidValue);
             tbdVector.push_back(tbdRecord);
@@ -30,6 +30,8 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <list>
+#include <string>
+#include <vector>
 
 namespace Security
 {
@@ -102,6 +104,8 @@ public:
 			const char *systemPath,			// e.g., /System/Library/Frameworks
 			const char *bundlePath);		// e.g., /System/Library/Security
 		void removeOutdatedPlugins();
+		/* real paths of the plugins removeOutdatedPlugins() kept */
+		const std::vector<std::string> &keptPluginPaths()	{ return mKeptPluginPaths; }
 		void updateForBundleDir(
 			const char *bundleDirPath);
 		void updateForBundle(
@@ -133,6 +137,7 @@ public:
 		CSSM_DB_HANDLE mObjDbHand;
 		CSSM_DB_HANDLE mDirectDbHand;
 		time_t mLaterTimestamp;
+		std::vector<std::string> mKeptPluginPaths;
 	};	/* DbFilesInfo */
 private:
     class LockHelper
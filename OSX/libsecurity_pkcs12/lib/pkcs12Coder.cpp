@@ -81,6 +81,7 @@ void P12Coder::init()
 	mAccess = NULL;
 	mNoAcl = false;
 	mKeyUsage = CSSM_KEYUSE_ANY;		/* default */
+	mKeyCache = NULL;
 	/* default key attrs; we add CSSM_KEYATTR_PERMANENT if importing to 
 	 * a keychain */
 	mKeyAttrs = CSSM_KEYATTR_RETURN_REF | CSSM_KEYATTR_EXTRACTABLE | 
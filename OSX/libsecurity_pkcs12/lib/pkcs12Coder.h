@@ -33,6 +33,8 @@
 #include <security_pkcs12/pkcs12SafeBag.h>
 #include <vector>
 
+class P12KeyCache;
+
 /*
  * This class essentially consists of the following:
  *
@@ -293,6 +295,10 @@ private:
 		const CSSM_DATA 			&authSafeBlob,
 		SecNssCoder 				&localCdr);
 
+	void prederiveKeys(
+		const vector<const CSSM_X509_ALGORITHM_IDENTIFIER *> &algIds,
+		SecNssCoder 				&localCdr);
+
 	/* private encoding routines */
 	NSS_P7_DecodedContentInfo *safeContentsBuild(
 		NSS_P12_SafeBag				**bags,
@@ -409,6 +415,12 @@ private:
 	CSSM_KEYUSE					mKeyUsage;
 	CSSM_KEYATTR_FLAGS			mKeyAttrs;
 	
+	/*
+	 * Keys derived from mEncrPassPhrase/mEncrPassKey, only valid
+	 * during decode()
+	 */
+	P12KeyCache					*mKeyCache;
+	
 	/*
 	 * The source of most (all?) of our privately allocated data
 	 */
@@ -31,6 +31,7 @@
 #include <security_cdsa_utils/cuCdsaUtils.h>
 #include <security_cdsa_utilities/cssmacl.h>
 #include <security_keychain/Access.h>
+#include <memory>
 
 /*
  * Given appropriate P12-style parameters, cook up a CSSM_KEY.
@@ -119,6 +120,86 @@ CSSM_RETURN p12KeyGen(
 	return crtn;
 }
 
+P12KeyCache::~P12KeyCache()
+{
+	for(EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+		CSSM_FreeKey(mCspHand, NULL, &it->second->key, CSSM_FALSE);
+		delete it->second;
+	}
+}
+
+/*
+ * Everything the derived key and IV depend on, other than the passphrase.
+ */
+std::string P12KeyCache::tagFor(
+	CSSM_ALGORITHMS		keyAlg,
+	CSSM_ALGORITHMS		pbeHashAlg,
+	uint32				keySizeInBits,
+	uint32				iterCount,
+	const CSSM_DATA		&salt,
+	CSSM_SIZE			ivLength)
+{
+	uint32 params[5] = { keyAlg, pbeHashAlg, keySizeInBits, iterCount, (uint32)ivLength };
+	std::string tag((const char *)params, sizeof(params));
+	tag.append((const char *)salt.Data, salt.Length);
+	return tag;
+}
+
+CSSM_RETURN P12KeyCache::deriveKey(
+	CSSM_ALGORITHMS		keyAlg,
+	CSSM_ALGORITHMS		pbeHashAlg,
+	uint32				keySizeInBits,
+	uint32				iterCount,
+	const CSSM_DATA		&salt,
+	const CSSM_DATA		*pwd,
+	const CSSM_KEY		*passKey,
+	CSSM_DATA			&iv,
+	const CSSM_KEY		*&key)
+{
+	std::string tag = tagFor(keyAlg, pbeHashAlg, keySizeInBits, iterCount,
+		salt, iv.Length);
+	{
+		StLock<Mutex> _(mLock);
+		EntryMap::const_iterator it = mEntries.find(tag);
+		if(it != mEntries.end()) {
+			key = &it->second->key;
+			if(iv.Length) {
+				memmove(iv.Data, it->second->iv.data(), iv.Length);
+			}
+			return CSSM_OK;
+		}
+	}
+
+	/* derive unlocked so that distinct keys can be derived concurrently */
+	std::unique_ptr<Entry> entry(new Entry);
+	CSSM_RETURN crtn = p12KeyGen(mCspHand, entry->key, true, keyAlg, pbeHashAlg,
+		keySizeInBits, iterCount, salt, pwd, passKey, iv);
+	if(crtn) {
+		return crtn;
+	}
+
+	/* until mEntries owns it, the derived key is ours to free */
+	try {
+		entry->iv.assign((const char *)iv.Data, iv.Length);
+
+		StLock<Mutex> _(mLock);
+		std::pair<EntryMap::iterator, bool> res = mEntries.insert(EntryMap::value_type(tag, entry.get()));
+		if(res.second) {
+			entry.release();
+		}
+		else {
+			/* lost a race with another thread deriving the same key */
+			CSSM_FreeKey(mCspHand, NULL, &entry->key, CSSM_FALSE);
+		}
+		key = &res.first->second->key;
+	}
+	catch(...) {
+		CSSM_FreeKey(mCspHand, NULL, &entry->key, CSSM_FALSE);
+		throw;
+	}
+	return CSSM_OK;
+}
+
 /*
  * Decrypt (typically, an encrypted P7 ContentInfo contents)
  */
@@ -138,10 +219,12 @@ CSSM_RETURN p12Decrypt(
 	const CSSM_DATA		*pwd,		// unicode external representation
 	const CSSM_KEY		*passKey,
 	SecNssCoder			&coder,		// for mallocing plainText
-	CSSM_DATA			&plainText)
+	CSSM_DATA			&plainText,
+	P12KeyCache			*keyCache)	// optional
 {
 	CSSM_RETURN crtn;
 	CSSM_KEY ckey;
+	const CSSM_KEY *keyPtr = &ckey;
 	CSSM_CC_HANDLE ccHand = 0;
 	CSSM_DATA ourPtext = {0, NULL};
 	CSSM_DATA remData = {0, NULL};
@@ -155,8 +238,14 @@ CSSM_RETURN p12Decrypt(
 	}
 	
 	/* P12 style key derivation */
-	crtn = p12KeyGen(cspHand, ckey, true, keyAlg, pbeHashAlg,
-		keySizeInBits, iterCount, salt, pwd, passKey, iv);
+	if(keyCache) {
+		crtn = keyCache->deriveKey(keyAlg, pbeHashAlg, keySizeInBits,
+			iterCount, salt, pwd, passKey, iv, keyPtr);
+	}
+	else {
+		crtn = p12KeyGen(cspHand, ckey, true, keyAlg, pbeHashAlg,
+			keySizeInBits, iterCount, salt, pwd, passKey, iv);
+	}
 	if(crtn) {
 		return crtn;
 	}	
@@ -167,7 +256,7 @@ CSSM_RETURN p12Decrypt(
 		encrAlg,
 		mode,
 		NULL,			// access cred
-		&ckey,
+		keyPtr,
 		ivPtr,			// InitVector, optional
 		padding,	
 		NULL,			// Params
@@ -206,7 +295,9 @@ errOut:
 	if(ccHand) {
 		CSSM_DeleteContext(ccHand);
 	}
-	CSSM_FreeKey(cspHand, NULL, &ckey, CSSM_FALSE);
+	if(keyCache == NULL) {
+		CSSM_FreeKey(cspHand, NULL, &ckey, CSSM_FALSE);
+	}
 	return crtn;
 }
 
@@ -396,10 +487,12 @@ CSSM_RETURN p12UnwrapKey(
 	 * Result: a private key, reference format, optionaly stored
 	 * in dlDbHand
 	 */
-	CSSM_KEY_PTR		&privKey)
+	CSSM_KEY_PTR		&privKey,
+	P12KeyCache			*keyCache)	// optional
 {
 	CSSM_RETURN crtn;
 	CSSM_KEY ckey;
+	const CSSM_KEY *keyPtr = &ckey;
 	CSSM_CC_HANDLE ccHand = 0;
 	CSSM_KEY wrappedKey;
 	CSSM_KEY unwrappedKey;
@@ -420,8 +513,14 @@ CSSM_RETURN p12UnwrapKey(
 	}
 	
 	/* P12 style key derivation */
-	crtn = p12KeyGen(cspHand, ckey, true, keyAlg, pbeHashAlg,
-		keySizeInBits, iterCount, salt, pwd, passKey, iv);
+	if(keyCache) {
+		crtn = keyCache->deriveKey(keyAlg, pbeHashAlg, keySizeInBits,
+			iterCount, salt, pwd, passKey, iv, keyPtr);
+	}
+	else {
+		crtn = p12KeyGen(cspHand, ckey, true, keyAlg, pbeHashAlg,
+			keySizeInBits, iterCount, salt, pwd, passKey, iv);
+	}
 	if(crtn) {
 		return crtn;
 	}	
@@ -432,7 +531,7 @@ CSSM_RETURN p12UnwrapKey(
 		encrAlg,
 		mode,
 		NULL,			// access cred
-		&ckey,
+		keyPtr,
 		ivPtr,			// InitVector, optional
 		padding,	
 		NULL,			// Params
@@ -534,7 +633,9 @@ errOut:
 	if(ccHand) {
 		CSSM_DeleteContext(ccHand);
 	}
-	CSSM_FreeKey(cspHand, NULL, &ckey, CSSM_FALSE);
+	if(keyCache == NULL) {
+		CSSM_FreeKey(cspHand, NULL, &ckey, CSSM_FALSE);
+	}
 	return crtn;
 }
 
@@ -30,6 +30,11 @@
 
 #include <Security/Security.h>
 #include <security_asn1/SecNssCoder.h>
+#include <security_utilities/threading.h>
+#include <string>
+#include <map>
+
+class P12KeyCache;
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,7 +78,8 @@ CSSM_RETURN p12Decrypt(
 	const CSSM_DATA		*pwd,		// unicode, double null terminated
 	const CSSM_KEY		*passKey,
 	SecNssCoder			&coder,		// for mallocing KeyData and plainText
-	CSSM_DATA			&plainText);
+	CSSM_DATA			&plainText,
+	P12KeyCache			*keyCache = NULL);	// optional, see below
 
 /*
  * Decrypt (typically, an encrypted P7 ContentInfo contents)
@@ -143,7 +149,8 @@ CSSM_RETURN p12UnwrapKey(
 	 * Result: a private key, reference format, optionaly stored
 	 * in dlDbHand
 	 */
-	CSSM_KEY_PTR		&privKey);
+	CSSM_KEY_PTR		&privKey,
+	P12KeyCache			*keyCache = NULL);	// optional, see below
 
 CSSM_RETURN p12WrapKey(
 	CSSM_CSP_HANDLE		cspHand,
@@ -168,5 +175,52 @@ CSSM_RETURN p12WrapKey(
 }
 #endif
 
+/*
+ * Encryption keys (and IVs) derived during one decode, keyed by the PBE
+ * parameters they were derived from. A PFX commonly uses the same salt and
+ * iteration count for many bags; with a high iteration count the derivation
+ * dominates the cost of a decrypt, so each one is only done once. The
+ * passphrase is not part of the lookup - a cache is only valid for one
+ * passphrase, and owns the keys it hands out. Safe to use from multiple
+ * threads.
+ */
+class P12KeyCache
+{
+public:
+	P12KeyCache(CSSM_CSP_HANDLE cspHand) : mCspHand(cspHand) { }
+	~P12KeyCache();
+	
+	/* Same as p12KeyGen() with isForEncr true, but the key remains ours */
+	CSSM_RETURN deriveKey(
+		CSSM_ALGORITHMS		keyAlg,
+		CSSM_ALGORITHMS		pbeHashAlg,
+		uint32				keySizeInBits,
+		uint32				iterCount,
+		const CSSM_DATA		&salt,
+		const CSSM_DATA		*pwd,
+		const CSSM_KEY		*passKey,
+		CSSM_DATA			&iv,		// Length is the IV size wanted
+		const CSSM_KEY		*&key);		// RETURNED
+	
+	static std::string tagFor(
+		CSSM_ALGORITHMS		keyAlg,
+		CSSM_ALGORITHMS		pbeHashAlg,
+		uint32				keySizeInBits,
+		uint32				iterCount,
+		const CSSM_DATA		&salt,
+		CSSM_SIZE			ivLength);
+
+private:
+	struct Entry {
+		CSSM_KEY			key;
+		std::string			iv;
+	};
+	typedef std::map<std::string, Entry *> EntryMap;
+	
+	CSSM_CSP_HANDLE			mCspHand;
+	Mutex					mLock;		// protects mEntries
+	EntryMap				mEntries;
+};
+
 #endif	/* _PKCS12_CRYPTO_H_ */
 
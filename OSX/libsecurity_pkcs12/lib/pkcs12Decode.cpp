@@ -33,6 +33,8 @@
 #include <security_cdsa_utilities/cssmerrors.h>
 #include <security_utilities/casts.h>
 #include <security_asn1/nssUtils.h>
+#include <dispatch/dispatch.h>
+#include <set>
 
 /* top-level PKCS12 PFX decoder */
 void P12Coder::decode(
@@ -78,7 +80,21 @@ void P12Coder::decode(
 		CssmError::throwMe(errSecPkcs12VerifyFailure);
 	}
 	
-	authSafeParse(*dci.content.data, localCdr);
+	/*
+	 * All the bags are encrypted with the same passphrase, so keys
+	 * derived for one can be reused by any other with identical PBE
+	 * parameters.
+	 */
+	P12KeyCache keyCache(mCspHand);
+	mKeyCache = &keyCache;
+	try {
+		authSafeParse(*dci.content.data, localCdr);
+	}
+	catch(...) {
+		mKeyCache = NULL;
+		throw;
+	}
+	mKeyCache = NULL;
 
 	/*
 	 * On success, if we have a keychain, store certs and CRLs there
@@ -139,7 +155,8 @@ void P12Coder::encryptedDataDecrypt(
 		pwd,
 		passKey, 
 		localCdr, 
-		ptext);
+		ptext,
+		mKeyCache);
 	if(crtn) {
 		CssmError::throwMe(crtn);
 	}
@@ -271,7 +288,8 @@ void P12Coder::shroudedKeyBagParse(
 		mNoAcl,
 		mKeyUsage,
 		mKeyAttrs,
-		privKey);
+		privKey,
+		mKeyCache);
 	if(crtn) {
 		p12ErrorLog("Error unwrapping private key\n");
 		CssmError::throwMe(crtn);
@@ -408,6 +426,17 @@ void P12Coder::safeContentsParse(
 		P12_THROW_DECODE;
 	}
 	unsigned numBags = nssArraySize((const void **)sc.bags);
+	
+	/* get the key derivations for all shrouded key bags going at once */
+	vector<const CSSM_X509_ALGORITHM_IDENTIFIER *> algIds;
+	for(unsigned dex=0; dex<numBags; dex++) {
+		NSS_P12_SafeBag *bag = sc.bags[dex];
+		if((bag->type == BT_ShroudedKeyBag) && (bag->bagValue.shroudedKeyBag != NULL)) {
+			algIds.push_back(&bag->bagValue.shroudedKeyBag->algorithm);
+		}
+	}
+	prederiveKeys(algIds, localCdr);
+	
 	for(unsigned dex=0; dex<numBags; dex++) {
 		NSS_P12_SafeBag *bag = sc.bags[dex];
 		assert(bag != NULL);
@@ -511,12 +540,113 @@ void P12Coder::authSafeParse(
 		P12_THROW_DECODE;
 	}
 	unsigned numInfos = nssArraySize((const void **)authSafe.info);
+	
+	/* get the key derivations for all EncryptedData going at once */
+	vector<const CSSM_X509_ALGORITHM_IDENTIFIER *> algIds;
+	for(unsigned dex=0; dex<numInfos; dex++) {
+		NSS_P7_DecodedContentInfo *info = authSafe.info[dex];
+		if((info->type == CT_EncryptedData) && (info->content.encryptData != NULL)) {
+			algIds.push_back(&info->content.encryptData->contentInfo.encrAlg);
+		}
+	}
+	prederiveKeys(algIds, localCdr);
+	
 	for(unsigned dex=0; dex<numInfos; dex++) {
 		NSS_P7_DecodedContentInfo *info = authSafe.info[dex];
 		authSafeElementParse(info, localCdr);
 	}
 }
 
+/* PBE parameters of one key for prederiveKeys() */
+struct P12PendingDerivation {
+	CSSM_ALGORITHMS		keyAlg;
+	CSSM_ALGORITHMS		pbeHashAlg;
+	uint32				keySizeInBits;
+	uint32				blockSizeInBytes;
+	uint32				iterCount;
+	CSSM_DATA			salt;
+};
+
+/*
+ * The PKCS12 key derivation is what makes decrypting a bag expensive, and
+ * the derivations for different bags are independent. Run the ones for
+ * the given PBE algorithm IDs concurrently so that the (serial) decrypts
+ * which follow find their keys in mKeyCache. Nothing is reported here;
+ * anything we can't handle is left for the decrypt to fail on.
+ */
+void P12Coder::prederiveKeys(
+	const vector<const CSSM_X509_ALGORITHM_IDENTIFIER *> &algIds,
+	SecNssCoder &localCdr)
+{
+	if((mKeyCache == NULL) || (algIds.size() < 2)) {
+		/* nothing to overlap */
+		return;
+	}
+	const CSSM_DATA *pwd = getEncrPassPhrase();
+	const CSSM_KEY *passKey = getEncrPassKey();
+	if((pwd == NULL) && (passKey == NULL)) {
+		return;
+	}
+	
+	vector<P12PendingDerivation> derivations;
+	std::set<std::string> tags;
+	for(unsigned dex=0; dex<algIds.size(); dex++) {
+		const CSSM_X509_ALGORITHM_IDENTIFIER &algId = *algIds[dex];
+		P12PendingDerivation pd;
+		CSSM_ALGORITHMS encrAlg;
+		CSSM_PADDING padding;
+		CSSM_ENCRYPT_MODE mode;
+		PKCS_Which pkcs;
+		NSS_P12_PBE_Params pbep;
+		
+		if(!pkcsOidToParams(&algId.algorithm, pd.keyAlg, encrAlg, pd.pbeHashAlg,
+				pd.keySizeInBits, pd.blockSizeInBytes, padding, mode, pkcs) ||
+		   (pkcs != PW_PKCS12)) {
+			continue;
+		}
+		memset(&pbep, 0, sizeof(pbep));
+		if((algId.parameters.Length == 0) ||
+		   localCdr.decodeItem(algId.parameters, NSS_P12_PBE_ParamsTemplate, &pbep) ||
+		   !p12DataToInt(pbep.iterations, pd.iterCount)) {
+			continue;
+		}
+		pd.salt = pbep.salt;
+		
+		/* one derivation per distinct key */
+		if(tags.insert(P12KeyCache::tagFor(pd.keyAlg, pd.pbeHashAlg, pd.keySizeInBits,
+				pd.iterCount, pd.salt, pd.blockSizeInBytes)).second) {
+			derivations.push_back(pd);
+		}
+	}
+	if(derivations.size() < 2) {
+		return;
+	}
+	
+	p12DecodeLog("prederiving %u keys", (unsigned)derivations.size());
+	P12KeyCache *keyCache = mKeyCache;
+	const P12PendingDerivation *pending = &derivations[0];
+	dispatch_apply(derivations.size(), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+		^(size_t dex) {
+			const P12PendingDerivation &pd = pending[dex];
+			CSSM_DATA iv = {pd.blockSizeInBytes, NULL};
+			const CSSM_KEY *key;
+			if(iv.Length) {
+				iv.Data = (uint8 *)malloc(iv.Length);
+				if(iv.Data == NULL) {
+					return;
+				}
+			}
+			try {
+				keyCache->deriveKey(pd.keyAlg, pd.pbeHashAlg, pd.keySizeInBits,
+					pd.iterCount, pd.salt, pwd, passKey, iv, key);
+			}
+			catch(...) {
+				/* the decrypt will try again, and report */
+			}
+			free(iv.Data);
+		});
+}
+
 void P12Coder::macParse(
 	const NSS_P12_MacData &macData, 
 	SecNssCoder &localCdr)
@@ -36,8 +36,17 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+/* Maximum plaintext fragment size, defined in TLS 1.2 RFC, section 6.2.1 */
+#define MAX_PLAINTEXT_SIZE 16384
+
 /* Maximum encrypted record size, defined in TLS 1.2 RFC, section 6.2.3 */
-#define DEFAULT_BUFFER_SIZE (16384 + 2048)
+#define DEFAULT_BUFFER_SIZE (MAX_PLAINTEXT_SIZE + 2048)
+
+/* Read buffer size when read ahead is enabled */
+#define READ_AHEAD_BUFFER_SIZE (4 * DEFAULT_BUFFER_SIZE)
+
+/* Room reserved to coalesce full size application data records into one write */
+#define WRITE_COALESCE_SIZE (4 * DEFAULT_BUFFER_SIZE)
 
 
 /*
@@ -89,6 +98,58 @@ int sslIoWrite(SSLBuffer                       buf,
 	return ortn;
 }
 
+/*
+ * Make sure at least 'needed' bytes of the current record are buffered.
+ *
+ * Without read ahead we ask the I/O callback for exactly the missing bytes,
+ * as we always have. With read ahead we ask for as much as fits in the
+ * buffer, so that a single callback typically returns the header, the body
+ * and the start of the following records. Whatever is left over after the
+ * current record stays buffered for the next SSLRecordReadInternal call.
+ */
+static
+int SSLRecordFillInternal(struct SSLRecordInternalContext *ctx, size_t needed)
+{
+    int     err = 0;
+    size_t  len;
+    SSLBuffer readData;
+
+    if (ctx->amountRead >= needed)
+        return 0;
+
+    /* Slide a partial record down to the start of the buffer if it won't fit */
+    if (ctx->readOffset + needed > ctx->partialReadBuffer.length) {
+        memmove(ctx->partialReadBuffer.data,
+                ctx->partialReadBuffer.data + ctx->readOffset,
+                ctx->amountRead);
+        ctx->readOffset = 0;
+    }
+
+    while (ctx->amountRead < needed) {
+        readData.data = ctx->partialReadBuffer.data + ctx->readOffset + ctx->amountRead;
+        if (ctx->readAhead)
+            readData.length = ctx->partialReadBuffer.length - ctx->readOffset - ctx->amountRead;
+        else
+            readData.length = needed - ctx->amountRead;
+        len = readData.length;
+        err = sslIoRead(readData, &len, ctx);
+        ctx->amountRead += len;
+        if (err != 0) {
+            /* A short read ahead is fine as long as the record is complete */
+            if (err == errSSLRecordWouldBlock && ctx->amountRead >= needed)
+                err = 0;
+            break;
+        }
+        if (len == 0 && ctx->amountRead < needed) {
+            /* noErr without any progress: behave as a would block */
+            err = errSSLRecordWouldBlock;
+            break;
+        }
+    }
+
+    return err;
+}
+
 /* Entry points to Record Layer */
 
 static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
@@ -96,38 +157,20 @@ static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
     struct SSLRecordInternalContext *ctx = ref;
 
     int     err;
-    size_t  len, contentLen;
-    SSLBuffer readData;
+    size_t  contentLen;
 
     size_t head=tls_record_get_header_size(ctx->filter);
 
-    if (ctx->amountRead < head)
+    if ((err = SSLRecordFillInternal(ctx, head)) != 0)
     {
-        readData.length = head - ctx->amountRead;
-        readData.data = ctx->partialReadBuffer.data + ctx->amountRead;
-        len = readData.length;
-        err = sslIoRead(readData, &len, ctx);
-        if(err != 0)
-        {
-            switch(err) {
-                case errSSLRecordWouldBlock:
-                    ctx->amountRead += len;
-                    break;
-                default:
-                    /* Any other error but errSSLWouldBlock is  translated to errSSLRecordClosedAbort */
-                    err = errSSLRecordClosedAbort;
-                    break;
-            }
-            return err;
-        }
-        ctx->amountRead += len;
-
-        check(ctx->amountRead == head);
+        /* Any other error but errSSLWouldBlock is  translated to errSSLRecordClosedAbort */
+        if (err != errSSLRecordWouldBlock)
+            err = errSSLRecordClosedAbort;
+        return err;
     }
 
-
     tls_buffer header;
-    header.data=ctx->partialReadBuffer.data;
+    header.data=ctx->partialReadBuffer.data + ctx->readOffset;
     header.length=head;
 
     uint8_t content_type;
@@ -142,39 +185,28 @@ static int SSLRecordReadInternal(SSLRecordContextRef ref, SSLRecord *rec)
         if(err!=0) return errSSLRecordUnexpectedRecord;
     }
 
-    check(ctx->partialReadBuffer.length>=head+contentLen);
+    check(DEFAULT_BUFFER_SIZE>=head+contentLen);
 
-    if(head+contentLen>ctx->partialReadBuffer.length) {
+    if(head+contentLen>DEFAULT_BUFFER_SIZE) {
         sslDebugLog("overflow in SSLReadRecordInternal");
         return errSSLRecordRecordOverflow;
     }
 
-    if (ctx->amountRead < head + contentLen)
-    {
-        readData.length = head + contentLen - ctx->amountRead;
-        readData.data = ctx->partialReadBuffer.data + ctx->amountRead;
-        len = readData.length;
-        err = sslIoRead(readData, &len, ctx);
-        if(err != 0)
-        {
-            if (err == errSSLRecordWouldBlock)
-            {
-                ctx->amountRead += len;
-            }
-            return err;
-        }
-        ctx->amountRead += len;
-    }
-
-    check(ctx->amountRead == head + contentLen);
+    if ((err = SSLRecordFillInternal(ctx, head + contentLen)) != 0)
+        return err;
 
     tls_buffer record;
-    record.data = ctx->partialReadBuffer.data;
-    record.length = ctx->amountRead;
+    record.data = ctx->partialReadBuffer.data + ctx->readOffset;
+    record.length = head + contentLen;
 
     rec->contentType = content_type;
 
-    ctx->amountRead = 0;        /* We've used all the data in the cache */
+    /* Consume the record; anything read past it stays buffered */
+    ctx->amountRead -= record.length;
+    if (ctx->amountRead == 0)
+        ctx->readOffset = 0;
+    else
+        ctx->readOffset += record.length;
 
     if(content_type==tls_record_type_SSL2) {
         /* Just copy the SSL2 record, dont decrypt since this is only for SSL2 Client Hello */
@@ -208,38 +240,59 @@ static int SSLRecordWriteInternal(SSLRecordContextRef ref, SSLRecord rec)
 {
     int err;
     struct SSLRecordInternalContext *ctx = ref;
-    WaitingRecord *queue, *out;
+    WaitingRecord *queue, *out = NULL;
     tls_buffer data;
     tls_buffer content;
-    size_t len;
+    size_t len, capacity;
 
     err = errSSLRecordInternal; /* FIXME: allocation error */
     len=tls_record_encrypted_size(ctx->filter, rec.contentType, rec.contents.length);
 
-    require((out = (WaitingRecord *)sslMalloc(offsetof(WaitingRecord, data) + len)), fail);
+    content.data = rec.contents.data;
+    content.length = rec.contents.length;
+
+    queue = ctx->recordWriteQueue;
+    while (queue && queue->next != 0)
+        queue = queue->next;
+
+    /*
+     * For TLS, encrypt straight into the room left at the end of the last
+     * queued record, so that SSLRecordServiceWriteQueueInternal hands the
+     * I/O callback several records at once. DTLS records each go out in
+     * their own datagram and are never coalesced.
+     */
+    if (!ctx->sslCtx->isDTLS && queue && queue->capacity - queue->length >= len) {
+        data.data = &queue->data[queue->length];
+        data.length = len;
+        require_noerr((err=tls_record_encrypt(ctx->filter, content, rec.contentType, &data)), fail);
+        queue->length += data.length;
+        return 0;
+    }
+
+    /* Full size application data records usually come in runs from a single SSLWrite */
+    capacity = len;
+    if (!ctx->sslCtx->isDTLS && rec.contentType == SSL_RecordTypeAppData &&
+        rec.contents.length >= MAX_PLAINTEXT_SIZE)
+        capacity = WRITE_COALESCE_SIZE;
+
+    require((out = (WaitingRecord *)sslMalloc(offsetof(WaitingRecord, data) + capacity)), fail);
     out->next = NULL;
 	out->sent = 0;
 	out->length = len;
+    out->capacity = capacity;
 
     data.data=&out->data[0];
     data.length=out->length;
 
-    content.data = rec.contents.data;
-    content.length = rec.contents.length;
-
     require_noerr((err=tls_record_encrypt(ctx->filter, content, rec.contentType, &data)), fail);
 
     out->length = data.length; // This should not be needed if tls_record_encrypted_size works properly.
 
     /* Enqueue the record to be written from the idle loop */
-    if (ctx->recordWriteQueue == 0)
+    if (queue == 0)
         ctx->recordWriteQueue = out;
     else
-    {   queue = ctx->recordWriteQueue;
-        while (queue->next != 0)
-            queue = queue->next;
         queue->next = out;
-    }
 
     return 0;
 fail:
@@ -316,6 +369,30 @@ SSLRecordServiceWriteQueueInternal(SSLRecordContextRef ref)
     return werr;
 }
 
+static int
+SSLRecordSetReadAheadInternal(struct SSLRecordInternalContext *ctx, bool value)
+{
+    SSLBuffer buffer;
+    int err;
+
+    /* Each DTLS read returns exactly one datagram, there is nothing to read ahead */
+    if (ctx->sslCtx->isDTLS)
+        return 0;
+
+    if (value && ctx->partialReadBuffer.length < READ_AHEAD_BUFFER_SIZE) {
+        if ((err = SSLAllocBuffer(&buffer, READ_AHEAD_BUFFER_SIZE)))
+            return err;
+        memcpy(buffer.data, ctx->partialReadBuffer.data + ctx->readOffset, ctx->amountRead);
+        SSLFreeBuffer(&ctx->partialReadBuffer);
+        ctx->partialReadBuffer = buffer;
+        ctx->readOffset = 0;
+    }
+
+    /* Keep the larger buffer when turning it off, it may still hold data we read ahead */
+    ctx->readAhead = value;
+    return 0;
+}
+
 static int
 SSLRecordSetOption(SSLRecordContextRef ref, SSLRecordOption option, bool value)
 {
@@ -323,6 +400,8 @@ SSLRecordSetOption(SSLRecordContextRef ref, SSLRecordOption option, bool value)
     switch (option) {
         case kSSLRecordOptionSendOneByteRecord:
             return tls_record_set_record_splitting(ctx->filter, value);
+        case kSSLRecordOptionReadAhead:
+            return SSLRecordSetReadAheadInternal(ctx, value);
         default:
             return 0;
     }
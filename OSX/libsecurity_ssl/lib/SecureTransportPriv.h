@@ -451,6 +451,17 @@ OSStatus SSLSetDHEEnabled(SSLContextRef ctx, bool enabled);
 
 OSStatus SSLGetDHEEnabled(SSLContextRef ctx, bool *enabled);
 
+/*
+ * Let the record layer ask the read callback for as many bytes as it can
+ * buffer instead of one record header and body at a time. Off by default:
+ * the read callback must return errSSLWouldBlock on a short read rather than
+ * block, and bytes read ahead are held by the record layer, so a readable
+ * socket is no longer the only sign that SSLRead has data. Ignored for DTLS.
+ */
+OSStatus SSLSetReadAheadEnabled(SSLContextRef ctx, bool enabled);
+
+OSStatus SSLGetReadAheadEnabled(SSLContextRef ctx, bool *enabled);
+
 #if TARGET_OS_IPHONE
 
 /* Following are SPIs on iOS */
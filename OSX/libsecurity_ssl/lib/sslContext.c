@@ -119,7 +119,9 @@ CFIndex kMinProtocolVersionDefaultValue;
 CFStringRef kSSLSessionConfigDefaultValue;
 Boolean kSSLDisableRecordSplittingDefaultValue;
 
-static tls_cache_t g_session_cache = NULL;
+CFIndex kSSLSessionCacheSizeDefaultValue;
+
+static SSLSessionCacheRef g_session_cache = NULL;
 
 #if TARGET_OS_IPHONE
 /*
@@ -224,6 +226,9 @@ static void _SSLContextReadDefault()
     /* Default Config */
     kSSLSessionConfigDefaultValue = SSLPreferencesCopyString(CFSTR("SSLSessionConfig"), managed_prefs);
 
+    /* Max number of resumable sessions kept process wide, 0 means the default */
+    kSSLSessionCacheSizeDefaultValue = SSLPreferencesGetInteger(CFSTR("SSLSessionCacheSize"), managed_prefs);
+
     CFReleaseSafe(managed_prefs);
 }
 
@@ -231,7 +236,7 @@ static void _SSLContextReadDefault()
 static void SSLContextOnce(void)
 {
     _SSLContextReadDefault();
-    g_session_cache = tls_cache_create();
+    g_session_cache = SSLSessionCacheCreate(kSSLSessionCacheSizeDefaultValue > 0 ? (size_t)kSSLSessionCacheSizeDefaultValue : 0);
 }
 
 CFGiblisWithHashFor(SSLContext)
@@ -444,7 +449,7 @@ void SSLContextDestroy(CFTypeRef arg)
     SSLFreeBuffer(&ctx->dhParamsEncoded);
 
     if(ctx->cache)
-        tls_cache_cleanup(ctx->cache);
+        SSLSessionCacheCleanup(ctx->cache);
 
     memset(((uint8_t*) ctx) + sizeof(CFRuntimeBase), 0, sizeof(SSLContext) - sizeof(CFRuntimeBase));
 }
@@ -2206,6 +2211,30 @@ OSStatus SSLGetDHEEnabled(SSLContextRef ctx, bool *enabled)
     return noErr;
 }
 
+OSStatus SSLSetReadAheadEnabled(SSLContextRef ctx, bool enabled)
+{
+    int err;
+
+    if(ctx == NULL) {
+        return errSecParam;
+    }
+    err = ctx->recFuncs->setOption(ctx->recCtx, kSSLRecordOptionReadAhead, enabled);
+    if(err) {
+        return err;
+    }
+    ctx->readAheadEnabled = enabled;
+    return noErr;
+}
+
+OSStatus SSLGetReadAheadEnabled(SSLContextRef ctx, bool *enabled)
+{
+    if(ctx == NULL) {
+        return errSecParam;
+    }
+    *enabled = ctx->readAheadEnabled;
+    return noErr;
+}
+
 OSStatus SSLSetMinimumDHGroupSize(SSLContextRef ctx, unsigned nbits)
 {
     return tls_handshake_set_min_dh_group_size(ctx->hdsk, nbits);
@@ -34,7 +34,6 @@
 #include <tls_handshake.h>
 #include <tls_record.h>
 #include <tls_stream_parser.h>
-#include <tls_cache.h>
 
 #ifdef USE_CDSA_CRYPTO
 #include <Security/cssmtype.h>
@@ -54,6 +53,7 @@
 
 #include "sslPriv.h"
 #include "sslRecord.h"
+#include "sslSessionCache.h"
 #include "cipherSpecs.h"
 
 #include <dispatch/dispatch.h>
@@ -91,7 +91,7 @@ struct SSLContext
     SSLRecordContextRef recCtx;
 
     tls_handshake_t hdsk;
-    tls_cache_t cache;
+    SSLSessionCacheRef cache;
     int readCipher_ready;
     int writeCipher_ready;
 
@@ -254,6 +254,9 @@ struct SSLContext
     /* Enable DHE or not */
     bool            dheEnabled;
 
+    /* Let the record layer read ahead of the current record */
+    bool            readAheadEnabled;
+
     /* For early failure reporting */
     bool    serverHelloReceived;
 };
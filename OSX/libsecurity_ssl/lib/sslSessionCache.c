@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * sslSessionCache.c - sharded, bounded cache of resumable sessions
+ */
+
+#include "SecureTransport.h"
+
+#include "sslSessionCache.h"
+#include "sslDebug.h"
+#include "sslMemory.h"
+
+#include <AssertMacros.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct SessionCacheEntry
+{
+    struct SessionCacheEntry    *chain;         /* next entry in the same bucket */
+    struct SessionCacheEntry    *newer;         /* LRU list, towards most recently used */
+    struct SessionCacheEntry    *older;         /* LRU list, towards least recently used */
+    uint64_t                    hash;
+    time_t                      expires;
+    size_t                      keyLength;
+    size_t                      dataLength;
+    uint8_t                     bytes[];        /* key, then session data */
+} SessionCacheEntry;
+
+typedef struct SessionCacheShard
+{
+    pthread_mutex_t             lock;
+    SessionCacheEntry           **buckets;
+    size_t                      bucketMask;
+    SessionCacheEntry           *newest;
+    SessionCacheEntry           *oldest;
+    size_t                      count;
+    size_t                      capacity;
+} SessionCacheShard;
+
+struct SSLSessionCache
+{
+    SessionCacheShard           shards[SSL_SESSION_CACHE_SHARDS];
+};
+
+/* FNV-1a; session keys are either random session IDs or tickets, so this is plenty */
+static uint64_t SessionCacheHash(const SSLBuffer *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < key->length; i++) {
+        hash ^= key->data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static SessionCacheShard *SessionCacheShardForHash(SSLSessionCacheRef cache, uint64_t hash)
+{
+    /* Low bits pick the bucket, high bits pick the shard */
+    return &cache->shards[(hash >> 56) & (SSL_SESSION_CACHE_SHARDS - 1)];
+}
+
+static SessionCacheEntry **SessionCacheFindSlot(SessionCacheShard *shard, const SSLBuffer *key, uint64_t hash)
+{
+    SessionCacheEntry **slot = &shard->buckets[hash & shard->bucketMask];
+
+    while (*slot) {
+        SessionCacheEntry *entry = *slot;
+        if (entry->hash == hash && entry->keyLength == key->length &&
+            memcmp(entry->bytes, key->data, key->length) == 0)
+            break;
+        slot = &entry->chain;
+    }
+    return slot;
+}
+
+static void SessionCacheUnlinkLRU(SessionCacheShard *shard, SessionCacheEntry *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        shard->newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        shard->oldest = entry->newer;
+    entry->newer = entry->older = NULL;
+}
+
+static void SessionCacheLinkNewest(SessionCacheShard *shard, SessionCacheEntry *entry)
+{
+    entry->newer = NULL;
+    entry->older = shard->newest;
+    if (shard->newest)
+        shard->newest->newer = entry;
+    else
+        shard->oldest = entry;
+    shard->newest = entry;
+}
+
+/* Remove the entry found at slot from both the bucket chain and the LRU list */
+static void SessionCacheRemoveAt(SessionCacheShard *shard, SessionCacheEntry **slot)
+{
+    SessionCacheEntry *entry = *slot;
+
+    *slot = entry->chain;
+    SessionCacheUnlinkLRU(shard, entry);
+    shard->count--;
+    sslFree(entry);
+}
+
+static void SessionCacheRemove(SessionCacheShard *shard, SessionCacheEntry *entry)
+{
+    SSLBuffer key;
+
+    key.data = entry->bytes;
+    key.length = entry->keyLength;
+    SessionCacheRemoveAt(shard, SessionCacheFindSlot(shard, &key, entry->hash));
+}
+
+static void SessionCacheShardEmpty(SessionCacheShard *shard)
+{
+    SessionCacheEntry *entry, *older;
+
+    for (entry = shard->newest; entry; entry = older) {
+        older = entry->older;
+        sslFree(entry);
+    }
+    memset(shard->buckets, 0, (shard->bucketMask + 1) * sizeof(*shard->buckets));
+    shard->newest = shard->oldest = NULL;
+    shard->count = 0;
+}
+
+SSLSessionCacheRef SSLSessionCacheCreate(size_t capacity)
+{
+    SSLSessionCacheRef cache;
+    size_t perShard, buckets;
+    int i;
+
+    if (capacity == 0)
+        capacity = SSL_SESSION_CACHE_DEFAULT_CAPACITY;
+    perShard = (capacity + SSL_SESSION_CACHE_SHARDS - 1) / SSL_SESSION_CACHE_SHARDS;
+
+    /* Keep the load factor at or below one */
+    for (buckets = 1; buckets < perShard; buckets <<= 1)
+        ;
+
+    cache = sslMalloc(sizeof(*cache));
+    if (cache == NULL)
+        return NULL;
+    memset(cache, 0, sizeof(*cache));
+
+    for (i = 0; i < SSL_SESSION_CACHE_SHARDS; i++) {
+        SessionCacheShard *shard = &cache->shards[i];
+        shard->buckets = sslMalloc(buckets * sizeof(*shard->buckets));
+        require(shard->buckets, fail);
+        memset(shard->buckets, 0, buckets * sizeof(*shard->buckets));
+        shard->bucketMask = buckets - 1;
+        shard->capacity = perShard;
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+
+    return cache;
+
+fail:
+    while (--i >= 0) {
+        pthread_mutex_destroy(&cache->shards[i].lock);
+        sslFree(cache->shards[i].buckets);
+    }
+    sslFree(cache);
+    return NULL;
+}
+
+void SSLSessionCacheDestroy(SSLSessionCacheRef cache)
+{
+    int i;
+
+    if (cache == NULL)
+        return;
+
+    for (i = 0; i < SSL_SESSION_CACHE_SHARDS; i++) {
+        SessionCacheShard *shard = &cache->shards[i];
+        SessionCacheShardEmpty(shard);
+        pthread_mutex_destroy(&shard->lock);
+        sslFree(shard->buckets);
+    }
+    sslFree(cache);
+}
+
+int SSLSessionCacheSave(SSLSessionCacheRef cache, const SSLBuffer *key,
+                        const SSLBuffer *sessionData, uint32_t timeToLive)
+{
+    uint64_t hash = SessionCacheHash(key);
+    SessionCacheShard *shard = SessionCacheShardForHash(cache, hash);
+    SessionCacheEntry *entry, **slot;
+
+    /* Build the entry outside the lock */
+    entry = sslMalloc(offsetof(SessionCacheEntry, bytes) + key->length + sessionData->length);
+    if (entry == NULL)
+        return errSecAllocate;
+    entry->chain = entry->newer = entry->older = NULL;
+    entry->hash = hash;
+    entry->expires = time(NULL) + timeToLive;
+    entry->keyLength = key->length;
+    entry->dataLength = sessionData->length;
+    memcpy(entry->bytes, key->data, key->length);
+    memcpy(entry->bytes + key->length, sessionData->data, sessionData->length);
+
+    pthread_mutex_lock(&shard->lock);
+
+    slot = SessionCacheFindSlot(shard, key, hash);
+    if (*slot) {
+        /* Replace in place, keeping our position in the chain */
+        SessionCacheEntry *old = *slot;
+        entry->chain = old->chain;
+        *slot = entry;
+        SessionCacheUnlinkLRU(shard, old);
+        sslFree(old);
+    } else {
+        if (shard->count >= shard->capacity)
+            SessionCacheRemove(shard, shard->oldest);
+        slot = &shard->buckets[hash & shard->bucketMask];
+        entry->chain = *slot;
+        *slot = entry;
+        shard->count++;
+    }
+    SessionCacheLinkNewest(shard, entry);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return errSecSuccess;
+}
+
+int SSLSessionCacheLoad(SSLSessionCacheRef cache, const SSLBuffer *key,
+                        SSLBuffer *sessionData)
+{
+    uint64_t hash = SessionCacheHash(key);
+    SessionCacheShard *shard = SessionCacheShardForHash(cache, hash);
+    SessionCacheEntry **slot;
+    int err = errSSLSessionNotFound;
+
+    pthread_mutex_lock(&shard->lock);
+
+    slot = SessionCacheFindSlot(shard, key, hash);
+    if (*slot) {
+        SessionCacheEntry *entry = *slot;
+        if (entry->expires <= time(NULL)) {
+            sslDebugLog("SSLSessionCacheLoad: session expired\n");
+            SessionCacheRemoveAt(shard, slot);
+        } else {
+            err = SSLCopyBufferFromData(entry->bytes + entry->keyLength, entry->dataLength, sessionData);
+            SessionCacheUnlinkLRU(shard, entry);
+            SessionCacheLinkNewest(shard, entry);
+        }
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return err;
+}
+
+int SSLSessionCacheDelete(SSLSessionCacheRef cache, const SSLBuffer *key)
+{
+    uint64_t hash = SessionCacheHash(key);
+    SessionCacheShard *shard = SessionCacheShardForHash(cache, hash);
+    SessionCacheEntry **slot;
+    int err = errSSLSessionNotFound;
+
+    pthread_mutex_lock(&shard->lock);
+
+    slot = SessionCacheFindSlot(shard, key, hash);
+    if (*slot) {
+        SessionCacheRemoveAt(shard, slot);
+        err = errSecSuccess;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return err;
+}
+
+void SSLSessionCacheEmpty(SSLSessionCacheRef cache)
+{
+    int i;
+
+    for (i = 0; i < SSL_SESSION_CACHE_SHARDS; i++) {
+        SessionCacheShard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        SessionCacheShardEmpty(shard);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void SSLSessionCacheCleanup(SSLSessionCacheRef cache)
+{
+    time_t now = time(NULL);
+    int i;
+
+    for (i = 0; i < SSL_SESSION_CACHE_SHARDS; i++) {
+        SessionCacheShard *shard = &cache->shards[i];
+        if (pthread_mutex_trylock(&shard->lock) != 0)
+            continue;
+        while (shard->oldest && shard->oldest->expires <= now)
+            SessionCacheRemove(shard, shard->oldest);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All Rights Reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * sslSessionCache.h - process wide cache of resumable sessions
+ *
+ * Entries are spread over a fixed number of shards by a hash of the session
+ * key, each shard having its own lock, hash table and LRU list, so that
+ * concurrent handshakes rarely contend and every operation is O(1).
+ * The cache holds at most 'capacity' sessions; adding one to a full shard
+ * evicts that shard's least recently used session.
+ */
+
+#ifndef _SSL_SESSION_CACHE_H_
+#define _SSL_SESSION_CACHE_H_ 1
+
+#include "sslTypes.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SSLSessionCache *SSLSessionCacheRef;
+
+/* Default number of sessions held when no capacity is configured */
+#define SSL_SESSION_CACHE_DEFAULT_CAPACITY  4096
+
+/* Number of shards the capacity is split over; must be a power of two */
+#define SSL_SESSION_CACHE_SHARDS            16
+
+SSLSessionCacheRef SSLSessionCacheCreate(size_t capacity);
+
+/*
+ * The process wide cache lives until exit and is never destroyed; this is
+ * for caches created for a limited time, such as by the regression tests.
+ */
+void SSLSessionCacheDestroy(SSLSessionCacheRef cache);
+
+/* Add or replace the session stored for key, valid for timeToLive seconds */
+int SSLSessionCacheSave(SSLSessionCacheRef cache, const SSLBuffer *key,
+                        const SSLBuffer *sessionData, uint32_t timeToLive);
+
+/* Copy out the session stored for key; errSSLSessionNotFound if missing or expired */
+int SSLSessionCacheLoad(SSLSessionCacheRef cache, const SSLBuffer *key,
+                        SSLBuffer *sessionData);
+
+int SSLSessionCacheDelete(SSLSessionCacheRef cache, const SSLBuffer *key);
+
+void SSLSessionCacheEmpty(SSLSessionCacheRef cache);
+
+/*
+ * Opportunistically drop expired sessions from the cold end of each shard.
+ * Stops at the first live session and skips shards that are busy, so it
+ * never walks the whole cache.
+ */
+void SSLSessionCacheCleanup(SSLSessionCacheRef cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SSL_SESSION_CACHE_H_ */
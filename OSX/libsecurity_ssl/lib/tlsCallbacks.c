@@ -33,7 +33,6 @@
 #include "utilities/SecCFRelease.h"
 
 #include <tls_helpers.h>
-#include <tls_cache.h>
 
 static
 int tls_handshake_write_callback(tls_handshake_ctx_t ctx, const SSLBuffer data, uint8_t content_type)
@@ -242,7 +241,7 @@ tls_handshake_save_session_data_callback(tls_handshake_ctx_t ctx, SSLBuffer sess
 
     sslDebugLog("%s: %p, key len=%zd, k[0]=%02x, data len=%zd\n", __FUNCTION__, myCtx, configurationSpecificKey.length, configurationSpecificKey.data[0], sessionData.length);
 
-    err = tls_cache_save_session_data(myCtx->cache, &configurationSpecificKey, &sessionData, myCtx->sessionCacheTimeout);
+    err = SSLSessionCacheSave(myCtx->cache, &configurationSpecificKey, &sessionData, myCtx->sessionCacheTimeout);
 
     free(configurationSpecificKey.data);
 
@@ -268,7 +267,7 @@ tls_handshake_load_session_data_callback(tls_handshake_ctx_t ctx, SSLBuffer sess
         return err;
     }
 
-    err = tls_cache_load_session_data(myCtx->cache, &configurationSpecificKey, &myCtx->resumableSession);
+    err = SSLSessionCacheLoad(myCtx->cache, &configurationSpecificKey, &myCtx->resumableSession);
     sslDebugLog("%p, key len=%zd, data len=%zd, err=%d\n", ctx, configurationSpecificKey.length, sessionData->length, err);
     *sessionData = myCtx->resumableSession;
 
@@ -285,7 +284,7 @@ tls_handshake_delete_session_data_callback(tls_handshake_ctx_t ctx, SSLBuffer se
 
     sslDebugLog("%p, key len=%zd k[0]=%02x\n", ctx, sessionKey.length, sessionKey.data[0]);
     if(myCtx->cache) {
-        err = tls_cache_delete_session_data(myCtx->cache, &sessionKey);
+        err = SSLSessionCacheDelete(myCtx->cache, &sessionKey);
     }
     return err;
 }
@@ -297,7 +296,7 @@ tls_handshake_delete_all_sessions_callback(tls_handshake_ctx_t ctx)
     sslDebugLog("%p\n", ctx);
 
     if(myCtx->cache) {
-        tls_cache_empty(myCtx->cache);
+        SSLSessionCacheEmpty(myCtx->cache);
     }
     return 0;
 }
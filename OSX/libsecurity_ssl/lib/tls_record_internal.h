@@ -50,9 +50,12 @@ typedef struct WaitingRecord
     /*
      * These two fields replace a dynamically allocated SSLBuffer;
      * the payload to write is contained in the variable-length
-     * array data[].
+     * array data[]. capacity is the allocated size of data[]; records
+     * queued after this one may be encrypted into the spare room so
+     * that they go out in the same write callback.
      */
     size_t					length;
+    size_t					capacity;
     uint8_t					data[1];
 } WaitingRecord;
 
@@ -66,7 +69,9 @@ struct SSLRecordInternalContext
 
     /* buffering */
     SSLBuffer    		partialReadBuffer;
-    size_t              amountRead;
+    size_t              readOffset;     /* start of the current record in partialReadBuffer */
+    size_t              amountRead;     /* bytes buffered from readOffset, may span several records */
+    bool                readAhead;      /* ask the read callback for as much as fits */
 
     WaitingRecord       *recordWriteQueue;
 };
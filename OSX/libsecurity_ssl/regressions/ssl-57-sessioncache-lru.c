@@ -0,0 +1,202 @@
+//
+//  ssl-57-sessioncache-lru.c
+//  libsecurity_ssl
+//
+//  Exercises the process session cache directly: lookup, per shard LRU
+//  eviction, expiry and deletion.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Security/SecureTransport.h>
+
+#include "../lib/sslSessionCache.h"
+
+#include "ssl_regressions.h"
+
+/* Same hash and shard selection as sslSessionCache.c */
+static unsigned key_shard(const SSLBuffer *key)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < key->length; i++) {
+        hash ^= key->data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return (unsigned)((hash >> 56) & (SSL_SESSION_CACHE_SHARDS - 1));
+}
+
+/* Session keys are 32 bytes, like a session ID; the first four vary */
+static void make_key(SSLBuffer *key, uint8_t bytes[32], uint32_t n)
+{
+    memset(bytes, 0xA5, 32);
+    memcpy(bytes, &n, sizeof(n));
+    key->data = bytes;
+    key->length = 32;
+}
+
+/* Find the next key after *n landing in the given shard */
+static void make_key_in_shard(SSLBuffer *key, uint8_t bytes[32], uint32_t *n, unsigned shard)
+{
+    do {
+        make_key(key, bytes, ++*n);
+    } while (key_shard(key) != shard);
+}
+
+static bool session_is(SSLSessionCacheRef cache, const SSLBuffer *key, const char *expected)
+{
+    SSLBuffer session = { 0, NULL };
+    bool match;
+
+    if (SSLSessionCacheLoad(cache, key, &session) != errSecSuccess)
+        return false;
+    match = session.length == strlen(expected) &&
+            memcmp(session.data, expected, session.length) == 0;
+    free(session.data);
+    return match;
+}
+
+static void test_insert_lookup(void)
+{
+    SSLSessionCacheRef cache = SSLSessionCacheCreate(0);
+    uint8_t bytes1[32], bytes2[32];
+    SSLBuffer key1, key2, session;
+
+    make_key(&key1, bytes1, 1);
+    make_key(&key2, bytes2, 2);
+
+    session.data = (uint8_t *)"first";
+    session.length = 5;
+    is(SSLSessionCacheSave(cache, &key1, &session, 600), errSecSuccess, "save first session");
+    ok(session_is(cache, &key1, "first"), "load first session");
+    is(SSLSessionCacheLoad(cache, &key2, &session), errSSLSessionNotFound, "unknown key not found");
+
+    session.data = (uint8_t *)"replaced";
+    session.length = 8;
+    is(SSLSessionCacheSave(cache, &key1, &session, 600), errSecSuccess, "replace first session");
+    ok(session_is(cache, &key1, "replaced"), "load replaced session");
+
+    SSLSessionCacheEmpty(cache);
+    is(SSLSessionCacheLoad(cache, &key1, &session), errSSLSessionNotFound, "emptied cache");
+
+    SSLSessionCacheDestroy(cache);
+}
+
+static void test_lru_eviction(void)
+{
+    /* Two sessions per shard */
+    SSLSessionCacheRef cache = SSLSessionCacheCreate(2 * SSL_SESSION_CACHE_SHARDS);
+    uint8_t bytesA[32], bytesB[32], bytesC[32], bytesD[32], bytesOther[32];
+    SSLBuffer keyA, keyB, keyC, keyD, keyOther, session;
+    uint32_t n = 0;
+    unsigned shard;
+
+    make_key(&keyA, bytesA, n);
+    shard = key_shard(&keyA);
+    make_key_in_shard(&keyB, bytesB, &n, shard);
+    make_key_in_shard(&keyC, bytesC, &n, shard);
+    make_key_in_shard(&keyD, bytesD, &n, shard);
+    do {
+        make_key(&keyOther, bytesOther, ++n);
+    } while (key_shard(&keyOther) == shard);
+
+    session.data = (uint8_t *)"A";
+    session.length = 1;
+    SSLSessionCacheSave(cache, &keyA, &session, 600);
+    session.data = (uint8_t *)"B";
+    SSLSessionCacheSave(cache, &keyB, &session, 600);
+    session.data = (uint8_t *)"X";
+    SSLSessionCacheSave(cache, &keyOther, &session, 600);
+
+    /* A lookup makes A the most recently used, so C evicts B */
+    ok(session_is(cache, &keyA, "A"), "load A");
+    session.data = (uint8_t *)"C";
+    SSLSessionCacheSave(cache, &keyC, &session, 600);
+    is(SSLSessionCacheLoad(cache, &keyB, &session), errSSLSessionNotFound, "least recently used B evicted");
+    ok(session_is(cache, &keyC, "C"), "C inserted");
+    ok(session_is(cache, &keyA, "A"), "A survives eviction");
+
+    /* A was looked up last, so D evicts C */
+    session.data = (uint8_t *)"D";
+    SSLSessionCacheSave(cache, &keyD, &session, 600);
+    is(SSLSessionCacheLoad(cache, &keyC, &session), errSSLSessionNotFound, "least recently used C evicted");
+    ok(session_is(cache, &keyA, "A"), "A still cached");
+    ok(session_is(cache, &keyD, "D"), "D inserted");
+
+    /* Eviction never touches other shards */
+    ok(session_is(cache, &keyOther, "X"), "session in another shard kept");
+
+    SSLSessionCacheDestroy(cache);
+}
+
+static void test_expiry(void)
+{
+    SSLSessionCacheRef cache = SSLSessionCacheCreate(0);
+    uint8_t bytes1[32], bytes2[32];
+    SSLBuffer key1, key2, session;
+
+    make_key(&key1, bytes1, 1);
+    make_key(&key2, bytes2, 2);
+
+    /* A zero time to live expires as soon as it is stored */
+    session.data = (uint8_t *)"expired";
+    session.length = 7;
+    is(SSLSessionCacheSave(cache, &key1, &session, 0), errSecSuccess, "save expired session");
+    is(SSLSessionCacheLoad(cache, &key1, &session), errSSLSessionNotFound, "expired session not loaded");
+    is(SSLSessionCacheDelete(cache, &key1), errSSLSessionNotFound, "expired session dropped by lookup");
+
+    /* Cleanup drops expired sessions without a lookup */
+    session.data = (uint8_t *)"expired";
+    SSLSessionCacheSave(cache, &key1, &session, 0);
+    session.data = (uint8_t *)"live";
+    session.length = 4;
+    SSLSessionCacheSave(cache, &key2, &session, 600);
+    SSLSessionCacheCleanup(cache);
+    is(SSLSessionCacheDelete(cache, &key1), errSSLSessionNotFound, "expired session dropped by cleanup");
+    ok(session_is(cache, &key2, "live"), "live session kept by cleanup");
+
+    SSLSessionCacheDestroy(cache);
+}
+
+static void test_delete(void)
+{
+    SSLSessionCacheRef cache = SSLSessionCacheCreate(0);
+    uint8_t bytes1[32], bytes2[32];
+    SSLBuffer key1, key2, session;
+
+    make_key(&key1, bytes1, 1);
+    make_key(&key2, bytes2, 2);
+
+    is(SSLSessionCacheDelete(cache, &key1), errSSLSessionNotFound, "delete from empty cache");
+
+    session.data = (uint8_t *)"session";
+    session.length = 7;
+    SSLSessionCacheSave(cache, &key1, &session, 600);
+    is(SSLSessionCacheDelete(cache, &key2), errSSLSessionNotFound, "delete missing key");
+    ok(session_is(cache, &key1, "session"), "other session untouched");
+    is(SSLSessionCacheDelete(cache, &key1), errSecSuccess, "delete cached key");
+    is(SSLSessionCacheDelete(cache, &key1), errSSLSessionNotFound, "delete key twice");
+    is(SSLSessionCacheLoad(cache, &key1, &session), errSSLSessionNotFound, "deleted session not loaded");
+
+    SSLSessionCacheDestroy(cache);
+}
+
+static void tests(void)
+{
+    test_insert_lookup();
+    test_lru_eviction();
+    test_expiry();
+    test_delete();
+}
+
+int ssl_57_sessioncache_lru(int argc, char *const *argv)
+{
+    plan_tests(6 + 8 + 5 + 6);
+
+    tests();
+
+    return 0;
+}
@@ -0,0 +1,395 @@
+//
+//  ssl-58-readahead.c
+//  libsecurity_ssl
+//
+//  Record layer read ahead and coalescing of queued writes.
+//
+
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <dispatch/dispatch.h>
+
+#include <AssertMacros.h>
+#include <Security/SecureTransportPriv.h> /* SSLSetReadAheadEnabled */
+#include <Security/SecureTransport.h>
+#include <Security/SecRandom.h>
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "ssl_regressions.h"
+#include "ssl-utils.h"
+
+#include <tls_stream_parser.h>
+
+#define MAX_RECORDS     16
+
+/*
+ * The server only starts writing once the client is done with the handshake,
+ * and the client only starts reading once everything has been written, so
+ * that what each read callback returns does not depend on thread scheduling.
+ * The socket buffers are made large enough to hold all of it.
+ */
+#define SOCKET_BUFFER_SIZE  (256 * 1024)
+
+typedef struct {
+    SSLContextRef st;
+    bool is_server;
+    int comm;
+    dispatch_semaphore_t handshake_done;
+    dispatch_semaphore_t data_written;
+    const uint8_t *data;
+    uint8_t *received;
+    size_t data_size;
+    size_t write_size;
+    bool counting;
+    int reads;
+    int writes;
+    tls_stream_parser_t parser;
+    int records;
+    size_t record_lengths[MAX_RECORDS];
+} ssl_test_handle;
+
+typedef struct {
+    intptr_t server_err;
+    intptr_t client_err;
+    bool data_ok;
+    int reads;
+    int writes;
+    int records;
+    size_t record_lengths[MAX_RECORDS];
+} transfer_result;
+
+
+#pragma mark -
+#pragma mark SecureTransport support
+
+static OSStatus SocketWrite(SSLConnectionRef h, const void *data, size_t *length)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)h;
+    int conn = handle->comm;
+    size_t len = *length;
+    uint8_t *ptr = (uint8_t *)data;
+
+    if (handle->counting) {
+        tls_buffer buffer;
+        buffer.data = ptr;
+        buffer.length = len;
+        tls_stream_parser_parse(handle->parser, buffer);
+        handle->writes++;
+    }
+
+    do {
+        ssize_t ret;
+        do {
+            ret = write((int)conn, ptr, len);
+        } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+        if (ret > 0) {
+            len -= ret;
+            ptr += ret;
+        }
+        else
+            return -36;
+    } while (len > 0);
+
+    *length = *length - len;
+    return errSecSuccess;
+}
+
+/* A single read(), as a read ahead capable callback must never wait for more than is there */
+static OSStatus SocketRead(SSLConnectionRef h, void *data, size_t *length)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)h;
+    int conn = handle->comm;
+    ssize_t ret;
+
+    do {
+        ret = read((int)conn, data, *length);
+    } while ((ret < 0) && (errno == EAGAIN || errno == EINTR));
+    if (ret <= 0) {
+        *length = 0;
+        return -36;
+    }
+
+    if (handle->counting)
+        handle->reads++;
+
+    if ((size_t)ret < *length) {
+        *length = ret;
+        return errSSLWouldBlock;
+    }
+    return errSecSuccess;
+}
+
+static int process(tls_stream_parser_ctx_t ctx, tls_buffer record)
+{
+    ssl_test_handle *handle = (ssl_test_handle *)ctx;
+
+    if (record.data[0] == tls_record_type_AppData && handle->records < MAX_RECORDS)
+        handle->record_lengths[handle->records++] = record.length;
+
+    return 0;
+}
+
+static void *securetransport_ssl_thread(void *arg)
+{
+    OSStatus ortn;
+    ssl_test_handle * ssl = (ssl_test_handle *)arg;
+    SSLContextRef ctx = ssl->st;
+    bool got_server_auth = false;
+
+    do {
+        ortn = SSLHandshake(ctx);
+
+        if (ortn == errSSLServerAuthCompleted)
+        {
+            require_string(!got_server_auth, out, "second server auth");
+            got_server_auth = true;
+        }
+    } while (ortn == errSSLWouldBlock
+             || ortn == errSSLServerAuthCompleted);
+
+    require_noerr_action_quiet(ortn, out,
+                               fprintf(stderr, "Fell out of SSLHandshake with error: %d\n", (int)ortn));
+
+    if (ssl->is_server) {
+        size_t sent = 0, len;
+
+        dispatch_semaphore_wait(ssl->handshake_done, DISPATCH_TIME_FOREVER);
+        ssl->counting = true;
+        while (sent < ssl->data_size) {
+            size_t size = ssl->data_size - sent;
+            if (size > ssl->write_size)
+                size = ssl->write_size;
+            require_noerr(ortn = SSLWrite(ctx, ssl->data + sent, size, &len), out);
+            require_action(len == size, out, ortn = -1);
+            sent += len;
+        }
+        ssl->counting = false;
+        dispatch_semaphore_signal(ssl->data_written);
+    } else {
+        size_t received = 0, len;
+
+        dispatch_semaphore_signal(ssl->handshake_done);
+        dispatch_semaphore_wait(ssl->data_written, DISPATCH_TIME_FOREVER);
+        ssl->counting = true;
+        while (received < ssl->data_size) {
+            ortn = SSLRead(ctx, ssl->received + received, ssl->data_size - received, &len);
+            received += len;
+            if (ortn == errSSLWouldBlock)
+                continue;
+            require_noerr(ortn, out);
+        }
+        ssl->counting = false;
+    }
+
+out:
+    /* Don't leave the peer waiting if we failed halfway */
+    if (ssl->is_server)
+        dispatch_semaphore_signal(ssl->data_written);
+    else
+        dispatch_semaphore_signal(ssl->handshake_done);
+    SSLClose(ctx);
+    close(ssl->comm);
+    pthread_exit((void *)(intptr_t)ortn);
+    return NULL;
+}
+
+static void
+ssl_test_handle_destroy(ssl_test_handle *handle)
+{
+    if(handle) {
+        if(handle->parser) tls_stream_parser_destroy(handle->parser);
+        if(handle->st) CFRelease(handle->st);
+        free(handle->received);
+        free(handle);
+    }
+}
+
+static ssl_test_handle *
+ssl_test_handle_create(bool server, int comm, CFArrayRef certs)
+{
+    ssl_test_handle *handle = calloc(1, sizeof(ssl_test_handle));
+    SSLContextRef ctx = SSLCreateContext(kCFAllocatorDefault, server?kSSLServerSide:kSSLClientSide, kSSLStreamType);
+    int size = SOCKET_BUFFER_SIZE;
+
+    require(handle, out);
+    require(ctx, out);
+
+    require_noerr(setsockopt(comm, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)), out);
+    require_noerr(setsockopt(comm, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)), out);
+
+    require_noerr(SSLSetIOFuncs(ctx,
+                                (SSLReadFunc)SocketRead, (SSLWriteFunc)SocketWrite), out);
+    require_noerr(SSLSetConnection(ctx, (SSLConnectionRef)handle), out);
+
+    if (server)
+        require_noerr(SSLSetCertificate(ctx, certs), out);
+
+    require_noerr(SSLSetSessionOption(ctx,
+                                      kSSLSessionOptionBreakOnServerAuth, true), out);
+
+    /* Tell SecureTransport to not check certs itself: it will break out of the
+     handshake to let us take care of it instead. */
+    require_noerr(SSLSetEnableCertVerify(ctx, false), out);
+
+    /* Fix the record sizes: TLS 1.2 has no 1/n-1 split */
+    require_noerr(SSLSetProtocolVersionMax(ctx, kTLSProtocol12), out);
+
+    handle->is_server = server;
+    handle->comm = comm;
+    handle->st = ctx;
+    handle->parser = tls_stream_parser_create(handle, process);
+
+    return handle;
+
+out:
+    if (handle) free(handle);
+    if (ctx) CFRelease(ctx);
+    return NULL;
+}
+
+static SSLCipherSuite cipher = TLS_RSA_WITH_AES_128_CBC_SHA;
+
+/*
+ * Send data_size random bytes from server to client, write_size bytes per
+ * SSLWrite, and collect what the client's read callback and the server's
+ * write callback saw while the data went through.
+ */
+static void
+transfer(CFArrayRef server_certs, bool read_ahead, size_t data_size, size_t write_size,
+         transfer_result *result)
+{
+    pthread_t client_thread, server_thread;
+    dispatch_semaphore_t handshake_done = dispatch_semaphore_create(0);
+    dispatch_semaphore_t data_written = dispatch_semaphore_create(0);
+    ssl_test_handle *server = NULL, *client = NULL;
+    uint8_t *data = malloc(data_size);
+    int sp[2];
+
+    memset(result, 0, sizeof(*result));
+    result->server_err = result->client_err = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp)) exit(errno);
+    fcntl(sp[0], F_SETNOSIGPIPE, 1);
+    fcntl(sp[1], F_SETNOSIGPIPE, 1);
+
+    server = ssl_test_handle_create(true /*server*/, sp[0], server_certs);
+    client = ssl_test_handle_create(false/*client*/, sp[1], NULL);
+
+    require(data, out);
+    require(client, out);
+    require(server, out);
+    client->received = malloc(data_size);
+    require(client->received, out);
+    require_noerr(SecRandomCopyBytes(kSecRandomDefault, data_size, data), out);
+
+    require_noerr(SSLSetEnabledCiphers(client->st, &cipher, 1), out);
+    if (read_ahead)
+        require_noerr(SSLSetReadAheadEnabled(client->st, true), out);
+
+    server->handshake_done = client->handshake_done = handshake_done;
+    server->data_written = client->data_written = data_written;
+    server->data = data;
+    server->data_size = client->data_size = data_size;
+    server->write_size = write_size;
+
+    pthread_create(&client_thread, NULL, securetransport_ssl_thread, client);
+    pthread_create(&server_thread, NULL, securetransport_ssl_thread, server);
+
+    pthread_join(client_thread, (void*)&result->client_err);
+    pthread_join(server_thread, (void*)&result->server_err);
+
+    result->data_ok = memcmp(data, client->received, data_size) == 0;
+    result->reads = client->reads;
+    result->writes = server->writes;
+    result->records = server->records;
+    memcpy(result->record_lengths, server->record_lengths, sizeof(result->record_lengths));
+
+out:
+    ssl_test_handle_destroy(client);
+    ssl_test_handle_destroy(server);
+    dispatch_release(handshake_done);
+    dispatch_release(data_written);
+    free(data);
+}
+
+static void
+tests(void)
+{
+    CFArrayRef server_certs = server_chain();
+    ok(server_certs, "got server certs");
+
+    SSLContextRef ctx = SSLCreateContext(kCFAllocatorDefault, kSSLClientSide, kSSLStreamType);
+    bool enabled = true;
+    ok(ctx && SSLGetReadAheadEnabled(ctx, &enabled) == errSecSuccess && !enabled, "read ahead off by default");
+    CFReleaseSafe(ctx);
+
+    transfer_result result, separate;
+
+    /* Eight small records, all waiting in the socket: one read callback for all of them */
+    transfer(server_certs, true, 8 * 100, 100, &result);
+    ok(!result.server_err, "Server error = %ld", result.server_err);
+    ok(!result.client_err, "Client error = %ld", result.client_err);
+    ok(result.data_ok, "read ahead: data received intact");
+    is(result.reads, 1, "read ahead: several records delivered in one read");
+
+    /* Without read ahead, each record still takes a read for its header and one for its body */
+    transfer(server_certs, false, 8 * 100, 100, &result);
+    ok(!result.server_err, "Server error = %ld", result.server_err);
+    ok(!result.client_err, "Client error = %ld", result.client_err);
+    ok(result.data_ok, "no read ahead: data received intact");
+    is(result.reads, 2 * 8, "no read ahead: header and body read separately");
+
+    /*
+     * Six full size records don't fit in the read ahead buffer, which holds a
+     * little over four: the first read stops in the middle of the fifth record,
+     * and the second read completes it along with the sixth.
+     */
+    transfer(server_certs, true, 6 * 16384, 6 * 16384, &result);
+    ok(!result.server_err, "Server error = %ld", result.server_err);
+    ok(!result.client_err, "Client error = %ld", result.client_err);
+    ok(result.data_ok, "read ahead: record split across reads received intact");
+    is(result.reads, 2, "read ahead: partial record at the end of the buffer completed by the next read");
+
+    /*
+     * A single SSLWrite of four full size records reaches the write callback
+     * in one call, as the same records written by four SSLWrite calls.
+     */
+    transfer(server_certs, false, 4 * 16384, 4 * 16384, &result);
+    ok(!result.server_err, "Server error = %ld", result.server_err);
+    ok(!result.client_err, "Client error = %ld", result.client_err);
+    ok(result.data_ok, "coalesced writes: data received intact");
+    transfer(server_certs, false, 4 * 16384, 16384, &separate);
+    ok(!separate.server_err, "Server error = %ld", separate.server_err);
+    ok(!separate.client_err, "Client error = %ld", separate.client_err);
+    ok(separate.data_ok, "separate writes: data received intact");
+
+    is(result.writes, 1, "coalesced writes: one write callback");
+    is(separate.writes, 4, "separate writes: one write callback per record");
+    is(result.records, 4, "coalesced writes: four data records");
+    is(separate.records, 4, "separate writes: four data records");
+    ok(memcmp(result.record_lengths, separate.record_lengths, sizeof(result.record_lengths)) == 0,
+       "coalesced and separate writes produce the same records");
+
+    CFReleaseNull(server_certs);
+}
+
+int ssl_58_readahead(int argc, char *const *argv)
+{
+
+    plan_tests(2 + 4 + 4 + 4 + 11);
+
+
+    tests();
+
+    return 0;
+}
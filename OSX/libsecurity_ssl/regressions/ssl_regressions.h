@@ -33,4 +33,6 @@ ONE_TEST(ssl_53_clientauth)
 ONE_TEST(ssl_54_dhe)
 ONE_TEST(ssl_55_sessioncache)
 ONE_TEST(ssl_56_renegotiate)
+ONE_TEST(ssl_57_sessioncache_lru)
+ONE_TEST(ssl_58_readahead)
 
@@ -50,6 +50,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonDigest.h>
 #include <sys/stat.h>
 #import "NSData+HexString.h"
 #include <CoreFoundation/CFBase.h>
@@ -4238,6 +4239,126 @@ static SecTransformInstanceBlock ErrorResultsTest(CFStringRef name,
 	CFRelease(err);
 }
 
+// Null -> Null -> Digest is a linear chain of built-in transforms, so it runs fused (see GroupTransform::FuseLinearChains)
+static SecGroupTransformRef fused_digest_chain(SecTransformRef source, SecTransformRef *middle)
+{
+	SecGroupTransformRef group = SecTransformCreateGroupTransform();
+	SecTransformRef a = SecNullTransformCreate();
+	SecTransformRef b = SecNullTransformCreate();
+	SecTransformRef c = SecDigestTransformCreate(kSecDigestSHA1, 0, NULL);
+	
+	SecTransformConnectTransforms(source, kSecTransformOutputAttributeName, a, kSecTransformInputAttributeName, group, NULL);
+	SecTransformConnectTransforms(a, kSecTransformOutputAttributeName, b, kSecTransformInputAttributeName, group, NULL);
+	SecTransformConnectTransforms(b, kSecTransformOutputAttributeName, c, kSecTransformInputAttributeName, group, NULL);
+	
+	if (middle) {
+		*middle = b;
+	}
+	CFRelease(a);
+	CFRelease(b);
+	CFRelease(c);
+	return group;
+}
+
+-(void)testFusedChain
+{
+	// Enough data that the stream source sends many chunks through the fused links
+	const size_t size = 4 * 1024 * 1024;
+	UInt8 *bytes = (UInt8 *)malloc(size);
+	for (size_t i = 0; i < size; i++) {
+		bytes[i] = (UInt8)(i * 7);
+	}
+	unsigned char expected[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1(bytes, (CC_LONG)size, expected);
+	
+	CFReadStreamRef stream = CFReadStreamCreateWithBytesNoCopy(NULL, bytes, size, kCFAllocatorNull);
+	SecTransformRef source = SecTransformCreateReadTransformWithReadStream(stream);
+	SecGroupTransformRef group = fused_digest_chain(source, NULL);
+	
+	CFErrorRef error = NULL;
+	CFDataRef digest = (CFDataRef)SecTransformExecute(group, &error);
+	STAssertNil((id)error, @"fused chain failed: %@", error);
+	STAssertNotNil((id)digest, @"fused chain produced no result");
+	if (digest) {
+		STAssertEquals(CFDataGetLength(digest), (CFIndex)CC_SHA1_DIGEST_LENGTH, @"wrong digest length");
+		STAssertTrue(0 == memcmp(CFDataGetBytePtr(digest), expected, CC_SHA1_DIGEST_LENGTH), @"fused chain computed the wrong digest");
+		CFRelease(digest);
+	}
+	
+	CFRelease(group);
+	CFRelease(source);
+	CFRelease(stream);
+	free(bytes);
+}
+
+-(void)testFusedChainError
+{
+	// The error is sent into the head of the fused chain and has to cross both fused links
+	CFStringRef name = CFSTR("com.apple.security.unit-test.error-results");
+	SecTransformRegister(name, &ErrorResultsTest, NULL);
+	SecTransformRef source = SecTransformCreate(name, NULL);
+	CFDataRef data = CFDataCreate(NULL, (const UInt8 *)"fused", 5);
+	SecTransformSetAttribute(source, kSecTransformInputAttributeName, data, NULL);
+	SecGroupTransformRef group = fused_digest_chain(source, NULL);
+	
+	CFErrorRef err = NULL;
+	CFTypeRef no_result = SecTransformExecute(group, &err);
+	
+	STAssertNil((id)no_result, @"No result from a chain fed an error");
+	STAssertErrorHas((id)err, @"expected error", @"Signaled error made it through the fused chain");
+	
+	CFReleaseNull(err);
+	CFRelease(group);
+	CFRelease(source);
+	CFRelease(data);
+}
+
+-(void)testFusedChainAbort
+{
+	// Data goes through the fused links but end of stream never does, so only the ABORT sent
+	// into the middle of the chain can finish it.
+	SecTransformCreateBlock noEOS = ^(CFStringRef name, SecTransformRef new_transform, const SecTransformCreateBlockParameters *params) {
+		params->overrideAttribute(kSecTransformActionAttributeNotification, kSecTransformInputAttributeName, ^(SecTransformAttributeRef attribute, CFTypeRef value) {
+			if (value) {
+				params->send(kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, value);
+			}
+			return value;
+		});
+	};
+	SecTransformRef source = custom_transform(CFSTR("com.apple.security.unit-test.fused-no-eos"), noEOS);
+	STAssertNotNil((id)source, @"custom_transform failed");
+	CFDataRef data = CFDataCreate(NULL, (const UInt8 *)"fused", 5);
+	SecTransformSetAttribute(source, kSecTransformInputAttributeName, data, NULL);
+	
+	SecTransformRef middle = NULL;
+	SecGroupTransformRef group = fused_digest_chain(source, &middle);
+	
+	// the delay transform sleeps for (and then passes on) any number it is sent
+	SecTransformRef dt = delay_transform(NSEC_PER_SEC / 10);
+	long long delay = NSEC_PER_SEC / 10;
+	CFNumberRef delayRef = CFNumberCreate(NULL, kCFNumberLongLongType, &delay);
+	SecTransformSetAttribute(dt, kSecTransformInputAttributeName, delayRef, NULL);
+	SecTransformConnectTransforms(dt, kSecTransformOutputAttributeName, middle, kSecTransformAbortAttributeName, group, NULL);
+	
+	CFErrorRef error = NULL;
+	CFTypeRef no_result = SecTransformExecute(group, &error);
+	
+	STAssertNil((id)no_result, @"Didn't expect a result from an aborted fused chain");
+	STAssertNotNil((id)error, @"Expected error from execute");
+	if (error) {
+		CFDictionaryRef userDictionary = CFErrorCopyUserInfo(error);
+		STAssertNotNil((id) CFDictionaryGetValue(userDictionary, kSecTransformAbortOriginatorKey), @"Originating transform not listed.");
+		CFRelease(userDictionary);
+		CFRelease(error);
+	}
+	
+	CFRelease(delayRef);
+	CFRelease(dt);
+	CFRelease(group);
+	CFRelease(source);
+	CFRelease(data);
+}
+
 -(void)testErrorExecutesInRightQueue {
 	// testExecuteBlock checks to see if blocks are generally executed on the proper queue, this specifically checks
 	// for an error while starting (which was originally improperly coded).
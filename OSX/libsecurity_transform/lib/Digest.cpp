@@ -499,6 +499,15 @@ TransformFactory* DigestTransform::MakeTransformFactory()
 
 
 
+bool DigestTransform::IsFusable()
+{
+	// digesting is pure computation on the calling thread, so a digest can
+	// share a queue with its neighbours
+	return true;
+}
+
+
+
 CFDictionaryRef DigestTransform::CopyState()
 {
 	return mDigest->CopyState();
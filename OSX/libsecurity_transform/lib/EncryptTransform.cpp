@@ -895,6 +895,16 @@ void EncryptDecryptBase::AttributeChanged(SecTransformAttributeRef ah, CFTypeRef
 
 }
 
+/* --------------------------------------------------------------------------
+ method: 		IsFusable
+ description: 	Encrypt and decrypt only call into CSSM from AttributeChanged,
+ 				so they can run on a queue shared with their neighbours
+ -------------------------------------------------------------------------- */
+bool EncryptDecryptBase::IsFusable()
+{
+	return true;
+}
+
 /* --------------------------------------------------------------------------
  method: 		CopyState
  description: 	Copy the current state of this transform
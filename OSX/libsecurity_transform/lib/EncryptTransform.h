@@ -85,6 +85,9 @@ public:
 	
 	// your own routines
 	virtual bool 			InitializeObject(SecKeyRef key, CFErrorRef *error);
+
+	// AttributeChanged never waits on another transform's queue
+	virtual bool			IsFusable();
 	
 	
 };
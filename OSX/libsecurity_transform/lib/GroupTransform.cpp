@@ -343,6 +343,77 @@ CFDictionaryRef GroupTransform::Externalize(CFErrorRef* error)
 	return NULL;
 }
 
+// Find runs of fusable transforms where each one's OUTPUT feeds only the next one's INPUT, and
+// nothing else feeds that INPUT (e.g. decode -> decrypt -> digest), and let every run share one
+// serial queue.  Values then go from stage to stage with a direct call instead of a dispatch_async
+// per stage (see Transform::SetAttributeNoCallback).
+void GroupTransform::FuseLinearChains()
+{
+	CFMutableArrayRef nodes = CFArrayCreateMutable(NULL, 0, NULL);
+	CFMutableDictionaryRef incoming = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+	
+	ForAllNodes(false, false, ^(Transform *t) {
+		CFArrayAppendValue(nodes, t);
+		
+		CFIndex i, numAttributes = t->GetAttributeCount();
+		transform_attribute **attributes = (transform_attribute **)alloca(numAttributes * sizeof(transform_attribute *));
+		t->TAGetAll(attributes);
+		for (i = 0; i < numAttributes; ++i) {
+			CFIndex j, numConnections = attributes[i]->connections ? CFArrayGetCount(attributes[i]->connections) : 0;
+			for (j = 0; j < numConnections; ++j) {
+				const void *ah = CFArrayGetValueAtIndex(attributes[i]->connections, j);
+				intptr_t count = (intptr_t)CFDictionaryGetValue(incoming, ah);
+				CFDictionarySetValue(incoming, ah, (const void *)(count + 1));
+			}
+		}
+		return (CFErrorRef)NULL;
+	});
+	
+	// next maps a transform to its fusable successor, hasPrevious marks the ones that have a predecessor
+	CFMutableDictionaryRef next = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+	CFMutableSetRef hasPrevious = CFSetCreateMutable(NULL, 0, NULL);
+	CFIndex i, numNodes = CFArrayGetCount(nodes);
+	for (i = 0; i < numNodes; ++i) {
+		Transform *t = (Transform *)CFArrayGetValueAtIndex(nodes, i);
+		transform_attribute *output = t->getTA(kSecTransformOutputAttributeName, false);
+		if (!t->IsFusable() || !output || !output->connections || CFArrayGetCount(output->connections) != 1) {
+			continue;
+		}
+		
+		const void *ah = CFArrayGetValueAtIndex(output->connections, 0);
+		transform_attribute *input = ah2ta(ah);
+		Transform *u = input->transform;
+		if (u == NULL || u == t || !u->IsFusable() || u->mFusedQueue ||
+			CFStringCompare(input->name, kSecTransformInputAttributeName, 0) != kCFCompareEqualTo ||
+			(intptr_t)CFDictionaryGetValue(incoming, ah) != 1) {
+			continue;
+		}
+		
+		CFDictionarySetValue(next, t, u);
+		CFSetAddValue(hasPrevious, u);
+	}
+	
+	for (i = 0; i < numNodes; ++i) {
+		Transform *t = (Transform *)CFArrayGetValueAtIndex(nodes, i);
+		if (CFSetContainsValue(hasPrevious, t) || !CFDictionaryContainsKey(next, t)) {
+			// not the head of a chain (a cycle has no head, and is left alone)
+			continue;
+		}
+		
+		dispatch_queue_t fusedQueue = CreateFusedQueue(t->GetName());
+		for (Transform *member = t; member != NULL; member = (Transform *)CFDictionaryGetValue(next, member)) {
+			Debug("fusing %@ into %s\n", member->GetName(), dispatch_queue_get_label(fusedQueue));
+			member->JoinFusedQueue(fusedQueue);
+		}
+		dispatch_release(fusedQueue);
+	}
+	
+	CFReleaseNull(hasPrevious);
+	CFReleaseNull(next);
+	CFReleaseNull(incoming);
+	CFReleaseNull(nodes);
+}
+
 // Visit all children once.   Unlike ForAllNodes there is no way to early exit, nor a way to return a status.
 // Returns when all work is scheduled, use group to determine completion of work.
 // See also ForAllNodes below.
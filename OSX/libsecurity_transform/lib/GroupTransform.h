@@ -50,6 +50,9 @@ public:
 	
     CFErrorRef ForAllNodes(bool parallel, bool opExecutesOnGroups, Transform::TransformOperation op);
 	void ForAllNodesAsync(bool opExecutesOnGroups, dispatch_group_t group, Transform::TransformAsyncOperation op);
+	
+	// Put each straight OUTPUT->INPUT run of fusable transforms on a single queue (called once, just before execution)
+	void FuseLinearChains();
 
     CFStringRef DotForDebugging();
 };
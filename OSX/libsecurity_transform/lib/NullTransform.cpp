@@ -24,6 +24,13 @@ void NullTransform::AttributeChanged(CFStringRef name, CFTypeRef value)
 
 
 
+bool NullTransform::IsFusable()
+{
+	return true;
+}
+
+
+
 std::string NullTransform::DebugDescription()
 {
 	return Transform::DebugDescription() + ": NullTransform";
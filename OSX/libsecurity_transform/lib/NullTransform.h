@@ -19,6 +19,7 @@ public:
 	static TransformFactory* MakeTransformFactory();
 	
 	virtual void AttributeChanged(CFStringRef name, CFTypeRef value);
+	virtual bool IsFusable();
 };
 
 
@@ -17,8 +17,9 @@ static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 		{
 		}
 		
-		// define the storage for our block
-		__block CFIndex blockSize = 4096;  // make a default block size
+		// define the storage for our block; unless a size is set explicitly, it adapts to the stream
+		__block CFIndex blockSize = ReadBufferInitialSize();
+		__block bool adaptiveBlockSize = true;
 		
 		// it's not necessary to set the input stream size
 		SecTransformCustomSetAttribute(ref, kStreamMaxSize, kSecTransformMetaAttributeRequired, kCFBooleanFalse);
@@ -28,6 +29,7 @@ static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 		^(SecTransformAttributeRef attribute, CFTypeRef value)
 		{
 			CFNumberGetValue((CFNumberRef) value, kCFNumberCFIndexType, &blockSize);
+			adaptiveBlockSize = false;
 			return value;
 		});
 		
@@ -76,27 +78,41 @@ static SecTransformInstanceBlock StreamTransformImplementation(CFStringRef name,
 				break;
 			}		
 			
-			// allocate the read buffer on the heap
-			u_int8_t* buffer = (u_int8_t*) malloc(blockSize);
+			// get a read buffer from the pool
+			u_int8_t* buffer = NULL;
 			
 			CFIndex bytesRead;
 			
-			bytesRead = CFReadStreamRead(input, buffer, blockSize);
-			while (bytesRead > 0)
+			do
 			{
-				// make data from what was read
-				CFDataRef value = CFDataCreate(NULL, buffer, bytesRead);
-				
-				// send it down the chain
-				SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, value);
-				
-				// cleanup
-				CFReleaseNull(value);
+				if (buffer == NULL)
+				{
+					buffer = ReadBufferAcquire(blockSize);
+				}
 				
 				bytesRead = CFReadStreamRead(input, buffer, blockSize);
-			}
+				if (bytesRead > 0)
+				{
+					// make data from what was read; full buffers are passed along without a copy
+					CFDataRef value = ReadBufferCreateData(&buffer, blockSize, bytesRead);
+					
+					// send it down the chain
+					SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, value);
+					
+					// cleanup
+					CFReleaseNull(value);
+					
+					CFIndex nextSize = adaptiveBlockSize ? ReadBufferNextSize(input, blockSize, bytesRead) : blockSize;
+					if (nextSize != blockSize)
+					{
+						ReadBufferRelinquish(buffer);
+						buffer = NULL;
+						blockSize = nextSize;
+					}
+				}
+			} while (bytesRead > 0);
 			
-			free(buffer);
+			ReadBufferRelinquish(buffer);
 			
 			SecTransformCustomSetAttribute(ref, kSecTransformOutputAttributeName, kSecTransformMetaAttributeValue, (CFTypeRef) NULL);
 			
@@ -2,13 +2,12 @@
 #include <string>
 #include "misc.h"
 #include "SecCFRelease.h"
+#include "Utilities.h"
 
 using namespace std;
 
 CFStringRef gStreamSourceName = CFSTR("StreamSource");
 
-const CFIndex kMaximumSize = 2048;
-
 StreamSource::StreamSource(CFReadStreamRef input, Transform* transform, CFStringRef name)
 	: Source(gStreamSourceName, transform, name),
 	mReadStream(input),
@@ -21,19 +20,24 @@ StreamSource::StreamSource(CFReadStreamRef input, Transform* transform, CFString
 void StreamSource::BackgroundActivate()
 {
 	CFIndex result = 0;
+	CFIndex blockSize = ReadBufferInitialSize();
+	UInt8* buffer = NULL;
 	
 	do
 	{
-		// make a buffer big enough to handle the object
-		// NOTE: allocating this on the stack and letting CFDataCreate copy it is _faster_ then malloc and CFDataCreateWithBytes(..., kCFAllactorMalloc) by a fair margin.   At least for 2K chunks.   Retest if changing the size.
-		UInt8 buffer[kMaximumSize];
+		// Reads start small and grow while the stream keeps filling them; full buffers are handed
+		// down the chain without a copy and come back to the read buffer pool when released.
+		if (buffer == NULL)
+		{
+			buffer = ReadBufferAcquire(blockSize);
+		}
 		
-		result = CFReadStreamRead(mReadStream, buffer, kMaximumSize);
+		result = CFReadStreamRead(mReadStream, buffer, blockSize);
 		
 		if (result > 0) // was data returned?
 		{
 			// make the data and send it to the transform
-			CFDataRef data = CFDataCreate(NULL, buffer, result);
+			CFDataRef data = ReadBufferCreateData(&buffer, blockSize, result);
 
 			CFErrorRef error = mDestination->SetAttribute(mDestinationName, data);
 			
@@ -41,11 +45,22 @@ void StreamSource::BackgroundActivate()
 
 			if (error != NULL) // we have a problem, there was probably an abort on the chain
 			{
+				ReadBufferRelinquish(buffer);
 				return; // quiesce the source
 			}
+			
+			CFIndex nextSize = ReadBufferNextSize(mReadStream, blockSize, result);
+			if (nextSize != blockSize)
+			{
+				ReadBufferRelinquish(buffer);
+				buffer = NULL;
+				blockSize = nextSize;
+			}
 		}
 	} while (result > 0);
 	
+	ReadBufferRelinquish(buffer);
+	
 	if (result < 0)
 	{
 		// we got an error!
@@ -22,6 +22,14 @@ static CFTypeID internalID = _kCFRuntimeNotATypeID;
 // a transforms master, activation, or any attribute queue to the Transform*
 static unsigned char dispatchQueueToTransformKey;
 
+// Use &fusedQueueKey as a key to dispatch_get_specific to find the fused queue (if any) we are running on
+static unsigned char fusedQueueKey;
+
+// While a member of a fused chain has its Do called directly from a neighbour (see Transform::FusedDo),
+// that member and the chain's fused queue.  Only meaningful while running on that fused queue.
+static __thread Transform *fusedRunningTransform;
+static __thread dispatch_queue_t fusedRunningQueue;
+
 static char RandomChar()
 {
 	return arc4random() % 26 + 'A'; // good enough
@@ -229,6 +237,7 @@ SecTransformAttributeRef Transform::getAH(SecTransformStringOrAttributeRef attri
 		ta->direct_error_handling = 0;
 		ta->allow_external_sets = 0;
 		ta->has_been_deferred = 0;
+		ta->fused_backlog = 0;
 		ta->attribute_changed_block = NULL;
 		ta->attribute_validate_block = NULL;
 	}
@@ -340,6 +349,7 @@ Transform::Transform(CFStringRef transformType, CFStringRef CFobjectType) :
 	mAttributes = NULL;
 	mPushedback = NULL;
 	mProcessingPushbacks = FALSE;
+	mFusedQueue = NULL;
 	
 	if (internalID == _kCFRuntimeNotATypeID) {
 		(void)SecTransformNoData();
@@ -480,7 +490,7 @@ void Transform::Finalize()
 	dispatch_block_t mark_as_finalizing = ^{ this->mIsFinalizing = true; };
     
 	// Mark the transform as "finalizing" so it knows not to propagate values across connections
-    if (this == dispatch_get_specific(&dispatchQueueToTransformKey)) {
+    if (this == RunningTransform() || InFusedContext()) {
         mark_as_finalizing();
     } else {
         dispatch_sync(mDispatchQueue, mark_as_finalizing);
@@ -507,6 +517,11 @@ Transform::~Transform()
 	// See if we can catch anything using us after our death
 	mDispatchQueue = (dispatch_queue_t)0xdeadbeef;
 	
+	if (mFusedQueue) {
+		dispatch_release(mFusedQueue);
+		mFusedQueue = NULL;
+	}
+	
 	CFReleaseNull(mTypeName);
 	
 	if (NULL != mPushedback)
@@ -638,7 +653,7 @@ CFErrorRef Transform::RefactorErrorToIncludeAbortingTransform(CFErrorRef sourceE
 void Transform::AbortJustThisTransform(CFErrorRef abortErr)
 {
     (void)transforms_assume(abortErr);
-    (void)transforms_assume(dispatch_get_specific(&dispatchQueueToTransformKey) == this);
+    (void)transforms_assume(RunningTransform() == this);
     
     Boolean wasActive = mIsActive;
 
@@ -919,7 +934,13 @@ CFErrorRef Transform::SetAttributeNoCallback(SecTransformStringOrAttributeRef ke
 			Transform *tt = ah2ta(ah)->transform;
 			if (NULL != tt)
 			{
-				if (tt->mIsActive)
+				if (tt->CanTakeFusedValue(ah2ta(ah)))
+				{
+					// Same fused chain and nothing holding this value back, so run the next stage
+					// right here instead of hopping through its attribute queue.
+					tt->FusedDo(ah, value);
+				}
+				else if (tt->mIsActive)
 				{
 					tt->SetAttribute(ah, value);
 				}
@@ -1007,17 +1028,29 @@ CFErrorRef Transform::SetAttribute(CFTypeRef key, CFTypeRef value)
     CFRetainSafe(value); // if we use dispatch_async we need to own the value (the matching release is in the set block)
 	
 	transform_attribute *ta = ah2ta(ah);
+	
+	// A sender in our own fused chain holds the queue ta->q drains on, so it must neither
+	// wait for that to happen nor let a later direct Do overtake this value.
+	bool fused = InFusedContext();
+	if (fused) {
+		ta->fused_backlog++;
+	}
 
 	dispatch_block_t set = ^{
+		if (fused) {
+			ta->fused_backlog--;
+		}
 		Do(ah, value);
-		dispatch_semaphore_signal(ta->semaphore);
+		if (!fused) {
+			dispatch_semaphore_signal(ta->semaphore);
+		}
         CFReleaseSafe(value);
 	};
 	
 	
 	// when the transform is active, set attributes asynchronously.  Otherwise, we are doing
 	// initialization and must wait for the operation to complete.
-	if (mIsActive)
+	if (mIsActive || fused)
 	{
 		dispatch_async(ta->q, set);
 	}
@@ -1025,7 +1058,7 @@ CFErrorRef Transform::SetAttribute(CFTypeRef key, CFTypeRef value)
 	{
 		dispatch_sync(ta->q, set);
 	}
-	if (dispatch_semaphore_wait(ta->semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC))) {
+	if (!fused && dispatch_semaphore_wait(ta->semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC))) {
 		Debug("Send from %@ to %@ is still waiting\n", GetName(), ah);
 		dispatch_semaphore_wait(ta->semaphore, DISPATCH_TIME_FOREVER);
 	}
@@ -1207,7 +1240,7 @@ void Transform::Do(SecTransformAttributeRef ah, CFTypeRef value)
 	{
 		return;
 	}
-	(void)transforms_assume(dispatch_get_current_queue() == ((ta->pushback_state == transform_attribute::pb_repush) ? mDispatchQueue : ta->q));
+	(void)transforms_assume((InFusedContext() && RunningTransform() == this) || dispatch_get_current_queue() == ((ta->pushback_state == transform_attribute::pb_repush) ? mDispatchQueue : ta->q));
 	
 	if (mIsFinalizing)
 	{
@@ -1320,6 +1353,10 @@ CFTypeRef Transform::Execute(dispatch_queue_t deliveryQueue, SecMessageBlock del
 	CFErrorRef temp = TraverseTransform(NULL, ^(Transform *t){
         return t->ExecuteOperation(outputAttached, (SecMonitorRef)monitorRef, p2, p3);
 	});
+	if (!temp) {
+		// All the connections are known now, and nothing is flowing yet
+		rootGroup->FuseLinearChains();
+	}
 	// ExecuteOperation is not called for the outer group, so we need to manually set mISActive for it.
 	rootGroup->mIsActive = true;
     rootGroup->StartingExecutionInGroup();
@@ -1383,7 +1420,7 @@ static void ActivateInputs_set(const void *v, void *unused) {
 
 void Transform::ActivateInputs()
 {
-	(void)transforms_assume_zero(mIsActive && this != dispatch_get_specific(&dispatchQueueToTransformKey));
+	(void)transforms_assume_zero(mIsActive && this != RunningTransform());
 	
 	// now run all of the forward links
 	if (!mIsFinalizing) {
@@ -1538,6 +1575,87 @@ bool Transform::IsExternalizable()
 	return true;
 }
 
+
+
+bool Transform::IsFusable()
+{
+	return false;
+}
+
+
+
+dispatch_queue_t Transform::CreateFusedQueue(CFStringRef name)
+{
+	char *qname = NULL;
+	CFIndex sz = 1+CFStringGetMaximumSizeForEncoding(CFStringGetLength(name), kCFStringEncodingUTF8);
+	char *nbuf = (char *)alloca(sz);
+	CFStringGetCString(name, nbuf, sz, kCFStringEncodingUTF8);
+	asprintf(&qname, "fused-%s", nbuf);
+	
+	dispatch_queue_t fusedQueue = dispatch_queue_create(qname, NULL);
+	dispatch_queue_set_specific(fusedQueue, &fusedQueueKey, fusedQueue, NULL);
+	free(qname);
+	
+	return fusedQueue;
+}
+
+
+
+void Transform::JoinFusedQueue(dispatch_queue_t fusedQueue)
+{
+	// Only done before execution starts, while nothing is running on mDispatchQueue
+	(void)transforms_assume_zero(mIsActive || mFusedQueue);
+	
+	dispatch_retain(fusedQueue);
+	mFusedQueue = fusedQueue;
+	dispatch_set_target_queue(mDispatchQueue, fusedQueue);
+}
+
+
+
+bool Transform::InFusedContext()
+{
+	return mFusedQueue != NULL && dispatch_get_specific(&fusedQueueKey) == mFusedQueue;
+}
+
+
+
+bool Transform::CanTakeFusedValue(transform_attribute *ta)
+{
+	// Everything a value sent through ta->q could be held back by: a suspended attribute queue
+	// (pushback), values already queued there, pushbacks waiting to be retried, an abort or a finalize.
+	return mIsActive && !mAbortError && !mIsFinalizing && InFusedContext() &&
+		ta->pushback_state == transform_attribute::pb_empty && ta->fused_backlog == 0 &&
+		!mProcessingPushbacks && !(mPushedback && CFArrayGetCount(mPushedback));
+}
+
+
+
+void Transform::FusedDo(SecTransformAttributeRef ah, CFTypeRef value)
+{
+	// We are on the sender's queue, so stand in for our own: anything asking which transform
+	// is running (RunningTransform) must see this one until Do returns.
+	Transform *savedTransform = fusedRunningTransform;
+	dispatch_queue_t savedQueue = fusedRunningQueue;
+	fusedRunningTransform = this;
+	fusedRunningQueue = mFusedQueue;
+	
+	Do(ah, value);
+	
+	fusedRunningTransform = savedTransform;
+	fusedRunningQueue = savedQueue;
+}
+
+
+
+Transform *Transform::RunningTransform()
+{
+	if (fusedRunningTransform && dispatch_get_specific(&fusedQueueKey) == fusedRunningQueue) {
+		return fusedRunningTransform;
+	}
+	return (Transform *)dispatch_get_specific(&dispatchQueueToTransformKey);
+}
+
 static const void *CFTypeOrNULLRetain(CFAllocatorRef allocator, const void *value) {
     return CFRetainSafe(value);
 }
@@ -76,6 +76,9 @@ struct transform_attribute {
 	// Value has been created as a source (therefore deferred), give it special treatment
 	unsigned int has_been_deferred:1;
 	
+	// Values queued on q by other members of a fused chain and not yet delivered (only touched on the fused queue)
+	int fused_backlog;
+	
 	void *attribute_changed_block;
 	void *attribute_validate_block;
 };
@@ -93,6 +96,9 @@ class Transform : public CoreFoundationObject
 	friend class BlockMonitor;
 protected:
 	dispatch_queue_t mDispatchQueue, mActivationQueue;
+	// Set when this transform is part of a fused linear chain (see GroupTransform::FuseLinearChains),
+	// in which case mDispatchQueue targets it and neighbours in the chain call Do directly.
+	dispatch_queue_t mFusedQueue;
 	dispatch_group_t mActivationPending;
 	CFMutableSetRef mAttributes;
 	CFMutableArrayRef mPushedback;
@@ -159,6 +165,14 @@ protected:
 	bool HasNoInboundConnections();
 	bool HasNoOutboundConnections();
 
+	static dispatch_queue_t CreateFusedQueue(CFStringRef name);
+	void JoinFusedQueue(dispatch_queue_t fusedQueue);
+	bool InFusedContext();
+	bool CanTakeFusedValue(transform_attribute *ta);
+	void FusedDo(SecTransformAttributeRef ah, CFTypeRef value);
+	// The transform whose queue we are (logically) running on, taking fused direct calls into account
+	static Transform *RunningTransform();
+
 private:
 	CFErrorRef ExecuteOperation(CFStringRef &outputAttached, SecMonitorRef output, dispatch_queue_t phase2, dispatch_queue_t phase3);
 	SecTransformAttributeRef makeAH(transform_attribute *ta);
@@ -177,6 +191,10 @@ public:
 
 	// overload to return true if your transform can be externalized (generally true unless you are a monitor)
 	virtual bool IsExternalizable();
+	
+	// overload to return true if your transform may run inline on the queue of the transform feeding it
+	// (only safe if AttributeChanged never blocks waiting on other transforms)
+	virtual bool IsFusable();
 
 	// Base implementation saves all attributes that have kSecTransformMetaAttributeExternalize TRUE (which is the default).
 	// If that isn't useful for your transform overload to return a CFDictionary that contains the state of
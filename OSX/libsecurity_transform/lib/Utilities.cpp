@@ -26,6 +26,8 @@
 #include <sys/sysctl.h>
 #include <syslog.h>
 #include <dispatch/dispatch.h>
+#include <malloc/malloc.h>
+#include <os/lock.h>
 
 void MyDispatchAsync(dispatch_queue_t queue, void(^block)(void))
 {
@@ -137,3 +139,149 @@ void transforms_bug(size_t line, long val)
         syslog(LOG_NOTICE, "BUG in SecTransforms: %s - %p - %lu - %lu", os_build, last_seen, (unsigned long)line, val);
     }
 }
+
+
+
+// Read buffers come in power of two sizes from kReadBufferMinimumSize to kReadBufferMaximumFileSize,
+// and up to kReadBufferPoolDepth of each size are kept around for reuse.
+static const CFIndex kReadBufferMinimumSize = 4096;
+static const CFIndex kReadBufferMaximumStreamSize = 64 * 1024;
+static const CFIndex kReadBufferMaximumFileSize = 1024 * 1024;
+static const int kReadBufferSizeClasses = 9; // 4K ... 1M
+static const int kReadBufferPoolDepth = 4;
+
+static os_unfair_lock gReadBufferPoolLock = OS_UNFAIR_LOCK_INIT;
+static UInt8* gReadBufferPool[kReadBufferSizeClasses][kReadBufferPoolDepth];
+static int gReadBufferPoolCount[kReadBufferSizeClasses];
+
+static int ReadBufferSizeClass(size_t size)
+{
+	int sizeClass = 0;
+	size_t classSize = kReadBufferMinimumSize;
+	while (classSize < size && sizeClass < kReadBufferSizeClasses)
+	{
+		classSize <<= 1;
+		sizeClass += 1;
+	}
+	
+	// only exact matches can be pooled; anything else goes straight back to malloc
+	return (classSize == size && sizeClass < kReadBufferSizeClasses) ? sizeClass : -1;
+}
+
+
+
+CFIndex ReadBufferInitialSize(void)
+{
+	return kReadBufferMinimumSize;
+}
+
+
+
+CFIndex ReadBufferNextSize(CFReadStreamRef stream, CFIndex currentSize, CFIndex bytesRead)
+{
+	// only grow while the stream keeps filling the buffer we give it
+	if (bytesRead < currentSize || currentSize >= kReadBufferMaximumFileSize)
+	{
+		return currentSize;
+	}
+	
+	CFIndex maximumSize = kReadBufferMaximumStreamSize;
+	CFTypeRef offset = CFReadStreamCopyProperty(stream, kCFStreamPropertyFileCurrentOffset);
+	if (offset != NULL)
+	{
+		// file-backed: large blocks amortize the per-chunk cost of the transform chain
+		maximumSize = kReadBufferMaximumFileSize;
+		CFReleaseNull(offset);
+	}
+	
+	return currentSize < maximumSize ? currentSize * 2 : currentSize;
+}
+
+
+
+UInt8* ReadBufferAcquire(CFIndex size)
+{
+	int sizeClass = ReadBufferSizeClass(size);
+	if (sizeClass >= 0)
+	{
+		UInt8* buffer = NULL;
+		os_unfair_lock_lock(&gReadBufferPoolLock);
+		if (gReadBufferPoolCount[sizeClass] > 0)
+		{
+			buffer = gReadBufferPool[sizeClass][--gReadBufferPoolCount[sizeClass]];
+		}
+		os_unfair_lock_unlock(&gReadBufferPoolLock);
+		
+		if (buffer != NULL)
+		{
+			return buffer;
+		}
+	}
+	
+	return (UInt8*) malloc(size);
+}
+
+
+
+void ReadBufferRelinquish(UInt8* buffer)
+{
+	if (buffer == NULL)
+	{
+		return;
+	}
+	
+	int sizeClass = ReadBufferSizeClass(malloc_size(buffer));
+	if (sizeClass >= 0)
+	{
+		os_unfair_lock_lock(&gReadBufferPoolLock);
+		if (gReadBufferPoolCount[sizeClass] < kReadBufferPoolDepth)
+		{
+			gReadBufferPool[sizeClass][gReadBufferPoolCount[sizeClass]++] = buffer;
+			buffer = NULL;
+		}
+		os_unfair_lock_unlock(&gReadBufferPoolLock);
+	}
+	
+	free(buffer);
+}
+
+
+
+static void ReadBufferDeallocate(void *ptr, void *info)
+{
+	ReadBufferRelinquish((UInt8*) ptr);
+}
+
+static CFAllocatorRef ReadBufferDeallocator(void)
+{
+	static dispatch_once_t once;
+	static CFAllocatorRef allocator = NULL;
+	dispatch_once(&once, ^{
+		CFAllocatorContext context = {0, NULL, NULL, NULL, NULL, NULL, NULL, ReadBufferDeallocate, NULL};
+		allocator = CFAllocatorCreate(NULL, &context);
+	});
+	
+	return allocator;
+}
+
+
+
+CFDataRef ReadBufferCreateData(UInt8** buffer, CFIndex size, CFIndex length)
+{
+	// A mostly empty buffer is cheaper to copy than to pin downstream; keep it for the next read.
+	if (length < size / 4)
+	{
+		return CFDataCreate(NULL, *buffer, length);
+	}
+	
+	// Otherwise the CFData takes ownership, and the caller acquires a fresh buffer for the next read.
+	UInt8* bytes = *buffer;
+	*buffer = NULL;
+	CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, bytes, length, ReadBufferDeallocator());
+	if (data == NULL)
+	{
+		ReadBufferRelinquish(bytes);
+	}
+	
+	return data;
+}
@@ -20,6 +20,15 @@ CFTypeRef DebugRetain(const void* owner, CFTypeRef type);
 void DebugRelease(const void* owner, CFTypeRef type);
 
 void transforms_bug(size_t line, long val) __attribute__((__noinline__));
+
+// Read buffers for stream sources.  Block sizes start small and grow while reads keep filling
+// the buffer (up to 1MB for file-backed streams), and full buffers are handed downstream without
+// a copy; they go back to a small pool when the CFData wrapping them is released.
+CFIndex ReadBufferInitialSize(void);
+CFIndex ReadBufferNextSize(CFReadStreamRef stream, CFIndex currentSize, CFIndex bytesRead);
+UInt8* ReadBufferAcquire(CFIndex size);
+void ReadBufferRelinquish(UInt8* buffer);
+CFDataRef ReadBufferCreateData(UInt8** buffer, CFIndex size, CFIndex length);
     
 // Borrowed form libdispatch, fastpath's x should normally be true; slowpath's x should normally be false.
 // The compiler will generate correct code in either case, but it is faster if you hint right.   If you
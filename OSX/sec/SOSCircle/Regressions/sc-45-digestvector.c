@@ -28,8 +28,9 @@
 
 #include <utilities/SecCFRelease.h>
 #include <stdlib.h>
+#include <string.h>
 
-static int kTestTestCount = 15;
+static int kTestTestCount = 20;
 
 static void testNullDigestVector(void)
 {
@@ -150,10 +151,102 @@ static void testIntersectUnionDigestVector(void)
     SOSDigestVectorFree(&dvpatched);
 }
 
+static void testSortLargeDigestVector(void)
+{
+    struct SOSDigestVector dv = SOSDigestVectorInit;
+    const size_t count = 5000;
+    uint8_t digest[SOSDigestSize] = {};
+    uint32_t seed = 1;
+
+    // Enough entries to take the radix sort path, every tenth one after the first repeats its predecessor
+    for (size_t ix = 0; ix < count; ++ix) {
+        if (ix % 10 != 0) {
+            for (size_t bx = 0; bx < SOSDigestSize; ++bx) {
+                seed = seed * 1103515245 + 12345;
+                digest[bx] = (uint8_t)(seed >> 16);
+            }
+        }
+        SOSDigestVectorAppend(&dv, digest);
+    }
+
+    SOSDigestVectorSort(&dv);
+    is(dv.count, count - (count - 1) / 10, "sort removed duplicates");
+
+    bool ascending = true;
+    for (size_t ix = 1; ix < dv.count; ++ix) {
+        if (memcmp(dv.digest[ix - 1], dv.digest[ix], SOSDigestSize) >= 0)
+            ascending = false;
+    }
+    ok(ascending, "sorted vector is strictly ascending");
+
+    SOSDigestVectorFree(&dv);
+}
+
+static void testPatchDigestVector(void)
+{
+    struct SOSDigestVector base = SOSDigestVectorInit;
+    struct SOSDigestVector removals = SOSDigestVectorInit;
+    struct SOSDigestVector additions = SOSDigestVectorInit;
+    struct SOSDigestVector patched = SOSDigestVectorInit;
+    CFErrorRef localError = NULL;
+
+    // Running out of removals while looking at c used to drop c
+    SOSDigestVectorAppend(&base, (void *)"a                  ");
+    SOSDigestVectorAppend(&base, (void *)"c                  ");
+    SOSDigestVectorAppend(&base, (void *)"e                  ");
+    SOSDigestVectorAppend(&removals, (void *)"b                  ");
+    SOSDigestVectorAppend(&additions, (void *)"d                  ");
+    SOSDigestVectorPatch(&base, &removals, &additions, &patched, &localError);
+    CFReleaseNull(localError);
+    CFStringRef desc = dvCopyString(&patched);
+    ok(CFEqual(CFSTR("acde"), desc), "patched is %@, should be: %@", desc, CFSTR("acde"));
+    CFReleaseNull(desc);
+
+    // A few changes against a large base take the search based path
+    SOSDigestVectorFree(&base);
+    SOSDigestVectorFree(&removals);
+    SOSDigestVectorFree(&additions);
+    SOSDigestVectorFree(&patched);
+    uint8_t digest[SOSDigestSize] = {};
+    for (size_t ix = 0; ix < 1000; ++ix) {
+        digest[0] = (uint8_t)(ix >> 8);
+        digest[1] = (uint8_t)ix;
+        digest[2] = 1;
+        SOSDigestVectorAppend(&base, digest);
+        if (ix % 250 == 0)
+            SOSDigestVectorAppend(&removals, digest);
+        if (ix % 400 == 0) {
+            digest[2] = 2;
+            SOSDigestVectorAppend(&additions, digest);
+        }
+    }
+    SOSDigestVectorPatch(&base, &removals, &additions, &patched, &localError);
+    CFReleaseNull(localError);
+    is(patched.count, base.count - removals.count + additions.count, "patched count");
+
+    __block bool applied = true;
+    SOSDigestVectorApplySorted(&removals, ^(const uint8_t *removal, bool *stop) {
+        if (SOSDigestVectorContainsSorted(&patched, removal))
+            applied = false;
+    });
+    SOSDigestVectorApplySorted(&additions, ^(const uint8_t *addition, bool *stop) {
+        if (!SOSDigestVectorContainsSorted(&patched, addition))
+            applied = false;
+    });
+    ok(applied, "removals gone and additions present");
+
+    SOSDigestVectorFree(&base);
+    SOSDigestVectorFree(&removals);
+    SOSDigestVectorFree(&additions);
+    SOSDigestVectorFree(&patched);
+}
+
 static void tests(void)
 {
     testNullDigestVector();
     testIntersectUnionDigestVector();
+    testSortLargeDigestVector();
+    testPatchDigestVector();
 }
 
 int sc_45_digestvector(int argc, char *const *argv)
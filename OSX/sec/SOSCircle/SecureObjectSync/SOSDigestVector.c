@@ -26,6 +26,7 @@
 #include <utilities/SecCFError.h>
 #include <utilities/SecCFWrappers.h>
 #include <dispatch/dispatch.h>
+#include <libkern/OSByteOrder.h>
 #include <stdlib.h>
 
 CFStringRef kSOSDigestVectorErrorDomain = CFSTR("com.apple.security.sos.digestvector.error");
@@ -59,6 +60,12 @@ static bool SOSDigestVectorEnsureCapacity(struct SOSDigestVector *dv, size_t cou
     return true;
 }
 
+// Preallocate room for a merge result, when that wouldn't exceed kMaxDVCapacity
+static void SOSDigestVectorReserve(struct SOSDigestVector *dv, size_t count) {
+    if (count <= kMaxDVCapacity)
+        SOSDigestVectorEnsureCapacity(dv, count);
+}
+
 static void SOSDigestVectorAppendOrdered(struct SOSDigestVector *dv, const uint8_t *digest)
 {
 	if (SOSDigestVectorEnsureCapacity(dv, dv->count + 1))
@@ -71,9 +78,27 @@ void SOSDigestVectorAppend(struct SOSDigestVector *dv, const uint8_t *digest)
 	dv->unsorted = true;
 }
 
+/*
+ Compare two digests as two big endian 64 bit words and a 32 bit word, which
+ orders exactly like memcmp but lets the compiler use a handful of loads and
+ conditional moves instead of a byte loop. This is the inner loop of every
+ manifest diff.
+ */
+static inline int SOSDigestCompareWords(const uint8_t *a, const uint8_t *b)
+{
+    uint64_t a0 = OSReadBigInt64(a, 0), b0 = OSReadBigInt64(b, 0);
+    if (a0 != b0)
+        return (a0 > b0) - (a0 < b0);
+    uint64_t a1 = OSReadBigInt64(a, 8), b1 = OSReadBigInt64(b, 8);
+    if (a1 != b1)
+        return (a1 > b1) - (a1 < b1);
+    uint32_t a2 = OSReadBigInt32(a, 16), b2 = OSReadBigInt32(b, 16);
+    return (a2 > b2) - (a2 < b2);
+}
+
 static int SOSDigestCompare(const void *a, const void *b)
 {
-	return memcmp(a, b, SOSDigestSize);
+    return SOSDigestCompareWords(a, b);
 }
 
 // Remove duplicates from sorted manifest using minimal memmove() calls
@@ -86,7 +111,7 @@ static void SOSDigestVectorUnique(struct SOSDigestVector *dv) {
     const uint8_t *end = dv->digest[dv->count];
     const uint8_t *source = dest;
     for (const uint8_t *cur = source; cur < end; cur += SOSDigestSize) {
-        int delta = SOSDigestCompare(prev, cur);
+        int delta = SOSDigestCompareWords(prev, cur);
         if (delta < 0) {
             // Found a properly sorted element
             // 1) Extend the current region (prev is end of region pointer)
@@ -106,7 +131,7 @@ static void SOSDigestVectorUnique(struct SOSDigestVector *dv) {
             if (cur < end) {
                 cur += SOSDigestSize;
                 while (cur < end) {
-                    int delta = SOSDigestCompare(prev, cur);
+                    int delta = SOSDigestCompareWords(prev, cur);
                     assert(delta <= 0);
                     if (delta != 0) {
                         break;
@@ -132,10 +157,76 @@ static void SOSDigestVectorUnique(struct SOSDigestVector *dv) {
 }
 
 
+/*
+ Digests are uniformly distributed, so one counting sort pass on their leading
+ bits leaves buckets of a few entries each, which an insertion sort finishes off.
+ Buckets that turn out large anyway (crafted or test data) fall back to qsort.
+ */
+#define kSOSDigestRadixMinCount     256
+#define kSOSDigestRadixMaxBucket    32
+
+static void SOSDigestSortBucket(uint8_t (*digest)[SOSDigestSize], size_t count)
+{
+    if (count > kSOSDigestRadixMaxBucket) {
+        qsort(digest, count, sizeof(*digest), SOSDigestCompare);
+        return;
+    }
+    for (size_t ix = 1; ix < count; ++ix) {
+        uint8_t cur[SOSDigestSize];
+        size_t jx = ix;
+        if (SOSDigestCompareWords(digest[jx - 1], digest[jx]) <= 0)
+            continue;
+        memcpy(cur, digest[ix], SOSDigestSize);
+        do {
+            memcpy(digest[jx], digest[jx - 1], SOSDigestSize);
+        } while (--jx > 0 && SOSDigestCompareWords(digest[jx - 1], cur) > 0);
+        memcpy(digest[jx], cur, SOSDigestSize);
+    }
+}
+
+static bool SOSDigestVectorRadixSort(struct SOSDigestVector *dv)
+{
+    size_t count = dv->count;
+    unsigned bits = count > 8 * 256 ? 16 : 8;
+    size_t buckets = (size_t)1 << bits;
+    uint8_t (*sorted)[SOSDigestSize] = NULL;
+    size_t *offsets = NULL;
+    bool ok = false;
+
+    sorted = malloc(dv->capacity * SOSDigestSize);
+    offsets = calloc(buckets + 1, sizeof(*offsets));
+    if (!sorted || !offsets)
+        goto out;
+
+    for (size_t ix = 0; ix < count; ++ix)
+        offsets[(OSReadBigInt16(dv->digest[ix], 0) >> (16 - bits)) + 1]++;
+    for (size_t bx = 1; bx <= buckets; ++bx)
+        offsets[bx] += offsets[bx - 1];
+    for (size_t ix = 0; ix < count; ++ix)
+        memcpy(sorted[offsets[OSReadBigInt16(dv->digest[ix], 0) >> (16 - bits)]++], dv->digest[ix], SOSDigestSize);
+
+    // offsets[bx] is now the end of bucket bx, which is also the start of bucket bx + 1
+    size_t start = 0;
+    for (size_t bx = 0; bx < buckets; ++bx) {
+        SOSDigestSortBucket(&sorted[start], offsets[bx] - start);
+        start = offsets[bx];
+    }
+
+    free(dv->digest);
+    dv->digest = sorted;
+    sorted = NULL;
+    ok = true;
+out:
+    free(sorted);
+    free(offsets);
+    return ok;
+}
+
 void SOSDigestVectorSort(struct SOSDigestVector *dv)
 {
     if (dv->unsorted && dv->digest) {
-        qsort(dv->digest, dv->count, sizeof(*dv->digest), SOSDigestCompare);
+        if (dv->count < kSOSDigestRadixMinCount || !SOSDigestVectorRadixSort(dv))
+            qsort(dv->digest, dv->count, sizeof(*dv->digest), SOSDigestCompare);
         dv->unsorted = false;
         SOSDigestVectorUnique(dv);
     }
@@ -220,7 +311,7 @@ static size_t SOSIncrementAndSkipDupes(const uint8_t *digests, size_t count, con
     size_t new_ix = ix;
     if (digests && new_ix < count) {
         while (++new_ix < count) {
-            int delta = SOSDigestCompare(digests + ix * SOSDigestSize, digests + new_ix * SOSDigestSize);
+            int delta = SOSDigestCompareWords(digests + ix * SOSDigestSize, digests + new_ix * SOSDigestSize);
             assert(delta <= 0);
             if (delta != 0)
                 break;
@@ -257,14 +348,92 @@ void SOSDigestVectorAppendMultipleOrdered(struct SOSDigestVector *dv,
 
 #endif /* !SOSDVSKIPDUPES */
 
+/*
+ When one side of a set operation is much smaller than the other, probing the
+ larger side with a galloping search and copying its untouched runs with memcpy
+ takes O(small * log(large)) comparisons instead of O(small + large). This is
+ what keeps applying a handful of changes to a large manifest cheap.
+ Runs are copied verbatim, so the large side must be free of duplicates, which
+ holds for anything that went through SOSDigestVectorSort.
+ */
+#define kSOSDigestVectorSearchRatio 16
+
+static bool SOSDigestVectorIsLopsided(size_t small, size_t large) {
+    return small * kSOSDigestVectorSearchRatio < large;
+}
+
+// Smallest index in [lo, dv->count) whose digest is not less than digest, galloping forward from lo
+static size_t SOSDigestVectorLowerBound(const struct SOSDigestVector *dv, size_t lo, const uint8_t *digest) {
+    size_t hi = lo, step = 1;
+    while (hi < dv->count && SOSDigestCompareWords(dv->digest[hi], digest) < 0) {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    if (hi > dv->count)
+        hi = dv->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (SOSDigestCompareWords(dv->digest[mid], digest) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static bool SOSDigestVectorHasAtIndex(const struct SOSDigestVector *dv, size_t ix, const uint8_t *digest) {
+    return ix < dv->count && SOSDigestCompareWords(dv->digest[ix], digest) == 0;
+}
+
+static void SOSDigestVectorAppendRangeOrdered(struct SOSDigestVector *dv, const struct SOSDigestVector *src, size_t from, size_t to) {
+    if (to > from && SOSDigestVectorEnsureCapacity(dv, dv->count + (to - from))) {
+        memcpy(dv->digest[dv->count], src->digest[from], (to - from) * SOSDigestSize);
+        dv->count += to - from;
+    }
+}
+
+// Append the members of small that are (or with wantFound false, are not) in large
+static void SOSDigestVectorAppendProbed(const struct SOSDigestVector *small, const struct SOSDigestVector *large,
+                                        bool wantFound, struct SOSDigestVector *dv) {
+    size_t il = 0;
+    for (size_t is = 0; is < small->count; is = SOSDVINCRIX(small, is)) {
+        il = SOSDigestVectorLowerBound(large, il, small->digest[is]);
+        if (SOSDigestVectorHasAtIndex(large, il, small->digest[is]) == wantFound)
+            SOSDigestVectorAppendOrdered(dv, small->digest[is]);
+    }
+}
+
+// Append large \ small by copying the runs of large between members of small
+static void SOSDigestVectorAppendRunsExcluding(const struct SOSDigestVector *small, const struct SOSDigestVector *large,
+                                               struct SOSDigestVector *dv) {
+    size_t il = 0;
+    for (size_t is = 0; is < small->count; is = SOSDVINCRIX(small, is)) {
+        size_t next = SOSDigestVectorLowerBound(large, il, small->digest[is]);
+        SOSDigestVectorAppendRangeOrdered(dv, large, il, next);
+        il = next;
+        if (SOSDigestVectorHasAtIndex(large, il, small->digest[is]))
+            il = SOSDVINCRIX(large, il);
+    }
+    SOSDigestVectorAppendRangeOrdered(dv, large, il, large->count);
+}
+
 void SOSDigestVectorIntersectSorted(const struct SOSDigestVector *dv1, const struct SOSDigestVector *dv2,
                                     struct SOSDigestVector *dvintersect)
 {
     /* dvintersect should be empty to start. */
     assert(dvintersect->count == 0);
+    SOSDigestVectorReserve(dvintersect, dv1->count < dv2->count ? dv1->count : dv2->count);
+    if (SOSDigestVectorIsLopsided(dv1->count, dv2->count)) {
+        SOSDigestVectorAppendProbed(dv1, dv2, true, dvintersect);
+        return;
+    } else if (SOSDigestVectorIsLopsided(dv2->count, dv1->count)) {
+        SOSDigestVectorAppendProbed(dv2, dv1, true, dvintersect);
+        return;
+    }
     size_t i1 = 0, i2 = 0;
     while (i1 < dv1->count && i2 < dv2->count) {
-        int delta = SOSDigestCompare(dv1->digest[i1], dv2->digest[i2]);
+        int delta = SOSDigestCompareWords(dv1->digest[i1], dv2->digest[i2]);
         if (delta == 0) {
             SOSDigestVectorAppendOrdered(dvintersect, dv1->digest[i1]);
             i1 = SOSDVINCRIX(dv1, i1);
@@ -282,9 +451,10 @@ void SOSDigestVectorUnionSorted(const struct SOSDigestVector *dv1, const struct
 {
     /* dvunion should be empty to start. */
     assert(dvunion->count == 0);
+    SOSDigestVectorReserve(dvunion, dv1->count + dv2->count);
     size_t i1 = 0, i2 = 0;
     while (i1 < dv1->count && i2 < dv2->count) {
-        int delta = SOSDigestCompare(dv1->digest[i1], dv2->digest[i2]);
+        int delta = SOSDigestCompareWords(dv1->digest[i1], dv2->digest[i2]);
         if (delta == 0) {
             SOSDigestVectorAppendOrdered(dvunion, dv1->digest[i1]);
             i1 = SOSDVINCRIX(dv1, i1);
@@ -308,9 +478,19 @@ void SOSDigestVectorDiffSorted(const struct SOSDigestVector *dv1, const struct S
     assert(dv1_2->count == 0);
     assert(dv2_1->count == 0);
 
+    if (SOSDigestVectorIsLopsided(dv1->count, dv2->count)) {
+        SOSDigestVectorAppendProbed(dv1, dv2, false, dv1_2);
+        SOSDigestVectorAppendRunsExcluding(dv1, dv2, dv2_1);
+        return;
+    } else if (SOSDigestVectorIsLopsided(dv2->count, dv1->count)) {
+        SOSDigestVectorAppendRunsExcluding(dv2, dv1, dv1_2);
+        SOSDigestVectorAppendProbed(dv2, dv1, false, dv2_1);
+        return;
+    }
+
     size_t i1 = 0, i2 = 0;
     while (i1 < dv1->count && i2 < dv2->count) {
-        int delta = SOSDigestCompare(dv1->digest[i1], dv2->digest[i2]);
+        int delta = SOSDigestCompareWords(dv1->digest[i1], dv2->digest[i2]);
         if (delta == 0) {
             i1 = SOSDVINCRIX(dv1, i1);
             i2 = SOSDVINCRIX(dv2, i2);
@@ -347,7 +527,7 @@ static void SOSDigestVectorAppendComplementAtIndex(size_t a_ix, const struct SOS
 {
     assert(a_ix <= dvA->count && b_ix <= dvB->count);
     while (a_ix < dvA->count && b_ix < dvB->count && dvA->digest && dvB->digest) {
-        int delta = SOSDigestCompare(dvA->digest[a_ix], dvB->digest[b_ix]);
+        int delta = SOSDigestCompareWords(dvA->digest[a_ix], dvB->digest[b_ix]);
         if (delta == 0) {
             a_ix = SOSDVINCRIX(dvA, a_ix);
             b_ix = SOSDVINCRIX(dvB, b_ix);
@@ -371,10 +551,59 @@ void SOSDigestVectorComplementSorted(const struct SOSDigestVector *dvA, const st
     assert(!dvA->unsorted);
 	assert(!dvB->unsorted);
 
+    if (dvA->digest && dvB->digest) {
+        if (SOSDigestVectorIsLopsided(dvB->count, dvA->count)) {
+            SOSDigestVectorAppendProbed(dvB, dvA, false, dvcomplement);
+            return;
+        } else if (SOSDigestVectorIsLopsided(dvA->count, dvB->count)) {
+            SOSDigestVectorAppendRunsExcluding(dvA, dvB, dvcomplement);
+            return;
+        }
+    }
     SOSDigestVectorAppendComplementAtIndex(0, dvA, 0, dvB, dvcomplement);
 }
 
 
+/*
+ Apply a few removals and additions to a large base: walk the changes in order,
+ copying the runs of base between them in bulk.
+ */
+static void SOSDigestVectorPatchLopsided(const struct SOSDigestVector *base, const struct SOSDigestVector *removals,
+                                         const struct SOSDigestVector *additions, struct SOSDigestVector *dv)
+{
+    size_t ib = 0, ir = 0, ia = 0;
+
+    SOSDigestVectorReserve(dv, base->count + additions->count);
+    while (ir < removals->count || ia < additions->count) {
+        // Next change is the smaller of the next removal and the next addition, removal wins on a tie
+        bool isRemoval, isAddition;
+        if (ia >= additions->count) {
+            isRemoval = true; isAddition = false;
+        } else if (ir >= removals->count) {
+            isRemoval = false; isAddition = true;
+        } else {
+            int delta = SOSDigestCompareWords(removals->digest[ir], additions->digest[ia]);
+            isRemoval = delta <= 0;
+            isAddition = delta >= 0;
+        }
+        const uint8_t *change = isRemoval ? removals->digest[ir] : additions->digest[ia];
+
+        size_t next = SOSDigestVectorLowerBound(base, ib, change);
+        SOSDigestVectorAppendRangeOrdered(dv, base, ib, next);
+        ib = next;
+        if (SOSDigestVectorHasAtIndex(base, ib, change))
+            ib = SOSDVINCRIX(base, ib);
+        if (!isRemoval)
+            SOSDigestVectorAppendOrdered(dv, change);
+
+        if (isRemoval)
+            ir = SOSDVINCRIX(removals, ir);
+        if (isAddition)
+            ia = SOSDVINCRIX(additions, ia);
+    }
+    SOSDigestVectorAppendRangeOrdered(dv, base, ib, base->count);
+}
+
 /*
     For each item in base
  
@@ -392,19 +621,26 @@ bool SOSDigestVectorPatchSorted(const struct SOSDigestVector *base, const struct
 	assert(!removals->unsorted);
 	assert(!additions->unsorted);
 
+    if (SOSDigestVectorIsLopsided(removals->count + additions->count, base->count)) {
+        SOSDigestVectorPatchLopsided(base, removals, additions, dv);
+        return true;
+    }
+
     size_t i1 = 0, i2 = 0, i3 = 0;
     while (i1 < base->count && i2 < additions->count) {
         // Pick the smaller of base->digest[i1] and additions->digest[i2] as a
         // candidate to be put into the output vector. If udelta positive, addition is smaller
-        int udelta = SOSDigestCompare(base->digest[i1], additions->digest[i2]);
+        int udelta = SOSDigestCompareWords(base->digest[i1], additions->digest[i2]);
         const uint8_t *candidate = udelta < 0 ? base->digest[i1] : additions->digest[i2];
 
         // ddelta > 0 means rem > candidate
         int ddelta = 1;
         while (i3 < removals->count) {
-            ddelta = SOSDigestCompare(removals->digest[i3], candidate);
+            ddelta = SOSDigestCompareWords(removals->digest[i3], candidate);
             if (ddelta < 0) {
                 i3 = SOSDVINCRIX(removals, i3);
+                // Running out of removals here must not drop the candidate
+                ddelta = 1;
             } else {
                 if (ddelta == 0)
                     i3 = SOSDVINCRIX(removals, i3);
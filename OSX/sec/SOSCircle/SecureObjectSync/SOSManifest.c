@@ -105,11 +105,38 @@ const struct SOSDigestVector *SOSManifestGetDigestVector(SOSManifestRef manifest
     return &manifest->dv;
 }
 
+// Like SOSManifestCreateWithDigestVector, but hands dv's buffer to the manifest instead of copying it; dv is left empty.
+static SOSManifestRef SOSManifestCreateConsumingDigestVector(struct SOSDigestVector *dv, CFErrorRef *error) {
+    if (dv->unsorted) SOSDigestVectorSort(dv);
+    if (!dv->digest || !dv->count)
+        return SOSManifestCreateWithBytes(NULL, 0, error);
+
+    SOSManifestRef manifest = CFTypeAllocate(SOSManifest, struct __OpaqueSOSManifest, kCFAllocatorDefault);
+    if (manifest)
+        manifest->digestVector = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, (const uint8_t *)dv->digest,
+                                                             (CFIndex)(dv->count * SOSDigestSize), kCFAllocatorMalloc);
+    if (!manifest || !manifest->digestVector) {
+        CFReleaseNull(manifest);
+        SecCFCreateErrorWithFormat(kSOSManifestCreateError, kSOSManifestErrorDomain, NULL, error, NULL, CFSTR("Failed to create manifest"));
+        return NULL;
+    }
+    // The manifest owns the buffer now
+    dv->digest = NULL;
+    dv->count = dv->capacity = 0;
+    return manifest;
+}
+
 bool SOSManifestDiff(SOSManifestRef a, SOSManifestRef b,
                      SOSManifestRef *a_minus_b, SOSManifestRef *b_minus_a,
                      CFErrorRef *error) {
     bool result = true;
-    if (SOSManifestGetCount(a) == 0) {
+    if (a && a == b) {
+        // Same manifest, nothing to diff
+        SOSManifestRef empty = SOSManifestCreateWithBytes(NULL, 0, error);
+        if (a_minus_b) CFRetainAssign(*a_minus_b, empty);
+        if (b_minus_a) CFRetainAssign(*b_minus_a, empty);
+        CFReleaseNull(empty);
+    } else if (SOSManifestGetCount(a) == 0) {
         //secnotice("manifest", "diff = b");
         SOSManifestRef empty = SOSManifestCreateWithBytes(NULL, 0, error);
         if (a_minus_b) CFRetainAssign(*a_minus_b, empty);
@@ -125,12 +152,12 @@ bool SOSManifestDiff(SOSManifestRef a, SOSManifestRef b,
         struct SOSDigestVector dvab = SOSDigestVectorInit, dvba = SOSDigestVectorInit;
         SOSDigestVectorDiffSorted(SOSManifestGetDigestVector(a), SOSManifestGetDigestVector(b), &dvab, &dvba);
         if (a_minus_b) {
-            *a_minus_b = SOSManifestCreateWithDigestVector(&dvab, error);
+            *a_minus_b = SOSManifestCreateConsumingDigestVector(&dvab, error);
             if (!*a_minus_b)
                 result = false;
         }
         if (b_minus_a) {
-            *b_minus_a = SOSManifestCreateWithDigestVector(&dvba, error);
+            *b_minus_a = SOSManifestCreateConsumingDigestVector(&dvba, error);
             if (!*b_minus_a)
                 result = false;
         }
@@ -153,9 +180,12 @@ SOSManifestRef SOSManifestCreateWithPatch(SOSManifestRef base,
                                           CFErrorRef *error) {
     struct SOSDigestVector dvresult = SOSDigestVectorInit;
     SOSManifestRef result;
+    // Nothing to apply: share base, and with it its already computed digest
+    if (base && SOSManifestGetCount(removals) == 0 && SOSManifestGetCount(additions) == 0)
+        return CFRetainSafe(base);
     if (SOSDigestVectorPatchSorted(SOSManifestGetDigestVector(base), SOSManifestGetDigestVector(removals),
                              SOSManifestGetDigestVector(additions), &dvresult, error)) {
-        result = SOSManifestCreateWithDigestVector(&dvresult, error);
+        result = SOSManifestCreateConsumingDigestVector(&dvresult, error);
     } else {
         result = NULL;
     }
@@ -176,7 +206,7 @@ SOSManifestRef SOSManifestCreateComplement(SOSManifestRef m1,
     struct SOSDigestVector dvresult = SOSDigestVectorInit;
     SOSManifestRef result;
     SOSDigestVectorComplementSorted(SOSManifestGetDigestVector(m1), SOSManifestGetDigestVector(m2), &dvresult);
-    result = SOSManifestCreateWithDigestVector(&dvresult, error);
+    result = SOSManifestCreateConsumingDigestVector(&dvresult, error);
     SOSDigestVectorFree(&dvresult);
     return result;
 }
@@ -187,7 +217,7 @@ SOSManifestRef SOSManifestCreateIntersection(SOSManifestRef m1,
     struct SOSDigestVector dvresult = SOSDigestVectorInit;
     SOSManifestRef result;
     SOSDigestVectorIntersectSorted(SOSManifestGetDigestVector(m1), SOSManifestGetDigestVector(m2), &dvresult);
-    result = SOSManifestCreateWithDigestVector(&dvresult, error);
+    result = SOSManifestCreateConsumingDigestVector(&dvresult, error);
     SOSDigestVectorFree(&dvresult);
     return result;
 }
@@ -205,7 +235,7 @@ SOSManifestRef SOSManifestCreateUnion(SOSManifestRef m1,
         struct SOSDigestVector dvresult = SOSDigestVectorInit;
         SOSManifestRef result;
         SOSDigestVectorUnionSorted(SOSManifestGetDigestVector(m1), SOSManifestGetDigestVector(m2), &dvresult);
-        result = SOSManifestCreateWithDigestVector(&dvresult, error);
+        result = SOSManifestCreateConsumingDigestVector(&dvresult, error);
         SOSDigestVectorFree(&dvresult);
         return result;
     }
@@ -984,8 +984,12 @@ bool SOSPeerDataSourceWillCommit(SOSPeerRef peer, SOSDataSourceTransactionSource
         // if (!SecIsScopeActive(kSecLevelNotice, "peer"))
         {
             // pended == UA unless the db is renotifying of an addition for something we already have
-            SOSManifestRef unpended = NULL, pended = NULL;
-            SOSManifestDiff(peer->pendingObjects, pendingObjectsManifest, &unpended, &pended, error);
+            // Derived from the (small) change sets rather than by diffing the old and new pendingObjects:
+            // unpended = O & R, pended = (UA \ O) \ R
+            SOSManifestRef unpended = SOSManifestCreateIntersection(removals, peer->pendingObjects, error);
+            SOSManifestRef newlyAdded = SOSManifestCreateComplement(peer->pendingObjects, unconfirmedAdditions, error);
+            SOSManifestRef pended = SOSManifestCreateComplement(removals, newlyAdded, error);
+            CFReleaseSafe(newlyAdded);
             secinfo("peer", "%@: willCommit R:%@ A:%@ UA:%@ %s O%s%@%s%@",
                        SOSPeerGetID(peer), removals, additions, unconfirmedAdditions,
                        (isAPITransaction ? "api": isCKKSTransaction ? "ckks" : "sos"),
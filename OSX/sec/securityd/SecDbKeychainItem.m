@@ -958,6 +958,14 @@ CFMutableDictionaryRef s3dl_item_v3_decode(CFDataRef plain, CFErrorRef *error) {
     return dictionaryFromPlist(item, error);
 }
 
+/* Whether items returned by q need their secret data, not just their metadata, decrypted. */
+bool s3dl_query_decrypts_secret_data(const Query *q) {
+    if ((q->q_return_type & kSecReturnDataMask) || (q->q_return_type & kSecReturnRefMask)) {
+        return true;
+    }
+    return q->q_match_policy || q->q_match_valid_on_date || q->q_match_trusted_only;
+}
+
 bool s3dl_item_from_data(CFDataRef edata, Query *q, CFArrayRef accessGroups,
                          CFMutableDictionaryRef *item, SecAccessControlRef *access_control, keyclass_t* keyclass, CFErrorRef *error) {
     SecAccessControlRef ac = NULL;
@@ -967,13 +975,7 @@ bool s3dl_item_from_data(CFDataRef edata, Query *q, CFArrayRef accessGroups,
     /* Decrypt and decode the item and check the decoded attributes against the query. */
     uint32_t version = 0;
 
-    bool decryptSecretData = false;
-    if ((q->q_return_type & kSecReturnDataMask) || (q->q_return_type & kSecReturnRefMask)) {
-        decryptSecretData = true;
-    }
-    else if (q->q_match_policy || q->q_match_valid_on_date || q->q_match_trusted_only) {
-        decryptSecretData = true;
-    }
+    bool decryptSecretData = s3dl_query_decrypts_secret_data(q);
 
     require_quiet((ok = ks_decrypt_data(q->q_keybag, kAKSKeyOpDecrypt, &ac, q->q_use_cred_handle, edata, q->q_class,
                                         q->q_caller_access_groups, item, &version, decryptSecretData, keyclass, error)), out);
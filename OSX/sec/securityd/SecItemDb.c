@@ -41,6 +41,7 @@
 #include <Security/SecItemInternal.h>
 #include <securityd/SOSCloudCircleServer.h>
 #include <utilities/array_size.h>
+#include <utilities/der_plist.h>
 #include <utilities/SecIOFormat.h>
 #include <utilities/SecCFCCWrappers.h>
 #include <SecAccessControlPriv.h>
@@ -407,14 +408,63 @@ out:
     return ok;
 }
 
+/* Cleartext columns selected after "rowid, data" so that a row can be screened
+ before its data blob is decrypted.  A column index of 0 means not selected. */
+struct s3dl_query_plan {
+    int tkid_col;
+    int issr_col;
+};
+
+/* Number of rows s3dl_copy_matching decodes concurrently when it has to
+ decrypt secret data for every row it returns. */
+#define S3DL_QUERY_DECODE_BATCH_SIZE 64
+
+/* A row whose decoding has been deferred to s3dl_query_flush_pending. */
+struct s3dl_query_pending_row {
+    sqlite_int64 rowid;
+    CFDataRef edata;
+    bool issuer_matched;
+    bool ok;
+    CFMutableDictionaryRef item;
+    CFErrorRef error;
+};
+
 struct s3dl_query_ctx {
     Query *q;
     CFArrayRef accessGroups;
     SecDbConnectionRef dbt;
     CFTypeRef result;
     int found;
+    struct s3dl_query_plan plan;
+    struct s3dl_query_pending_row *pending;
+    size_t pending_count;
 };
 
+static bool s3dl_class_has_attr(const SecDbClass *c, CFStringRef name) {
+    SecDbForEachAttr(c, desc) {
+        if (CFEqual(desc->name, name))
+            return true;
+    }
+    return false;
+}
+
+static void s3dl_query_plan(const Query *q, struct s3dl_query_plan *plan) {
+    int col = 2;
+    plan->tkid_col = 0;
+    plan->issr_col = 0;
+    /* The identity class joins keys and certs and has its own column layout. */
+    if (q->q_class == identity_class())
+        return;
+    /* Token items need their data to produce meaningful attributes; knowing up
+     front avoids decrypting them twice. */
+    if ((q->q_return_type & kSecReturnDataMask) == 0 && s3dl_class_has_attr(q->q_class, kSecAttrTokenID))
+        plan->tkid_col = col++;
+    /* Only rows whose issuer chains up to one of the requested issuers get
+     decrypted. */
+    if (q->q_match_issuer && s3dl_class_has_attr(q->q_class, kSecAttrIssuer))
+        plan->issr_col = col++;
+}
+
 /* Return whatever the caller requested based on the value of q->q_return_type.
  keys and values must be 3 larger than attr_count in size to accomadate the
  optional data, class and persistent ref results.  This is so we can use
@@ -500,15 +550,130 @@ static void s3dl_merge_into_dict(const void *key, const void *value, void *conte
 
 static bool checkTokenObjectID(CFDataRef token_object_id, CFDataRef value_data) {
     bool equalOID = false;
-    CFDictionaryRef itemValue = SecTokenItemValueCopy(value_data, NULL);
-    require_quiet(itemValue, out);
-    CFDataRef oID = CFDictionaryGetValue(itemValue, kSecTokenValueObjectIDKey);
+    CFPropertyListRef oID = NULL;
+    require_quiet(value_data, out);
+    // Only the OID is needed, so don't decode the rest of the token value (which may carry the object data).
+    const uint8_t *der = CFDataGetBytePtr(value_data);
+    const uint8_t *der_end = der + CFDataGetLength(value_data);
+    require_quiet(der_decode_dictionary_value(NULL, kCFPropertyListImmutable, kSecTokenValueObjectIDKey, &oID, NULL, der, der_end) == der_end, out);
     equalOID = CFEqualSafe(token_object_id, oID);
-    CFRelease(itemValue);
 out:
+    CFReleaseSafe(oID);
     return equalOID;
 }
 
+/* Log why an item failed to decode.  q->q_error holds the error and will be
+ released appropriately by a call to query_error. */
+static void s3dl_query_report_decode_error(Query *q, sqlite_int64 rowid, CFDataRef edata) {
+    OSStatus status = SecErrorGetOSStatus(q->q_error);
+    // errSecDecode means the item is corrupted, stash it for delete.
+    if (status == errSecDecode) {
+        secwarning("ignoring corrupt %@,rowid=%" PRId64 " %@", q->q_class->name, rowid, q->q_error);
+        {
+            CFMutableStringRef edatastring =  CFStringCreateMutable(kCFAllocatorDefault, 0);
+            if(edatastring) {
+                CFStringAppendEncryptedData(edatastring, edata);
+                secnotice("item", "corrupted edata=%@", edatastring);
+            }
+            CFReleaseSafe(edatastring);
+        }
+        CFReleaseNull(q->q_error);
+    } else if (status == errSecAuthNeeded) {
+        secwarning("Authentication is needed for %@,rowid=%" PRId64 " (%" PRIdOSStatus "): %@", q->q_class->name, rowid, status, q->q_error);
+    } else if (status == errSecInteractionNotAllowed) {
+        static dispatch_once_t kclockedtoken;
+        static sec_action_t kclockedaction;
+        dispatch_once(&kclockedtoken, ^{
+            kclockedaction = sec_action_create("ratelimiterdisabledlogevent", 1);
+            sec_action_set_handler(kclockedaction, ^{
+                secerror("decode item failed, keychain is locked (%d)", (int)errSecInteractionNotAllowed);
+            });
+        });
+        sec_action_perform(kclockedaction);
+    } else {
+        secerror("decode %@,rowid=%" PRId64 " failed (%" PRIdOSStatus "): %@", q->q_class->name, rowid, status, q->q_error);
+    }
+}
+
+/* Apply the match filters that need the decoded item and add it to the results. */
+static void s3dl_query_accept_item(struct s3dl_query_ctx *c, sqlite_int64 rowid,
+                                   CFMutableDictionaryRef item, bool issuer_matched) {
+    Query *q = c->q;
+
+    if (issuer_matched) {
+        if (!match_item_certificate(q, item))
+            return;
+    } else if (!match_item(c->dbt, q, c->accessGroups, item)) {
+        return;
+    }
+
+    CFTypeRef a_result = handle_result(q, item, rowid);
+    if (a_result) {
+        if (a_result == kCFNull) {
+            /* Caller wasn't interested in a result, but we still
+             count this row as found. */
+            CFRelease(a_result);  // Help shut up clang
+        } else if (q->q_limit == 1) {
+            c->result = a_result;
+        } else {
+            CFArrayAppendValue((CFMutableArrayRef)c->result, a_result);
+            CFRelease(a_result);
+        }
+        c->found++;
+    }
+}
+
+/* Decode the pending rows concurrently, then filter and collect them one by
+ one in the order sqlite returned them, stopping where s3dl_query would have. */
+static void s3dl_query_flush_pending(struct s3dl_query_ctx *c) {
+    Query *q = c->q;
+    CFArrayRef accessGroups = c->accessGroups;
+    SecDbConnectionRef dbconn = c->dbt;
+    struct s3dl_query_pending_row *rows = c->pending;
+    size_t count = c->pending_count;
+    ReturnTypeMask saved_mask = q->q_return_type;
+
+    if (count == 0)
+        return;
+
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t ix) {
+        // Metadata key lookups made while decrypting must reuse our connection, which may be inside a transaction.
+        kc_with_borrowed_dbt(dbconn, ^{
+            rows[ix].ok = s3dl_item_from_data(rows[ix].edata, q, accessGroups, &rows[ix].item, NULL, NULL, &rows[ix].error);
+        });
+    });
+
+    bool stop = false;
+    for (size_t ix = 0; ix < count; ++ix) {
+        struct s3dl_query_pending_row *row = &rows[ix];
+        if (!stop) {
+            // Secret data was decrypted anyway, so token items don't need decoding again to get it.
+            if (row->item && CFDictionaryContainsKey(row->item, kSecAttrTokenID))
+                q->q_return_type |= kSecReturnDataMask;
+            if (!row->ok) {
+                if (q->q_error == NULL) {
+                    q->q_error = row->error;
+                    row->error = NULL;
+                }
+                s3dl_query_report_decode_error(q, row->rowid, row->edata);
+            } else if (row->item && (q->q_token_object_id == NULL ||
+                                     checkTokenObjectID(q->q_token_object_id, CFDictionaryGetValue(row->item, kSecValueData)))) {
+                s3dl_query_accept_item(c, row->rowid, row->item, row->issuer_matched);
+            }
+            q->q_return_type = saved_mask;
+
+            bool needs_auth = q->q_error && CFErrorGetCode(q->q_error) == errSecAuthNeeded;
+            if (q->q_skip_acl_items && needs_auth)
+                CFReleaseNull(q->q_error);
+            stop = q->q_error && !needs_auth;
+        }
+        CFReleaseNull(row->edata);
+        CFReleaseNull(row->item);
+        CFReleaseNull(row->error);
+    }
+    c->pending_count = 0;
+}
+
 static void s3dl_query_row(sqlite3_stmt *stmt, void *context) {
     struct s3dl_query_ctx *c = context;
     Query *q = c->q;
@@ -516,43 +681,42 @@ static void s3dl_query_row(sqlite3_stmt *stmt, void *context) {
 
     sqlite_int64 rowid = sqlite3_column_int64(stmt, 0);
     CFMutableDictionaryRef item = NULL;
+    bool issuer_matched = false;
     bool ok;
 
+    /* Screen the row on its cleartext columns first, so we only pay for
+     decryption on rows that can actually be returned. */
+    if (c->plan.issr_col) {
+        CFDataRef issuer = NULL;
+        if (sqlite3_column_type(stmt, c->plan.issr_col) != SQLITE_NULL)
+            issuer = s3dl_copy_data_from_col(stmt, c->plan.issr_col, NULL);
+        issuer_matched = match_item_issuer(c->dbt, q, c->accessGroups, issuer);
+        CFReleaseSafe(issuer);
+        if (!issuer_matched)
+            goto out;
+    }
+
+    if (c->pending) {
+        struct s3dl_query_pending_row *row = &c->pending[c->pending_count++];
+        memset(row, 0, sizeof(*row));
+        row->rowid = rowid;
+        row->edata = CFDataCreate(kCFAllocatorDefault, sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1));
+        row->issuer_matched = issuer_matched;
+        if (c->pending_count == S3DL_QUERY_DECODE_BATCH_SIZE)
+            s3dl_query_flush_pending(c);
+        goto out;
+    }
+
+    if (c->plan.tkid_col && sqlite3_column_bytes(stmt, c->plan.tkid_col) > 0)
+        q->q_return_type |= kSecReturnDataMask;
+
 decode:
     ok = s3dl_item_from_col(stmt, q, 1, c->accessGroups, &item, NULL, NULL, &q->q_error);
     if (!ok) {
-        OSStatus status = SecErrorGetOSStatus(q->q_error);
-        // errSecDecode means the item is corrupted, stash it for delete.
-        if (status == errSecDecode) {
-            secwarning("ignoring corrupt %@,rowid=%" PRId64 " %@", q->q_class->name, rowid, q->q_error);
-            {
-                CFDataRef edata = s3dl_copy_data_from_col(stmt, 1, NULL);
-                CFMutableStringRef edatastring =  CFStringCreateMutable(kCFAllocatorDefault, 0);
-                if(edatastring) {
-                    CFStringAppendEncryptedData(edatastring, edata);
-                    secnotice("item", "corrupted edata=%@", edatastring);
-                }
-                CFReleaseSafe(edata);
-                CFReleaseSafe(edatastring);
-            }
-            CFReleaseNull(q->q_error);
-        } else if (status == errSecAuthNeeded) {
-            secwarning("Authentication is needed for %@,rowid=%" PRId64 " (%" PRIdOSStatus "): %@", q->q_class->name, rowid, status, q->q_error);
-        } else if (status == errSecInteractionNotAllowed) {
-            static dispatch_once_t kclockedtoken;
-            static sec_action_t kclockedaction;
-            dispatch_once(&kclockedtoken, ^{
-                kclockedaction = sec_action_create("ratelimiterdisabledlogevent", 1);
-                sec_action_set_handler(kclockedaction, ^{
-                    secerror("decode item failed, keychain is locked (%d)", (int)errSecInteractionNotAllowed);
-                });
-            });
-            sec_action_perform(kclockedaction);
-        } else {
-            secerror("decode %@,rowid=%" PRId64 " failed (%" PRIdOSStatus "): %@", q->q_class->name, rowid, status, q->q_error);
-        }
-        // q->q_error will be released appropriately by a call to query_error
-        return;
+        CFDataRef edata = s3dl_copy_data_from_col(stmt, 1, NULL);
+        s3dl_query_report_decode_error(q, rowid, edata);
+        CFReleaseSafe(edata);
+        goto out;
     }
 
     if (!item)
@@ -593,23 +757,7 @@ decode:
         item = key;
     }
 
-    if (!match_item(c->dbt, q, c->accessGroups, item))
-        goto out;
-
-    CFTypeRef a_result = handle_result(q, item, rowid);
-    if (a_result) {
-        if (a_result == kCFNull) {
-            /* Caller wasn't interested in a result, but we still
-             count this row as found. */
-            CFRelease(a_result);  // Help shut up clang
-        } else if (q->q_limit == 1) {
-            c->result = a_result;
-        } else {
-            CFArrayAppendValue((CFMutableArrayRef)c->result, a_result);
-            CFRelease(a_result);
-        }
-        c->found++;
-    }
+    s3dl_query_accept_item(c, rowid, item, issuer_matched);
 
 out:
     q->q_return_type = saved_mask;
@@ -730,7 +878,14 @@ static CFStringRef s3dl_create_select_sql(Query *q, CFArrayRef accessGroups) {
         SecDbAppendWhereMusr(sql, q, &needWhere);
         SecDbAppendWhereAccessGroups(sql, CFSTR("agrp"), accessGroups, &needWhere);
 	} else {
-        CFStringAppend(sql, CFSTR("SELECT rowid, data FROM "));
+        struct s3dl_query_plan plan;
+        s3dl_query_plan(q, &plan);
+        CFStringAppend(sql, CFSTR("SELECT rowid, data"));
+        if (plan.tkid_col)
+            CFStringAppend(sql, CFSTR(", tkid"));
+        if (plan.issr_col)
+            CFStringAppend(sql, CFSTR(", issr"));
+        CFStringAppend(sql, CFSTR(" FROM "));
 		CFStringAppend(sql, q->q_class->name);
         SecDbAppendWhereClause(sql, q, accessGroups);
     }
@@ -822,7 +977,7 @@ bool SecDbItemQuery(SecDbQueryRef query, CFArrayRef accessGroups, SecDbConnectio
 
     bool (^return_attr)(const SecDbAttr *attr) = ^bool (const SecDbAttr * attr) {
         // The attributes here must match field list hardcoded in s3dl_select_sql used below, which is
-        // "rowid, data"
+        // "rowid, data" (any cleartext columns from s3dl_query_plan follow those and are ignored here)
         return attr->kind == kSecDbRowIdAttr || attr->kind == kSecDbEncryptedDataAttr;
     };
 
@@ -906,6 +1061,8 @@ s3dl_query(s3dl_handle_row handle_row,
                 stop = stop || (q->q_error && !needs_auth);
                 return !stop;
             });
+            if (c->pending)
+                s3dl_query_flush_pending(c);
         }
         return sql_ok;
     });
@@ -943,7 +1100,12 @@ s3dl_copy_matching(SecDbConnectionRef dbt, Query *q, CFTypeRef *result,
     // Only copy things that aren't tombstones unless the client explicitly asks otherwise.
     if (!CFDictionaryContainsKey(q->q_item, kSecAttrTombstone))
         query_add_attribute(kSecAttrTombstone, kCFBooleanFalse, q);
+    s3dl_query_plan(q, &ctx.plan);
+    // When every returned row needs its secret data decrypted, spread that work over several threads.
+    if (q->q_class != identity_class() && q->q_limit == kSecMatchUnlimited && s3dl_query_decrypts_secret_data(q))
+        ctx.pending = calloc(S3DL_QUERY_DECODE_BATCH_SIZE, sizeof(*ctx.pending));
     bool ok = s3dl_query(s3dl_query_row, &ctx, error);
+    free(ctx.pending);
     if (ok && result)
         *result = ctx.result;
     else
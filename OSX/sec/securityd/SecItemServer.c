@@ -494,6 +494,146 @@ out:
 
 __thread SecDbConnectionRef dbt = NULL;
 
+// Number of items UpgradeItemPhase2 decrypts and re-encrypts concurrently before writing them back.
+// Bounds both the plaintext held in memory and the work lost if the keybag locks mid-batch.
+#define UPGRADE_PHASE2_BATCH_SIZE 128
+
+// Builds the rewritten form of item: decrypted, with the modification date bumped the same way
+// SecDbItemUpdate(item, item) would, and with encrypted data, hash and primary key computed afresh
+// so that SecDbItemUpdate only has to write it. Safe to call concurrently for different items.
+static SecDbItemRef UpgradeItemPhase2CopyRewrittenItem(SecDbItemRef item, CFDictionaryRef noUpdates, CFErrorRef *error) {
+    SecDbItemRef newItem = NULL;
+    const SecDbAttr *mdat = NULL;
+    CFDateRef date = NULL;
+    CFDateRef youngerDate = NULL;
+
+    require_quiet(SecDbItemEnsureDecrypted(item, true, error), out);
+    require_quiet(newItem = SecDbItemCopyWithUpdates(item, noUpdates, error), out);
+    require_quiet(mdat = SecDbClassAttrWithKind(item->class, kSecDbModificationDateAttr, error), fail);
+    require_quiet(date = SecDbItemGetValue(item, mdat, error), fail);
+    youngerDate = CFDateCreate(kCFAllocatorDefault, CFDateGetAbsoluteTime(date) + 0.001);
+    require_quiet(SecDbItemSetValue(newItem, mdat, youngerDate, error), fail);
+    require_quiet(SecDbItemGetValueKind(newItem, kSecDbEncryptedDataAttr, error), fail);
+    require_quiet(SecDbItemGetValueKind(newItem, kSecDbSHA1Attr, error), fail);
+    require_quiet(SecDbItemGetPrimaryKey(newItem, error), fail);
+    goto out;
+
+fail:
+    CFReleaseNull(newItem);
+out:
+    CFReleaseSafe(youngerDate);
+    return newItem;
+}
+
+// Rewrites a batch of items selected by UpgradeItemPhase2. The decryption and re-encryption are done
+// concurrently; the database writes are then done one by one on inDbt, in the order items were selected.
+static bool UpgradeItemPhase2Batch(SecDbConnectionRef inDbt, SecDbQueryRef query, CFArrayRef items,
+                                   bool *inProgress, int oldVersion, int newVersion, CFErrorRef *error) {
+    bool ok = true;
+    size_t count = (size_t)CFArrayGetCount(items);
+    SecDbItemRef *newItems = calloc(count, sizeof(SecDbItemRef));
+    CFErrorRef *itemErrors = calloc(count, sizeof(CFErrorRef));
+    CFDictionaryRef noUpdates = CFDictionaryCreate(kCFAllocatorDefault, NULL, NULL, 0,
+                                                   &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+    dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        // Metadata key lookups made while en/decrypting need to see the upgrade's connection, or they would
+        // try to open another one and block on our own transaction.
+        kc_with_borrowed_dbt(inDbt, ^{
+            newItems[i] = UpgradeItemPhase2CopyRewrittenItem((SecDbItemRef)CFArrayGetValueAtIndex(items, i), noUpdates, &itemErrors[i]);
+        });
+    });
+
+    bool stop = false;
+    for (size_t i = 0; i < count && !stop; i++) {
+        SecDbItemRef item = (SecDbItemRef)CFArrayGetValueAtIndex(items, i);
+        CFErrorRef localError = itemErrors[i];
+        itemErrors[i] = NULL;
+
+        if (newItems[i]) {
+            // Drop items with kSecAttrAccessGroupToken, as these items should not be there at all. Since agrp attribute
+            // is always stored as cleartext in the DB column, we can always rely on this attribute being present in item->attributes.
+            // <rdar://problem/33401870>
+            if (CFEqualSafe(SecDbItemGetCachedValueWithName(item, kSecAttrAccessGroup), kSecAttrAccessGroupToken) &&
+                SecDbItemGetCachedValueWithName(item, kSecAttrTokenID) == NULL) {
+                secnotice("upgr", "dropping item during item upgrade due to agrp=com.apple.token: %@", item);
+                ok = SecDbItemDelete(item, inDbt, kCFBooleanFalse, &localError);
+            } else {
+                // Replace item with the new value in the table; newItems[i] already carries the recoded data and hash.
+                ok = SecDbItemUpdate(item, newItems[i], inDbt, false, query->q_uuid_from_primary_key, &localError);
+            }
+        }
+
+        if (localError) {
+            CFIndex status = CFErrorGetCode(localError);
+
+            switch (status) {
+                case errSecDecode: {
+                    // Items producing errSecDecode are silently dropped - they are not decodable and lost forever.
+                    // make sure we use a local error so that this error is not proppaged upward and cause a
+                    // migration failure.
+                    CFErrorRef deleteError = NULL;
+                    (void)SecDbItemDelete(item, inDbt, false, &deleteError);
+                    CFReleaseNull(deleteError);
+                    ok = true;
+                    break;
+                }
+                case errSecInteractionNotAllowed:
+                    // If we are still not able to decrypt the item because the class key is not released yet,
+                    // remember that DB still needs phase2 migration to be run next time a connection is made.  Also
+                    // stop iterating next items, it would be just waste of time because the whole iteration will be run
+                    // next time when this phase2 will be rerun.
+                    LKAReportKeychainUpgradeOutcome(oldVersion, newVersion, LKAKeychainUpgradeOutcomeLocked);
+                    *inProgress = true;
+                    stop = true;
+                    ok = true;
+                    break;
+                case errSecAuthNeeded:
+                    // errSecAuthNeeded means that it is an ACL-based item which requires authentication (or at least
+                    // ACM context, which we do not have).
+                    ok = true;
+                    break;
+                case SQLITE_CONSTRAINT:         // yeah...
+                    if (!CFEqual(kSecDbErrorDomain, CFErrorGetDomain(localError))) {
+                        secerror("Received SQLITE_CONSTRAINT with wrong error domain. Huh? Item: %@, error: %@", item, localError);
+                        break;
+                    }
+                case errSecDuplicateItem:
+                    // continue to upgrade and don't propagate errors for insert failures
+                    // that are typical of a single item failure
+                    secnotice("upgr", "Ignoring duplicate item: %@", item);
+                    secdebug("upgr", "Duplicate item error: %@", localError);
+                    ok = true;
+                    break;
+#if USE_KEYSTORE
+                case kAKSReturnNotReady:
+                case kAKSReturnTimeout:
+#endif
+                case errSecNotAvailable:
+                    *inProgress = true;     // We're not done, call me again later!
+                    secnotice("upgr", "Bailing in phase 2 because AKS is unavailable: %@", localError);
+                    // FALLTHROUGH
+                default:
+                    //  Other errors should abort the migration completely.
+                    ok = CFErrorPropagate(CFRetainSafe(localError), error);
+                    break;
+            }
+        }
+
+        CFReleaseSafe(localError);
+        stop = stop || !ok;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        CFReleaseSafe(newItems[i]);
+        CFReleaseSafe(itemErrors[i]);
+    }
+    free(newItems);
+    free(itemErrors);
+    CFReleaseSafe(noUpdates);
+    return ok;
+}
+
 // Goes through all tables represented by old_schema and tries to migrate all items from them into new (current version) tables.
 static bool UpgradeItemPhase2(SecDbConnectionRef inDbt, bool *inProgress, int oldVersion, CFErrorRef *error) {
     SecDbConnectionRef oldDbt = dbt;
@@ -510,6 +650,7 @@ static bool UpgradeItemPhase2(SecDbConnectionRef inDbt, bool *inProgress, int ol
     // Go through all classes in new schema
     const SecDbSchema *newSchema = current_schema();
     int newVersion = SCHEMA_VERSION(newSchema);
+    CFMutableArrayRef batch = CFArrayCreateMutable(kCFAllocatorDefault, UPGRADE_PHASE2_BATCH_SIZE, &kCFTypeArrayCallBacks);
     for (const SecDbClass *const *class = newSchema->classes; *class != NULL && !*inProgress; class++) {
         if(!((*class)->itemclass)) {
             //Don't try to decrypt non-item 'classes'
@@ -538,94 +679,20 @@ static bool UpgradeItemPhase2(SecDbConnectionRef inDbt, bool *inProgress, int ol
             return SecDbBindObject(stmt, col++, kSecAttrAccessibleAlwaysPrivate, error) &&
             SecDbBindObject(stmt, col++, kSecAttrAccessibleAlwaysThisDeviceOnlyPrivate, error);
         }, ^(SecDbItemRef item, bool *stop) {
-            CFErrorRef localError = NULL;
-
 #if TARGET_OS_EMBEDDED
             itemsMigrated++;
 #endif
-
-            // Decrypt the item.
-            if (SecDbItemEnsureDecrypted(item, true, &localError)) {
-
-                // Delete SHA1 field from the item, so that it is newly recalculated before storing
-                // the item into the new table.
-                require_quiet(ok = SecDbItemSetValue(item, SecDbClassAttrWithKind(item->class, kSecDbSHA1Attr, error),
-                                                     kCFNull, &localError), out);
-                // Drop items with kSecAttrAccessGroupToken, as these items should not be there at all. Since agrp attribute
-                // is always stored as cleartext in the DB column, we can always rely on this attribute being present in item->attributes.
-                // <rdar://problem/33401870>
-                if (CFEqualSafe(SecDbItemGetCachedValueWithName(item, kSecAttrAccessGroup), kSecAttrAccessGroupToken) &&
-                    SecDbItemGetCachedValueWithName(item, kSecAttrTokenID) == NULL) {
-                    secnotice("upgr", "dropping item during item upgrade due to agrp=com.apple.token: %@", item);
-                    ok = SecDbItemDelete(item, dbt, kCFBooleanFalse, &localError);
-                } else {
-                    // Replace item with the new value in the table; this will cause the item to be decoded and recoded back,
-                    // incl. recalculation of item's hash.
-                    ok = SecDbItemUpdate(item, item, dbt, false, query->q_uuid_from_primary_key, &localError);
-                }
-            }
-
-            if (localError) {
-                CFIndex status = CFErrorGetCode(localError);
-
-                switch (status) {
-                    case errSecDecode: {
-                        // Items producing errSecDecode are silently dropped - they are not decodable and lost forever.
-                        // make sure we use a local error so that this error is not proppaged upward and cause a
-                        // migration failure.
-                        CFErrorRef deleteError = NULL;
-                        (void)SecDbItemDelete(item, dbt, false, &deleteError);
-                        CFReleaseNull(deleteError);
-                        ok = true;
-                        break;
-                    }
-                    case errSecInteractionNotAllowed:
-                        // If we are still not able to decrypt the item because the class key is not released yet,
-                        // remember that DB still needs phase2 migration to be run next time a connection is made.  Also
-                        // stop iterating next items, it would be just waste of time because the whole iteration will be run
-                        // next time when this phase2 will be rerun.
-                        LKAReportKeychainUpgradeOutcome(oldVersion, newVersion, LKAKeychainUpgradeOutcomeLocked);
-                        *inProgress = true;
-                        *stop = true;
-                        ok = true;
-                        break;
-                    case errSecAuthNeeded:
-                        // errSecAuthNeeded means that it is an ACL-based item which requires authentication (or at least
-                        // ACM context, which we do not have).
-                        ok = true;
-                        break;
-                    case SQLITE_CONSTRAINT:         // yeah...
-                        if (!CFEqual(kSecDbErrorDomain, CFErrorGetDomain(localError))) {
-                            secerror("Received SQLITE_CONSTRAINT with wrong error domain. Huh? Item: %@, error: %@", item, localError);
-                            break;
-                        }
-                    case errSecDuplicateItem:
-                        // continue to upgrade and don't propagate errors for insert failures
-                        // that are typical of a single item failure
-                        secnotice("upgr", "Ignoring duplicate item: %@", item);
-                        secdebug("upgr", "Duplicate item error: %@", localError);
-                        ok = true;
-                        break;
-#if USE_KEYSTORE
-                    case kAKSReturnNotReady:
-                    case kAKSReturnTimeout:
-#endif
-                    case errSecNotAvailable:
-                        *inProgress = true;     // We're not done, call me again later!
-                        secnotice("upgr", "Bailing in phase 2 because AKS is unavailable: %@", localError);
-                        // FALLTHROUGH
-                    default:
-                        //  Other errors should abort the migration completely.
-                        ok = CFErrorPropagate(CFRetainSafe(localError), error);
-                        break;
-                }
+            CFArrayAppendValue(batch, item);
+            if (CFArrayGetCount(batch) >= UPGRADE_PHASE2_BATCH_SIZE) {
+                ok = UpgradeItemPhase2Batch(inDbt, query, batch, inProgress, oldVersion, newVersion, error);
+                CFArrayRemoveAllValues(batch);
+                *stop = !ok || *inProgress;
             }
-
-        out:
-            CFReleaseSafe(localError);
-            *stop = *stop || !ok;
-
         });
+        if (ok && !*inProgress && CFArrayGetCount(batch) > 0) {
+            ok = UpgradeItemPhase2Batch(inDbt, query, batch, inProgress, oldVersion, newVersion, error);
+        }
+        CFArrayRemoveAllValues(batch);
         require_action(ok, out, LKAReportKeychainUpgradeOutcomeWithError(oldVersion, newVersion, LKAKeychainUpgradeOutcomePhase2, error ? *error : NULL));
     }
 
@@ -636,6 +703,7 @@ static bool UpgradeItemPhase2(SecDbConnectionRef inDbt, bool *inProgress, int ol
 out:
     if (query != NULL)
         query_destroy(query, NULL);
+    CFReleaseSafe(batch);
 
     dbt = oldDbt;
     return ok;
@@ -1214,6 +1282,14 @@ bool kc_with_dbt_non_item_tables(bool writeAndRead, CFErrorRef* error, bool (^pe
     return kc_with_custom_db(writeAndRead, false, NULL, error, perform);
 }
 
+void kc_with_borrowed_dbt(SecDbConnectionRef dbconn, void (^perform)(void))
+{
+    SecDbConnectionRef oldDbt = dbt;
+    dbt = dbconn;
+    perform();
+    dbt = oldDbt;
+}
+
 bool kc_with_custom_db(bool writeAndRead, bool usesItemTables, SecDbRef db, CFErrorRef *error, bool (^perform)(SecDbConnectionRef dbt))
 {
     if (db && db != kc_dbhandle(error)) {
@@ -1454,15 +1530,24 @@ out:
 }
 
 bool match_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDictionaryRef item)
+{
+    return match_item_issuer(dbt, q, accessGroups, CFDictionaryGetValue(item, kSecAttrIssuer)) &&
+           match_item_certificate(q, item);
+}
+
+/* The issuer check only looks at the (cleartext) issr attribute, so it can be
+ run against the database row before the item itself has been decrypted. */
+bool match_item_issuer(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDataRef issuer)
+{
+    if (!q->q_match_issuer)
+        return true;
+    return items_matching_issuer_parent(dbt, accessGroups, q->q_musrView, issuer, q->q_match_issuer, 10 /*max depth*/);
+}
+
+bool match_item_certificate(Query *q, CFDictionaryRef item)
 {
     bool ok = false;
     SecCertificateRef certRef = NULL;
-    if (q->q_match_issuer) {
-        CFDataRef issuer = CFDictionaryGetValue(item, kSecAttrIssuer);
-        if (!items_matching_issuer_parent(dbt, accessGroups, q->q_musrView, issuer, q->q_match_issuer, 10 /*max depth*/))
-            return ok;
-    }
-
     if (q->q_match_policy && (q->q_class == identity_class() || q->q_class == cert_class())) {
         if (!certRef)
             certRef = CopyCertificateFromItem(q, item);
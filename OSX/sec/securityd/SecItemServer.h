@@ -85,6 +85,7 @@ SecDbRef SecKeychainDbInitialize(SecDbRef db);
 bool kc_with_dbt(bool writeAndRead, CFErrorRef *error, bool (^perform)(SecDbConnectionRef dbt));
 bool kc_with_dbt_non_item_tables(bool writeAndRead, CFErrorRef* error, bool (^perform)(SecDbConnectionRef dbt)); // can be used when only tables which don't store 'items' are accessed - avoids invoking SecItemDataSourceFactoryGetDefault()
 bool kc_with_custom_db(bool writeAndRead, bool usesItemTables, SecDbRef db, CFErrorRef *error, bool (^perform)(SecDbConnectionRef dbt));
+void kc_with_borrowed_dbt(SecDbConnectionRef dbconn, void (^perform)(void)); // makes kc_with_* calls from perform, on this thread, use dbconn; for workers helping a thread that holds dbconn
 
 
 /* For whitebox testing only */
@@ -131,6 +132,8 @@ bool SecKeychainDbGetVersion(SecDbConnectionRef dbt, int *version, CFErrorRef *e
 
 // Should all be blocks called from SecItemDb
 bool match_item(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDictionaryRef item);
+bool match_item_issuer(SecDbConnectionRef dbt, Query *q, CFArrayRef accessGroups, CFDataRef issuer);
+bool match_item_certificate(Query *q, CFDictionaryRef item);
 bool accessGroupsAllows(CFArrayRef accessGroups, CFStringRef accessGroup, SecurityClient* client);
 bool itemInAccessGroup(CFDictionaryRef item, CFArrayRef accessGroups);
 void SecKeychainChanged(void);
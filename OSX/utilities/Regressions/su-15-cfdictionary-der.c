@@ -28,9 +28,11 @@
 #include "utilities/der_plist_internal.h"
 
 #include "utilities/SecCFRelease.h"
+#include "utilities/SecCFWrappers.h"
 #include "utilities/array_size.h"
 
 #include <CoreFoundation/CoreFoundation.h>
+#include <corecrypto/ccder.h>
 
 
 #define kMaxResultSize 1024
@@ -126,7 +128,93 @@ static void one_test(const struct test_case * thisCase)
     CFReleaseNull(testValue);
 }
 
-#define kTestCount (array_size(test_cases) * kTestsPerTestCase) + kTestsPerDictionaryTest
+// Enough pairs and bytes that the encoder can't keep its bookkeeping on the stack.
+#define kLargeDictionaryCount 64
+#define kTestsPerLargeDictionaryTest 3
+static void test_large_dictionary(void)
+{
+    CFMutableDictionaryRef dictionary = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    for (int i = 0; i < kLargeDictionaryCount; ++i) {
+        CFNumberRef key = CFNumberCreate(NULL, kCFNumberIntType, &i);
+        CFStringRef value = CFStringCreateWithFormat(NULL, NULL, CFSTR("Value number %d, padded out a little"), i);
+        CFDictionaryAddValue(dictionary, key, value);
+        CFReleaseNull(key);
+        CFReleaseNull(value);
+    }
+
+    CFDataRef encoded = CFPropertyListCreateDERData(NULL, dictionary, NULL);
+    ok(encoded != NULL && (size_t)CFDataGetLength(encoded) == der_sizeof_dictionary(dictionary, NULL), "Encoded large dictionary");
+
+    const uint8_t *der_end = CFDataGetBytePtr(encoded) + CFDataGetLength(encoded);
+    const uint8_t *set_end = NULL;
+    const uint8_t *element = ccder_decode_constructed_tl(CCDER_CONSTRUCTED_SET, &set_end, CFDataGetBytePtr(encoded), der_end);
+    const uint8_t *previous = NULL;
+    size_t previous_length = 0;
+    bool sorted = element != NULL && set_end == der_end;
+    while (sorted && element < set_end) {
+        const uint8_t *element_end = NULL;
+        sorted = ccder_decode_constructed_tl(CCDER_CONSTRUCTED_SEQUENCE, &element_end, element, set_end) != NULL;
+        if (sorted && previous) {
+            size_t element_length = element_end - element;
+            size_t shortest = previous_length < element_length ? previous_length : element_length;
+            int comparison = memcmp(previous, element, shortest);
+            sorted = comparison < 0 || (comparison == 0 && previous_length < element_length);
+        }
+        previous = element;
+        previous_length = element_end - element;
+        element = element_end;
+    }
+    ok(sorted, "Pairs in canonical order");
+
+    CFPropertyListRef decoded = CFPropertyListCreateWithDERData(NULL, encoded, kCFPropertyListImmutable, NULL, NULL);
+    ok(decoded != NULL && CFEqual(decoded, dictionary), "Didn't make equal value.");
+
+    CFReleaseNull(decoded);
+    CFReleaseNull(encoded);
+    CFReleaseNull(dictionary);
+}
+
+#define kTestsPerStreamingTest 4
+static void test_streaming(void)
+{
+    CFDataRef oid = CFDataCreate(NULL, (const uint8_t *)"oid bytes", 9);
+    CFDictionaryRef dictionary = CFDictionaryCreateForCFTypes(NULL,
+                                                              CFSTR("oid"), oid,
+                                                              CFSTR("ac"), kCFBooleanTrue,
+                                                              CFSTR("data"), CFSTR("Something big we don't want to decode"),
+                                                              NULL);
+    CFDataRef encoded = CFPropertyListCreateDERData(NULL, dictionary, NULL);
+    const uint8_t *der = CFDataGetBytePtr(encoded);
+    const uint8_t *der_end = der + CFDataGetLength(encoded);
+
+    __block int visited = 0;
+    ok(der_visit_dictionary(NULL, der, der_end, ^bool(const uint8_t *key_der, const uint8_t *key_der_end,
+                                                      const uint8_t *value_der, const uint8_t *value_der_end) {
+        visited++;
+        return true;
+    }) == der_end && visited == 3, "Visited every entry");
+
+    CFPropertyListRef value = NULL;
+    ok(der_decode_dictionary_value(NULL, kCFPropertyListImmutable, CFSTR("oid"), &value, NULL, der, der_end) == der_end &&
+       CFEqualSafe(value, oid), "Decoded single value");
+    CFReleaseNull(value);
+
+    ok(der_decode_dictionary_value(NULL, kCFPropertyListImmutable, CFSTR("missing"), &value, NULL, der, der_end) == der_end &&
+       value == NULL, "Missing key has no value");
+
+    CFErrorRef error = NULL;
+    ok(der_visit_dictionary(&error, der + 1, der_end, ^bool(const uint8_t *key_der, const uint8_t *key_der_end,
+                                                            const uint8_t *value_der, const uint8_t *value_der_end) {
+        return true;
+    }) == NULL && error != NULL, "Malformed dictionary rejected");
+    CFReleaseNull(error);
+
+    CFReleaseNull(encoded);
+    CFReleaseNull(dictionary);
+    CFReleaseNull(oid);
+}
+
+#define kTestCount (array_size(test_cases) * kTestsPerTestCase) + kTestsPerDictionaryTest + kTestsPerLargeDictionaryTest + kTestsPerStreamingTest
 static void tests(void)
 {
     for (int testnumber = 0; testnumber < array_size(test_cases); ++testnumber)
@@ -167,6 +255,9 @@ static void tests(void)
     uint8_t expected_result[] = { 0x31, 0x3D, 0x30, 0x07, 0x01, 0x01, 0x00, 0x02, 0x02, 0x09, 0x09, 0x30, 0x07, 0x02, 0x02, 0x09, 0x09, 0x01, 0x01, 0x01, 0x30, 0x0C, 0x0C, 0x07, 0x4F, 0x68, 0x20, 0x79, 0x65, 0x61, 0x68, 0x01, 0x01, 0x01, 0x30, 0x1B, 0x04, 0x03, 0xFC, 0xFF, 0xFA, 0x30, 0x14, 0x01, 0x01, 0x00, 0x04, 0x05, 0x10, 0xFF, 0x00, 0x12, 0xA5, 0x0C, 0x08, 0x49, 0x6E, 0x20, 0x41, 0x72, 0x72, 0x61, 0x79, };
     test_dictionary(dictionary, array_size(expected_result), expected_result);
     CFReleaseSafe(dictionary);
+
+    test_large_dictionary();
+    test_streaming();
 }
 
 int su_15_cfdictionary_der(int argc, char *const *argv)
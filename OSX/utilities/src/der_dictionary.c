@@ -23,6 +23,8 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "utilities/SecCFRelease.h"
 #include "utilities/der_plist.h"
@@ -111,6 +113,111 @@ exit:
     return payload;
 }
 
+//
+// Streaming access: walk the encoded pairs without building a CFDictionary.
+//
+
+// Returns the end of the DER element (of any type) starting at der.
+static const uint8_t* der_element_end(const uint8_t* der, const uint8_t *der_end)
+{
+    ccder_tag tag;
+    size_t length = 0;
+    const uint8_t *body = ccder_decode_len(&length, ccder_decode_tag(&tag, der, der_end), der_end);
+    if (NULL == body || length > (size_t)(der_end - body))
+        return NULL;
+    return body + length;
+}
+
+const uint8_t* der_visit_dictionary(CFErrorRef *error, const uint8_t* der, const uint8_t *der_end,
+                                    der_dictionary_visitor visitor)
+{
+    if (NULL == der)
+        return NULL;
+
+    const uint8_t *payload_end = 0;
+    const uint8_t *payload = ccder_decode_constructed_tl(CCDER_CONSTRUCTED_SET, &payload_end, der, der_end);
+
+    if (NULL == payload) {
+        SecCFDERCreateError(kSecDERErrorUnknownEncoding, CFSTR("Unknown data encoding, expected CCDER_CONSTRUCTED_SET"), NULL, error);
+        return NULL;
+    }
+
+    bool more = true;
+    while (more && payload < payload_end) {
+        const uint8_t *pair_end = 0;
+        const uint8_t *key = ccder_decode_constructed_tl(CCDER_CONSTRUCTED_SEQUENCE, &pair_end, payload, payload_end);
+        const uint8_t *key_end = key ? der_element_end(key, pair_end) : NULL;
+        const uint8_t *value_end = key_end ? der_element_end(key_end, pair_end) : NULL;
+
+        if (NULL == value_end || value_end != pair_end) {
+            SecCFDERCreateError(kSecDERErrorUnknownEncoding, CFSTR("Unknown data encoding, expected key value CCDER_CONSTRUCTED_SEQUENCE"), NULL, error);
+            return NULL;
+        }
+
+        more = visitor(key, key_end, key_end, value_end);
+        payload = pair_end;
+    }
+
+    return payload_end;
+}
+
+const uint8_t* der_find_dictionary_value(CFStringRef key, const uint8_t **value, const uint8_t **value_end,
+                                         CFErrorRef *error, const uint8_t* der, const uint8_t *der_end)
+{
+    // Keys are compared in their encoded form, so encode the one we're after once up front.
+    uint8_t inline_key[64];
+    uint8_t *encoded_key = inline_key;
+    size_t key_size = der_sizeof_string(key, error);
+    if (key_size == 0)
+        return NULL;
+    if (key_size > sizeof(inline_key)) {
+        encoded_key = malloc(key_size);
+        if (encoded_key == NULL) {
+            SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to allocate key"), NULL, error);
+            return NULL;
+        }
+    }
+
+    const uint8_t *result = NULL;
+    if (der_encode_string(key, error, encoded_key, encoded_key + key_size) == encoded_key) {
+        *value = NULL;
+        *value_end = NULL;
+        result = der_visit_dictionary(error, der, der_end, ^bool(const uint8_t *key_der, const uint8_t *key_der_end,
+                                                                 const uint8_t *value_der, const uint8_t *value_der_end) {
+            if ((size_t)(key_der_end - key_der) == key_size && memcmp(key_der, encoded_key, key_size) == 0) {
+                *value = value_der;
+                *value_end = value_der_end;
+                return false;
+            }
+            return true;
+        });
+    }
+
+    if (encoded_key != inline_key)
+        free(encoded_key);
+    return result;
+}
+
+const uint8_t* der_decode_dictionary_value(CFAllocatorRef allocator, CFOptionFlags mutability, CFStringRef key,
+                                           CFPropertyListRef* value, CFErrorRef *error,
+                                           const uint8_t* der, const uint8_t *der_end)
+{
+    const uint8_t *value_der = NULL;
+    const uint8_t *value_der_end = NULL;
+    const uint8_t *result = der_find_dictionary_value(key, &value_der, &value_der_end, error, der, der_end);
+
+    *value = NULL;
+    if (result && value_der) {
+        CFPropertyListRef decoded = NULL;
+        if (der_decode_plist(allocator, mutability, &decoded, error, value_der, value_der_end) != value_der_end) {
+            CFReleaseNull(decoded);
+            return NULL;
+        }
+        *value = decoded;
+    }
+    return result;
+}
+
 struct size_context {
     bool   success;
     size_t size;
@@ -168,77 +275,123 @@ static uint8_t* der_encode_key_value(CFPropertyListRef key, CFPropertyListRef va
            der_encode_plist(value, error, der, der_end)));
 }
 
+/* Pairs are encoded straight into the destination buffer in whatever order
+ CFDictionary hands them to us, then put in canonical (sorted SET OF) order by
+ sorting their locations and moving the bytes once.  Small dictionaries are
+ handled without touching the heap. */
+#define DER_DICTIONARY_INLINE_PAIRS 32
+#define DER_DICTIONARY_INLINE_SCRATCH 1024
+
+struct encoded_pair {
+    const uint8_t *bytes;
+    size_t length;
+};
+
 struct encode_context {
     bool         success;
     CFErrorRef * error;
-    CFMutableArrayRef list;
-    CFAllocatorRef allocator;
+    const uint8_t *der;
+    uint8_t *der_end;
+    struct encoded_pair *pairs;
+    CFIndex count;
 };
 
-static void add_sequence_to_array(const void *key_void, const void *value_void, void *context_void)
+static void encode_key_value_in_place(const void *key_void, const void *value_void, void *context_void)
 {
     struct encode_context *context = (struct encode_context *) context_void;
     if (context->success) {
-        CFTypeRef key = (CFTypeRef) key_void;
-        CFTypeRef value = (CFTypeRef) value_void;
-
-        size_t der_size = der_sizeof_key_value(key, value, context->error);
-        if (der_size == 0) {
-            context-> success = false;
+        uint8_t *pair_end = context->der_end;
+        uint8_t *pair_begin = der_encode_key_value((CFTypeRef) key_void, (CFTypeRef) value_void, context->error,
+                                                   context->der, pair_end);
+        if (pair_begin == NULL) {
+            context->success = false;
         } else {
-            CFMutableDataRef encoded_kv = CFDataCreateMutable(context->allocator, der_size);
-            CFDataSetLength(encoded_kv, der_size);
-
-            uint8_t* const encode_begin = CFDataGetMutableBytePtr(encoded_kv);
-            uint8_t* encode_end = encode_begin + der_size;
-
-            encode_end = der_encode_key_value(key, value, context->error, encode_begin, encode_end);
-
-            if (encode_end != NULL) {
-                CFDataDeleteBytes(encoded_kv, CFRangeMake(0, (encode_end - encode_begin)));
-                CFArrayAppendValue(context->list, encoded_kv);
-            } else {
-                context-> success = false;
-            }
-
-            CFReleaseNull(encoded_kv);
+            context->pairs[context->count].bytes = pair_begin;
+            context->pairs[context->count].length = pair_end - pair_begin;
+            context->count++;
+            context->der_end = pair_begin;
         }
     }
 }
 
-static CFComparisonResult cfdata_compare_contents(const void *val1, const void *val2, void *context __unused)
+// Same ordering as CFDataCompare
+static int encoded_pair_compare(const void *val1, const void *val2)
 {
-    return CFDataCompare((CFDataRef) val1, (CFDataRef) val2);
+    const struct encoded_pair *left = (const struct encoded_pair *) val1;
+    const struct encoded_pair *right = (const struct encoded_pair *) val2;
+    const size_t shortest = (left->length <= right->length) ? left->length : right->length;
+
+    int comparison = memcmp(left->bytes, right->bytes, shortest);
+    if (comparison != 0)
+        return comparison;
+    return (left->length > right->length) - (left->length < right->length);
 }
 
-
 uint8_t* der_encode_dictionary(CFDictionaryRef dictionary, CFErrorRef *error,
                                const uint8_t *der, uint8_t *der_end)
 {
-    CFMutableArrayRef elements = CFArrayCreateMutable(NULL, 0, &kCFTypeArrayCallBacks);
-    
-    struct encode_context context = { .success = true, .error = error, .list = elements };
-    CFDictionaryApplyFunction(dictionary, add_sequence_to_array, &context);
-    
-    if (!context.success) {
-        CFReleaseNull(elements);
+    if (der_end == NULL)
         return NULL;
-    }
-    
-    CFRange allOfThem = CFRangeMake(0, CFArrayGetCount(elements));
 
-    CFArraySortValues(elements, allOfThem, cfdata_compare_contents, NULL);
+    CFIndex count = CFDictionaryGetCount(dictionary);
+    struct encoded_pair inline_pairs[DER_DICTIONARY_INLINE_PAIRS];
+    struct encoded_pair *pairs = inline_pairs;
+    if (count > DER_DICTIONARY_INLINE_PAIRS) {
+        pairs = malloc(count * sizeof(*pairs));
+        if (pairs == NULL) {
+            SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to allocate dictionary pairs"), NULL, error);
+            return NULL;
+        }
+    }
 
     uint8_t* original_der_end = der_end;
+    struct encode_context context = { .success = true, .error = error, .der = der, .der_end = der_end, .pairs = pairs };
+    CFDictionaryApplyFunction(dictionary, encode_key_value_in_place, &context);
 
-    for(CFIndex position = CFArrayGetCount(elements); position > 0;) {
-        --position;
-        CFDataRef data = CFArrayGetValueAtIndex(elements, position);
-        der_end = ccder_encode_body(CFDataGetLength(data), CFDataGetBytePtr(data), der, der_end);
+    if (!context.success) {
+        der_end = NULL;
+        goto exit;
     }
 
-    CFReleaseNull(elements);
+    der_end = context.der_end;
+    qsort(pairs, context.count, sizeof(*pairs), encoded_pair_compare);
 
-    return ccder_encode_constructed_tl(CCDER_CONSTRUCTED_SET, original_der_end, der, der_end);
+    bool in_order = true;
+    for (CFIndex position = 1; position < context.count; ++position) {
+        if (pairs[position - 1].bytes + pairs[position - 1].length != pairs[position].bytes) {
+            in_order = false;
+            break;
+        }
+    }
 
+    if (!in_order) {
+        size_t body_length = original_der_end - der_end;
+        uint8_t inline_scratch[DER_DICTIONARY_INLINE_SCRATCH];
+        uint8_t *scratch = inline_scratch;
+        if (body_length > sizeof(inline_scratch)) {
+            scratch = malloc(body_length);
+            if (scratch == NULL) {
+                SecCFDERCreateError(kSecDERErrorAllocationFailure, CFSTR("Failed to allocate dictionary scratch"), NULL, error);
+                der_end = NULL;
+                goto exit;
+            }
+        }
+        memcpy(scratch, der_end, body_length);
+
+        uint8_t *cursor = der_end;
+        for (CFIndex position = 0; position < context.count; ++position) {
+            memcpy(cursor, scratch + (pairs[position].bytes - der_end), pairs[position].length);
+            cursor += pairs[position].length;
+        }
+
+        if (scratch != inline_scratch)
+            free(scratch);
+    }
+
+    der_end = ccder_encode_constructed_tl(CCDER_CONSTRUCTED_SET, original_der_end, der, der_end);
+
+exit:
+    if (pairs != inline_pairs)
+        free(pairs);
+    return der_end;
 }
@@ -59,6 +59,29 @@ const uint8_t* der_decode_plist(CFAllocatorRef pl, CFOptionFlags mutability,
                                 CFPropertyListRef* cf, CFErrorRef *error,
                                 const uint8_t* der, const uint8_t *der_end);
 
+// Pull style access to DER encoded dictionaries, for callers that only need some
+// of the entries.  Nothing is turned into CF objects unless asked for.
+
+// Called with the encoded key and value of each entry; return false to stop.
+typedef bool (^der_dictionary_visitor)(const uint8_t *key_der, const uint8_t *key_der_end,
+                                       const uint8_t *value_der, const uint8_t *value_der_end);
+
+// Visits the entries of the dictionary at der in encoded order.  Returns the
+// end of the dictionary, or NULL if it is malformed.
+const uint8_t* der_visit_dictionary(CFErrorRef *error, const uint8_t* der, const uint8_t *der_end,
+                                    der_dictionary_visitor visitor);
+
+// Locates the encoded value for key, setting *value and *value_end to NULL if
+// key isn't present.  Returns the end of the dictionary, or NULL if it is malformed.
+const uint8_t* der_find_dictionary_value(CFStringRef key, const uint8_t **value, const uint8_t **value_end,
+                                         CFErrorRef *error, const uint8_t* der, const uint8_t *der_end);
+
+// Decodes only the value for key, setting *value to NULL if key isn't present.
+// Returns the end of the dictionary, or NULL if it is malformed.
+const uint8_t* der_decode_dictionary_value(CFAllocatorRef allocator, CFOptionFlags mutability, CFStringRef key,
+                                           CFPropertyListRef* value, CFErrorRef *error,
+                                           const uint8_t* der, const uint8_t *der_end);
+
 CFDataRef CFPropertyListCreateDERData(CFAllocatorRef allocator, CFPropertyListRef plist, CFErrorRef *error);
 
 CFPropertyListRef CFPropertyListCreateWithDERData(CFAllocatorRef allocator, CFDataRef data, CFOptionFlags options, CFPropertyListFormat *format, CFErrorRef *error);
@@ -23,6 +23,7 @@
 
 #import <XCTest/XCTest.h>
 #import <Security/SFAnalytics.h>
+#import "SFAnalytics+Internal.h"
 #import "SFAnalyticsDefines.h"
 #import "SFAnalyticsSQLiteStore.h"
 #import "SFSQLite.h"
@@ -71,26 +72,31 @@ static NSString* product = NULL;
 
 - (void)assertNoSuccessEvents
 {
+    [_analytics flushPendingWrites];
     XCTAssertFalse([[_db fetch:@"select * from success_count"] next]);
 }
 
 - (void)assertNoHardFailures
 {
+    [_analytics flushPendingWrites];
     XCTAssertFalse([[_db fetch:@"select * from hard_failures"] next]);
 }
 
 - (void)assertNoSoftFailures
 {
+    [_analytics flushPendingWrites];
     XCTAssertFalse([[_db fetch:@"select * from soft_failures"] next]);
 }
 
 - (void)assertNoAllEvents
 {
+    [_analytics flushPendingWrites];
     XCTAssertFalse([[_db fetch:@"select * from all_events"] next]);
 }
 
 - (void)assertNoSamples
 {
+    [_analytics flushPendingWrites];
     XCTAssertFalse([[_db fetch:@"select * from samples"] next]);
 }
 
@@ -143,6 +149,7 @@ static NSString* product = NULL;
 
 - (void)checkSuccessCountsForEvent:(NSString*)eventType success:(int)success hard:(int)hard soft:(int)soft
 {
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from success_count where event_type = %@", eventType];
     XCTAssert([result next]);
     XCTAssertTrue([[result stringAtIndex:0] isEqualToString:eventType], @"event name \"%@\", expected \"%@\"", [result stringAtIndex:0], eventType);
@@ -156,6 +163,7 @@ static NSString* product = NULL;
 {
     NSUInteger samplescount = 0, targetcount = 0;
     NSMutableArray* samplesfound = [NSMutableArray array];
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from samples"];
     while ([result next]) {
         ++samplescount;
@@ -282,6 +290,7 @@ static NSString* product = NULL;
     [self assertNoHardFailures];
     [self assertNoSoftFailures];
 
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select success_count from success_count"];
     XCTAssert([result next], @"a row was found after adding an event");
     XCTAssertEqual([result intAtIndex:0], 1, @"success count is 1 after adding an event");
@@ -299,6 +308,7 @@ static NSString* product = NULL;
     [self checkSuccessCountsForEvent:@"unittestevent" success:0 hard:0 soft:1];
 
     // then check soft_failures itself
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from soft_failures"];
     [self properEventLogged:result eventType:@"unittestevent" class:SFAnalyticsEventClassSoftFailure];
 
@@ -316,6 +326,7 @@ static NSString* product = NULL;
     [self checkSuccessCountsForEvent:@"unittestevent" success:0 hard:0 soft:1];
 
     // then check soft_failures itself
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from soft_failures"];
     [self properEventLogged:result eventType:@"unittestevent" class:SFAnalyticsEventClassSoftFailure attributes:attrs];
 
@@ -333,6 +344,7 @@ static NSString* product = NULL;
     [self checkSuccessCountsForEvent:@"unittestevent" success:0 hard:1 soft:0];
 
     // then check hard_failures itself
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from hard_failures"];
     [self properEventLogged:result eventType:@"unittestevent" class:SFAnalyticsEventClassHardFailure];
 
@@ -351,6 +363,7 @@ static NSString* product = NULL;
     [self checkSuccessCountsForEvent:@"unittestevent" success:0 hard:1 soft:0];
 
     // then check hard_failures itself
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from hard_failures"];
     [self properEventLogged:result eventType:@"unittestevent" class:SFAnalyticsEventClassHardFailure attributes:attrs];
 
@@ -387,6 +400,7 @@ static NSString* product = NULL;
     // First check success_count has logged a success
     [self checkSuccessCountsForEvent:@"unittestevent" success:1 hard:0 soft:0];
 
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select * from all_events"];
     [self properEventLogged:result eventType:@"unittestevent" class:SFAnalyticsEventClassNote];
 }
@@ -740,6 +754,7 @@ static NSString* product = NULL;
         [_analytics logHardFailureForEventNamed:@"ringbufferevent" withAttributes:nil];
     }
 
+    [_analytics flushPendingWrites];
     PQLResultSet* result = [_db fetch:@"select count(*) from hard_failures"];
     XCTAssertTrue([result next], @"Got a count from hard_failures");
     XCTAssertLessThanOrEqual([result unsignedIntAtIndex:0], SFAnalyticsMaxEventsToReport, @"Ring buffer contains a sane number of events");
@@ -750,6 +765,72 @@ static NSString* product = NULL;
     XCTAssertLessThanOrEqual([result unsignedIntAtIndex:0], SFAnalyticsMaxEventsToReport + 50);
 }
 
+// MARK: Batched writes
+
+- (void)testPendingCountsMergeIntoOneRow
+{
+    for (unsigned idx = 0; idx < 3; ++idx) {
+        [_analytics logSuccessForEventNamed:@"mergedevent"];
+    }
+    [_analytics logHardFailureForEventNamed:@"mergedevent" withAttributes:nil];
+    [_analytics logHardFailureForEventNamed:@"mergedevent" withAttributes:nil];
+    [_analytics logSoftFailureForEventNamed:@"mergedevent" withAttributes:nil];
+    [self checkSuccessCountsForEvent:@"mergedevent" success:3 hard:2 soft:1];
+
+    // A second batch adds to the row the first one wrote
+    [_analytics logSuccessForEventNamed:@"mergedevent"];
+    [_analytics logSoftFailureForEventNamed:@"mergedevent" withAttributes:nil];
+    [self checkSuccessCountsForEvent:@"mergedevent" success:4 hard:2 soft:2];
+}
+
+- (void)testPendingWritesFlushAtThreshold
+{
+    // Each success costs two pending writes, an all_events row and a success_count increment,
+    // so the last of these leaves us one event short of SFAnalyticsMaxPendingWrites
+    NSUInteger writesPerSuccess = 2;
+    NSUInteger successesToFlush = SFAnalyticsMaxPendingWrites / writesPerSuccess;
+    for (NSUInteger idx = 0; idx < successesToFlush - 1; ++idx) {
+        [_analytics logSuccessForEventNamed:@"thresholdevent"];
+    }
+    XCTAssertFalse([[_db fetch:@"select * from success_count"] next], @"writes below the threshold are held back");
+    XCTAssertFalse([[_db fetch:@"select * from all_events"] next], @"writes below the threshold are held back");
+
+    [_analytics logSuccessForEventNamed:@"thresholdevent"];
+    PQLResultSet* result = [_db fetch:@"select success_count from success_count where event_type = %@", @"thresholdevent"];
+    XCTAssert([result next], @"reaching the threshold wrote the pending increments");
+    XCTAssertEqual([result intAtIndex:0], (int)successesToFlush, @"all pending increments were written");
+    XCTAssertFalse([result next], @"only one row for the event");
+}
+
+- (void)testClearAllDataDropsPendingWrites
+{
+    [_analytics logSuccessForEventNamed:@"clearedevent"];
+    [_analytics logHardFailureForEventNamed:@"clearedevent" withAttributes:nil];
+    [_analytics logSoftFailureForEventNamed:@"clearedevent" withAttributes:nil];
+    XCTAssertFalse([[_db fetch:@"select * from all_events"] next], @"events are still pending");
+
+    // Same store instance the logger writes through
+    SFAnalyticsSQLiteStore* store = [SFAnalyticsSQLiteStore storeWithPath:_dbpath schema:SFAnalyticsTableSchema];
+    XCTAssertNotNil(store);
+    [store clearAllData];
+    [self assertNoEventsAnywhere];
+    [store close];
+}
+
+- (void)testRemoveSamplesDropsPendingSamples
+{
+    NSString* metricName = [NSString stringWithFormat:@"UnitTestPendingMetric_%li", (long)_testnum];
+    NSString* otherName = [NSString stringWithFormat:@"UnitTestOtherMetric_%li", (long)_testnum];
+    [_analytics logMetric:@1.0 withName:metricName];
+    [_analytics logMetric:@2.0 withName:metricName];
+    [_analytics logMetric:@5.0 withName:otherName];
+    [_analytics logMetric:@3.0 withName:metricName oncePerReport:YES];
+
+    // Samples for other names survive, and the once-per-report one replaces the pending ones
+    [self checkSamples:@[@3.0] name:metricName totalSamples:2 accuracy:0.01f];
+    [self checkSamples:@[@5.0] name:otherName totalSamples:2 accuracy:0.01f];
+}
+
 - (void)testRaceToCreateLoggers
 {
     dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);